@@ -0,0 +1,133 @@
+/*
+
+S7XG library
+
+Asynchronous commands example
+
+Copyright (C) 2019 by Xose Pérez <xose at espurna dot io>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ARDUINO_ARCH_ESP32
+    #error "This scketch is meant to run on an ESP32 board"
+#endif
+
+HardwareSerial SerialS7XG(1);
+
+#include "S7XG.h"
+S7XG module;
+
+// This is required for the TTGO-T-Watch
+#if defined(ARDUINO_T_WATCH)
+
+#include <Wire.h>
+#include "axp20x.h"
+AXP20X_Class axp;
+
+void s7xg_power(bool status) {
+    axp.setLDO4Voltage(AXP202_LDO4_1800MV);
+    axp.setPowerOutPut(AXP202_LDO4, status ? AXP202_ON : AXP202_OFF);
+}
+
+#endif
+
+const char *devAddr = "26011433";
+const char *nwkSKey = "5DE49A0F0C9649B8D466B9032DAAB331";
+const char *appSKey = "EE0080DAB519CEF94E2EC83A110AA43A";
+
+bool joined = false;
+
+void joinCallback(uint8_t status, char * response, void * arg) {
+    if (S7XG_STATUS_OK == status) {
+        Serial.println("[INFO ] Joined!");
+        joined = true;
+    } else {
+        Serial.print("[ERROR] Join failed: ");
+        Serial.println(response);
+    }
+}
+
+void sendCallback(uint8_t status, char * response, void * arg) {
+    Serial.print("[INFO ] Message ");
+    Serial.print((uint32_t) arg);
+    Serial.println(S7XG_STATUS_OK == status ? " queued by the module" : " failed");
+}
+
+void txDoneCallback(bool success, void * arg) {
+    Serial.println(success ? "[INFO ] Message sent" : "[ERROR] Message not acknowledged");
+}
+
+void downlinkCallback(uint8_t port, uint8_t * data, uint8_t len, void * arg) {
+    Serial.printf("[INFO ] Downlink on port %d:", port);
+    for (uint8_t i=0; i<len; i++) Serial.printf(" %02X", data[i]);
+    Serial.println();
+}
+
+void setup() {
+
+    // Reset the S7XG module
+    #if defined(ARDUINO_T_WATCH)
+        Wire.begin(21, 22);
+        axp.begin(Wire);
+        s7xg_power(false);
+        delay(1000);
+        s7xg_power(true);
+    #endif
+
+    // Init connection to the PC
+    Serial.begin(115200);
+    delay(2000);
+    Serial.println();
+    Serial.println("[INFO ] S7XG asynchronous commands");
+    Serial.println();
+
+    // Init connection to the module
+    SerialS7XG.begin(115200, SERIAL_8N1, 34, 33);
+    module.begin(SerialS7XG);
+
+    // Results reported by the module later on are dispatched from module.loop()
+    module.onTxDone(txDoneCallback);
+    module.onDownlink(downlinkCallback);
+
+    // Blocking calls still work as usual
+    module.macPower(14);
+    module.macDatarate(S7XG_DR_SF7BW125_EU);
+    module.macADR(false);
+
+    // Queue the join sequence, the callback will be called from module.loop()
+    module.async(joinCallback)->macJoinABP(devAddr, nwkSKey, appSKey);
+
+}
+
+void loop() {
+
+    // Keep the command queue running
+    module.loop();
+
+    // Every 10 seconds (the payload must remain valid until the message is sent)
+    static uint32_t last = 0;
+    static uint32_t count = 0;
+    if (joined && (millis() - last > 10000)) {
+        last = millis();
+        count++;
+        static uint8_t payload[1];
+        payload[0] = count;
+        module.async(sendCallback, (void *) count)->macSend(payload, 1);
+    }
+
+    // Do other stuff here, the loop is never blocked waiting for the module
+
+}
@@ -0,0 +1,115 @@
+/*
+
+S7XG library
+
+GPS track example
+In this example the GPS is read every 10 seconds and the positions are sent
+in batches, a dozen per uplink, instead of one per uplink like in auto mode.
+Use extras/decoders/track.js to decode them in The Things Network.
+
+Copyright (C) 2019 by Xose Pérez <xose at espurna dot io>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ARDUINO_ARCH_ESP32
+    #error "This scketch is meant to run on an ESP32 board"
+#endif
+
+HardwareSerial SerialS7XG(1);
+
+#include "S7XG.h"
+#include "S7XGTrack.h"
+S7XG module;
+S7XGTrack track;
+
+// This is required for the TTGO-T-Watch
+#if defined(ARDUINO_T_WATCH)
+
+#include <Wire.h>
+#include "axp20x.h"
+AXP20X_Class axp;
+
+void s7xg_power(bool status) {
+    axp.setLDO4Voltage(AXP202_LDO4_1800MV);
+    axp.setPowerOutPut(AXP202_LDO4, status ? AXP202_ON : AXP202_OFF);
+}
+
+#endif
+
+const char *devAddr = "26011433";
+const char *nwkSKey = "5DE49A0F0C9649B8D466B9032DAAB331";
+const char *appSKey = "EE0080DAB519CEF94E2EC83A110AA43A";
+
+void setup() {
+
+    // Reset the S7XG module
+    #if defined(ARDUINO_T_WATCH)
+        Wire.begin(21, 22);
+        axp.begin(Wire);
+        s7xg_power(false);
+        delay(1000);
+        s7xg_power(true);
+    #endif
+
+    // Init connection to the PC
+    Serial.begin(115200);
+    delay(2000);
+    Serial.println();
+    Serial.println("[INFO ] S7XG GPS track");
+    Serial.println();
+
+    // Init connection to the module
+    SerialS7XG.begin(115200, SERIAL_8N1, 34, 33);
+    module.begin(SerialS7XG);
+
+    // Show the Device EUI
+    Serial.print  ("[INFO ] Device EUI: ");
+    Serial.println(module.getEUI());
+
+    // Transmit at max power ETSI allows
+    module.macPower(14);
+
+    // Use SF7 and BW125
+    module.macDatarate(S7XG_DR_SF7BW125_EU);
+
+    // Do not use ADR (moving device)
+    module.macADR(false);
+
+    // Read the band so the duty cycle budget is right
+    module.macBand();
+
+    // Initialize GPS (5s cycle, manual mode, gps system, hot start,...)
+    module.gpsInit();
+
+    // Join the network using Activation-By-Personalisation
+    module.macJoinABP(devAddr, nwkSKey, appSKey);
+
+    // Report the result of every uplink
+    module.onTxDone([](bool success, void * arg) {
+        Serial.printf("[INFO ] Track %s\n", success ? "sent" : "not sent");
+    });
+
+    // Read a fix every 10 seconds, send them on port 2 when the payload is full
+    // or when the oldest one is 5 minutes old
+    track.begin(module, 2, 10000);
+    track.setMaxAge(300000);
+
+}
+
+void loop() {
+    track.loop();
+    module.loop();
+}
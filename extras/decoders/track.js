@@ -0,0 +1,83 @@
+/*
+
+S7XG library
+
+Decoder for the track payloads sent by S7XGTrack (see src/S7XGTrack.cpp
+for the format). Paste it as the uplink payload formatter (Javascript) of
+the application in The Things Network, it also runs under Node.js.
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+var S7XG_TRACK_VERSION = 1;
+var S7XG_TRACK_HEADER_SIZE = 13;
+
+function readInt32(bytes, offset) {
+    return (bytes[offset] << 24) | (bytes[offset + 1] << 16) | (bytes[offset + 2] << 8) | bytes[offset + 3];
+}
+
+function readVarint(bytes, state) {
+    var value = 0;
+    var scale = 1;
+    while (state.offset < bytes.length) {
+        var b = bytes[state.offset++];
+        value += (b & 0x7F) * scale;
+        if (0 === (b & 0x80)) {
+            return (value % 2) ? -(value + 1) / 2 : value / 2;
+        }
+        scale *= 128;
+    }
+    return null;
+}
+
+function decodeTrack(bytes) {
+
+    if ((bytes.length < S7XG_TRACK_HEADER_SIZE) || (S7XG_TRACK_VERSION !== bytes[0])) return null;
+
+    var time = readInt32(bytes, 1) >>> 0;
+    var latitude = readInt32(bytes, 5);
+    var longitude = readInt32(bytes, 9);
+    var state = { offset: S7XG_TRACK_HEADER_SIZE };
+    var points = [];
+
+    while (true) {
+        points.push({
+            time: new Date(time * 1000).toISOString(),
+            latitude: latitude / 1e5,
+            longitude: longitude / 1e5
+        });
+        var dlat = readVarint(bytes, state);
+        var dlon = readVarint(bytes, state);
+        var dtime = readVarint(bytes, state);
+        if ((null === dlat) || (null === dlon) || (null === dtime)) break;
+        latitude += dlat;
+        longitude += dlon;
+        time += dtime;
+    }
+
+    return points;
+
+}
+
+// The Things Network (v3) uplink formatter
+function decodeUplink(input) {
+    var points = decodeTrack(input.bytes);
+    if (!points) return { errors: ["not a track payload"] };
+    return { data: { points: points } };
+}
+
+if (typeof module !== "undefined") module.exports = { decodeTrack: decodeTrack, decodeUplink: decodeUplink };
@@ -0,0 +1,247 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+#include <random>
+#include <unistd.h>
+#include <poll.h>
+
+StdioStream Serial;
+
+// ----------------------------------------------------------------------------
+// Core
+// ----------------------------------------------------------------------------
+
+static std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+static std::minstd_rand _random;
+
+/**
+ * @brief               Milliseconds since the program started
+ * @return              Milliseconds (wraps around after ~49 days, like on Arduino)
+ */
+uint32_t millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+/**
+ * @brief               Microseconds since the program started
+ * @return              Microseconds (wraps around after ~71 minutes, like on Arduino)
+ */
+uint32_t micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+/**
+ * @brief               Sleeps the calling thread
+ * @param[in] ms        Milliseconds
+ */
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+/**
+ * @brief               Sleeps the calling thread
+ * @param[in] us        Microseconds
+ */
+void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+/**
+ * @brief               Gives other threads a chance to run
+ */
+void yield() {
+    std::this_thread::yield();
+}
+
+long random(long max) {
+    return max > 0 ? _random() % max : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+    _random.seed(seed);
+}
+
+// ----------------------------------------------------------------------------
+// Print
+// ----------------------------------------------------------------------------
+
+size_t Print::write(const uint8_t * buffer, size_t size) {
+    size_t count = 0;
+    while (count < size) {
+        if (0 == write(buffer[count])) break;
+        count++;
+    }
+    return count;
+}
+
+size_t Print::write(const char * s) {
+    return s ? write((const uint8_t *) s, strlen(s)) : 0;
+}
+
+size_t Print::write(const char * buffer, size_t size) {
+    return write((const uint8_t *) buffer, size);
+}
+
+size_t Print::printf(const char * format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write(buffer, (size_t) len < sizeof(buffer) ? len : sizeof(buffer) - 1);
+}
+
+size_t Print::print(const __FlashStringHelper * s) {
+    return write(reinterpret_cast<const char *>(s));
+}
+
+size_t Print::print(const char * s) {
+    return write(s);
+}
+
+size_t Print::print(char ch) {
+    return write((uint8_t) ch);
+}
+
+size_t Print::print(unsigned char value, int base) {
+    return _printNumber(value, base, false);
+}
+
+size_t Print::print(int value, int base) {
+    return print((long) value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+    return _printNumber(value, base, false);
+}
+
+size_t Print::print(long value, int base) {
+    if ((value < 0) && (DEC == base)) return _printNumber(-(unsigned long) value, base, true);
+    return _printNumber(value, base, false);
+}
+
+size_t Print::print(unsigned long value, int base) {
+    return _printNumber(value, base, false);
+}
+
+size_t Print::print(double value, int digits) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return write(buffer);
+}
+
+size_t Print::println() {
+    return write("\r\n");
+}
+
+size_t Print::_printNumber(unsigned long value, int base, bool negative) {
+    char buffer[8 * sizeof(long) + 2];
+    char * p = &buffer[sizeof(buffer) - 1];
+    *p = 0;
+    if (base < 2) base = 10;
+    do {
+        uint8_t digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    if (negative) *--p = '-';
+    return write(p);
+}
+
+// ----------------------------------------------------------------------------
+// Stream
+// ----------------------------------------------------------------------------
+
+int Stream::_timedRead() {
+    uint32_t start = millis();
+    do {
+        int ch = read();
+        if (ch >= 0) return ch;
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char * buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int ch = _timedRead();
+        if (ch < 0) break;
+        buffer[count++] = (char) ch;
+    }
+    return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char * buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int ch = _timedRead();
+        if ((ch < 0) || (ch == terminator)) break;
+        buffer[count++] = (char) ch;
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+// StdioStream
+// ----------------------------------------------------------------------------
+
+int StdioStream::available() {
+    if (_peeked >= 0) return 1;
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    return (poll(&pfd, 1, 0) > 0) && (pfd.revents & POLLIN) ? 1 : 0;
+}
+
+int StdioStream::read() {
+    int ch = peek();
+    _peeked = -1;
+    return ch;
+}
+
+int StdioStream::peek() {
+    if (_peeked < 0 && available()) {
+        uint8_t ch;
+        if (1 == ::read(STDIN_FILENO, &ch, 1)) _peeked = ch;
+    }
+    return _peeked;
+}
+
+size_t StdioStream::write(uint8_t ch) {
+    return fwrite(&ch, 1, 1, stdout);
+}
+
+size_t StdioStream::write(const uint8_t * buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void StdioStream::flush() {
+    fflush(stdout);
+}
@@ -0,0 +1,77 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+Minimal Arduino compatibility layer for POSIX hosts. It only covers
+what the S7XG library and its host tools use.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// ----------------------------------------------------------------------------
+// PROGMEM
+// ----------------------------------------------------------------------------
+
+#define PROGMEM
+#define PGM_P                                 const char *
+#define PSTR(s)                               (s)
+#define pgm_read_byte(p)                      (*(const uint8_t *)(p))
+#define strlen_P                              strlen
+#define strcmp_P                              strcmp
+#define strncmp_P                             strncmp
+#define strncpy_P                             strncpy
+#define memcpy_P                              memcpy
+#define snprintf_P                            snprintf
+#define vsnprintf_P                           vsnprintf
+
+class __FlashStringHelper;
+#define F(s)                                  (reinterpret_cast<const __FlashStringHelper *>(s))
+
+// ----------------------------------------------------------------------------
+// Core
+// ----------------------------------------------------------------------------
+
+#define DEC                                   10
+#define HEX                                   16
+#define OCT                                   8
+#define BIN                                   2
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+#include "Print.h"
+#include "Stream.h"
+#include "StdioStream.h"
+
+extern StdioStream Serial;
@@ -0,0 +1,210 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "PosixSerial.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+
+/**
+ * @brief               Closes the port on destruction
+ */
+PosixSerial::~PosixSerial() {
+    end();
+}
+
+/**
+ * @brief               Opens a serial device in raw mode
+ * @param[in] device    Device path, like /dev/ttyUSB0
+ * @param[in] baud      Baudrate (defaults to 115200)
+ * @return              True if everything OK
+ */
+bool PosixSerial::begin(const char * device, uint32_t baud) {
+    end();
+    _fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (_fd < 0) return false;
+    if (!_raw() || !setBaudrate(baud)) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief               Uses an already open file descriptor (the stream takes ownership)
+ * @param[in] fd        File descriptor
+ * @return              True if everything OK
+ */
+bool PosixSerial::begin(int fd) {
+    end();
+    if (fd < 0) return false;
+    _fd = fd;
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+    if (isatty(_fd)) _raw();
+    return true;
+}
+
+/**
+ * @brief               Opens a new pseudo-terminal and binds the stream to its master side
+ * @details             Other processes can open the returned slave device as if it was a serial port.
+ * @return              Path to the slave device or NULL if error
+ */
+const char * PosixSerial::openPty() {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0) return NULL;
+    if ((grantpt(fd) < 0) || (unlockpt(fd) < 0)) {
+        close(fd);
+        return NULL;
+    }
+    const char * name = ptsname(fd);
+    if (!name || !begin(fd)) return NULL;
+    return name;
+}
+
+/**
+ * @brief               Changes the line speed
+ * @param[in] baud      Baudrate
+ * @return              True if the baudrate is supported
+ */
+bool PosixSerial::setBaudrate(uint32_t baud) {
+
+    speed_t speed;
+    switch (baud) {
+        case 9600: speed = B9600; break;
+        case 19200: speed = B19200; break;
+        case 38400: speed = B38400; break;
+        case 57600: speed = B57600; break;
+        case 115200: speed = B115200; break;
+        case 230400: speed = B230400; break;
+        #if defined(B460800)
+        case 460800: speed = B460800; break;
+        #endif
+        #if defined(B921600)
+        case 921600: speed = B921600; break;
+        #endif
+        default: return false;
+    }
+
+    struct termios tty;
+    if (tcgetattr(_fd, &tty) < 0) return false;
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    return 0 == tcsetattr(_fd, TCSADRAIN, &tty);
+
+}
+
+/**
+ * @brief               Closes the port
+ */
+void PosixSerial::end() {
+    if (_fd >= 0) close(_fd);
+    _fd = -1;
+    _head = _tail = 0;
+}
+
+/**
+ * @brief               Underlying file descriptor, for poll/select
+ * @return              File descriptor or -1 if closed
+ */
+int PosixSerial::fd() {
+    return _fd;
+}
+
+int PosixSerial::available() {
+    _fill();
+    return _tail - _head;
+}
+
+int PosixSerial::read() {
+    if ((_head == _tail) && !_fill()) return -1;
+    return _buffer[_head++];
+}
+
+int PosixSerial::peek() {
+    if ((_head == _tail) && !_fill()) return -1;
+    return _buffer[_head];
+}
+
+/**
+ * @brief               Reads up to length bytes, only waits (up to the stream timeout) if nothing is buffered
+ * @param[out] buffer   Destination
+ * @param[in] length    Maximum number of bytes
+ * @return              Number of bytes read
+ */
+size_t PosixSerial::readBytes(char * buffer, size_t length) {
+    if ((_head == _tail) && !_fill()) return Stream::readBytes(buffer, length > 0 ? 1 : 0);
+    size_t count = _tail - _head;
+    if (count > length) count = length;
+    memcpy(buffer, &_buffer[_head], count);
+    _head += count;
+    return count;
+}
+
+size_t PosixSerial::write(uint8_t ch) {
+    return write(&ch, 1);
+}
+
+size_t PosixSerial::write(const uint8_t * buffer, size_t size) {
+    size_t count = 0;
+    while ((_fd >= 0) && (count < size)) {
+        ssize_t written = ::write(_fd, buffer + count, size - count);
+        if (written > 0) {
+            count += written;
+        } else if ((written < 0) && (EAGAIN != errno) && (EINTR != errno)) {
+            break;
+        }
+    }
+    return count;
+}
+
+void PosixSerial::flush() {
+    if (_fd >= 0) tcdrain(_fd);
+}
+
+/**
+ * @brief               Reads whatever the driver has into the internal buffer
+ * @return              True if there is any data buffered
+ */
+bool PosixSerial::_fill() {
+    if (_head == _tail) _head = _tail = 0;
+    if ((_fd >= 0) && (_tail < sizeof(_buffer))) {
+        ssize_t count = ::read(_fd, &_buffer[_tail], sizeof(_buffer) - _tail);
+        if (count > 0) _tail += count;
+    }
+    return _head != _tail;
+}
+
+/**
+ * @brief               Sets the terminal in raw mode (8N1, no flow control)
+ * @return              True if everything OK
+ */
+bool PosixSerial::_raw() {
+    struct termios tty;
+    if (tcgetattr(_fd, &tty) < 0) return false;
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    return 0 == tcsetattr(_fd, TCSANOW, &tty);
+}
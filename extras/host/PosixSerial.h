@@ -0,0 +1,69 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "Arduino.h"
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+#define POSIX_SERIAL_BUFFER_SIZE              256
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+// Serial port (or pseudo-terminal) on a POSIX host, for USB-UART adapters
+class PosixSerial : public Stream {
+
+  public:
+
+    ~PosixSerial();
+
+    bool begin(const char * device, uint32_t baud = 115200);
+    bool begin(int fd);
+    const char * openPty();
+    bool setBaudrate(uint32_t baud);
+    void end();
+    int fd();
+
+    // Stream
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(char * buffer, size_t length);
+    size_t write(uint8_t ch);
+    size_t write(const uint8_t * buffer, size_t size);
+    void flush();
+
+  protected:
+
+    bool _fill();
+    bool _raw();
+
+    int _fd = -1;
+    uint8_t _buffer[POSIX_SERIAL_BUFFER_SIZE];
+    size_t _head = 0;
+    size_t _tail = 0;
+
+};
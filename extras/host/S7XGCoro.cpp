@@ -0,0 +1,398 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGCoro.h"
+
+#include <algorithm>
+#include <new>
+
+// Executor pause when there is nothing to resume, keeps an idle run() off the CPU
+#define S7XG_CORO_PAUSE_US                    50
+
+uint32_t S7XGTask::_frames = 0;
+uint32_t S7XGTask::_frame_bytes = 0;
+
+// ----------------------------------------------------------------------------
+// Task
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Destroys the coroutine unless it has been spawned
+ */
+S7XGTask::~S7XGTask() {
+    if (_handle) _handle.destroy();
+}
+
+/**
+ * @brief               Tells whether the coroutine has run to completion
+ * @return              True if done (or spawned, the executor owns it then)
+ */
+bool S7XGTask::done() {
+    return !_handle || _handle.done();
+}
+
+/**
+ * @brief               Starts the coroutine, the caller is resumed when it finishes
+ * @param[in] caller    Awaiting coroutine
+ * @return              Coroutine to run next
+ */
+std::coroutine_handle<> S7XGTask::await_suspend(std::coroutine_handle<> caller) {
+    _handle.promise().continuation = caller;
+    return _handle;
+}
+
+/**
+ * @brief               Number of coroutine frames alive
+ * @return              Frame count
+ */
+uint32_t S7XGTask::frames() {
+    return _frames;
+}
+
+/**
+ * @brief               Memory taken by the coroutine frames alive
+ * @return              Number of bytes
+ */
+uint32_t S7XGTask::frameBytes() {
+    return _frame_bytes;
+}
+
+/**
+ * @brief               Resumes the awaiting coroutine, or frees a spawned one
+ * @param[in] handle    Coroutine that has just finished
+ * @return              Coroutine to run next
+ */
+std::coroutine_handle<> S7XGTask::promise_type::final_awaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+    promise_type & promise = handle.promise();
+    if (promise.continuation) return promise.continuation;
+    if (promise.executor) {
+        promise.executor->_tasks--;
+        handle.destroy();
+    }
+    return std::noop_coroutine();
+}
+
+/**
+ * @brief               Allocates a coroutine frame
+ * @param[in] size      Frame size
+ * @return              Frame
+ */
+void * S7XGTask::promise_type::operator new(size_t size) {
+    _frames++;
+    _frame_bytes += size;
+    return ::operator new(size);
+}
+
+/**
+ * @brief               Frees a coroutine frame
+ * @param[in] frame     Frame
+ * @param[in] size      Frame size
+ */
+void S7XGTask::promise_type::operator delete(void * frame, size_t size) {
+    _frames--;
+    _frame_bytes -= size;
+    ::operator delete(frame);
+}
+
+// ----------------------------------------------------------------------------
+// Executor
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Runs a coroutine from the executor
+ * @details             The executor takes ownership of the coroutine and frees it when it finishes.
+ *                      It starts on the next step().
+ * @param[in] task      Coroutine, example: executor.spawn(provision(session));
+ */
+void S7XGExecutor::spawn(S7XGTask && task) {
+    if (!task._handle) return;
+    task._handle.promise().executor = this;
+    _schedule(task._handle);
+    task._handle = NULL;
+    _tasks++;
+}
+
+/**
+ * @brief               Moves every session on once and resumes the coroutines whose operations completed
+ * @details             Never blocks. Coroutines scheduled while resuming run on the next step.
+ * @return              True while there are spawned coroutines running
+ */
+bool S7XGExecutor::step() {
+
+    for (size_t i=0; i<_sessions.size(); i++) _sessions[i]->_service();
+
+    size_t count = _ready.size();
+    while (count--) {
+        std::coroutine_handle<> handle = _ready.front();
+        _ready.pop_front();
+        handle.resume();
+    }
+
+    return _tasks > 0;
+
+}
+
+/**
+ * @brief               Calls step() until all the spawned coroutines have finished
+ */
+void S7XGExecutor::run() {
+    while (step()) {
+        if (_ready.empty()) delayMicroseconds(S7XG_CORO_PAUSE_US);
+    }
+}
+
+/**
+ * @brief               Number of spawned coroutines that have not finished yet
+ * @return              Coroutine count
+ */
+uint32_t S7XGExecutor::tasks() {
+    return _tasks;
+}
+
+/**
+ * @brief               Queues a coroutine to be resumed on the next step
+ * @param[in] handle    Coroutine
+ */
+void S7XGExecutor::_schedule(std::coroutine_handle<> handle) {
+    _ready.push_back(handle);
+}
+
+/**
+ * @brief               Adds a session to the ones moved on by step()
+ * @param[in] session   Session
+ */
+void S7XGExecutor::_attach(S7XGSession * session) {
+    _sessions.push_back(session);
+}
+
+/**
+ * @brief               Removes a session
+ * @param[in] session   Session
+ */
+void S7XGExecutor::_detach(S7XGSession * session) {
+    _sessions.erase(std::remove(_sessions.begin(), _sessions.end(), session), _sessions.end());
+}
+
+// ----------------------------------------------------------------------------
+// Operations
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Suspends the awaiting coroutine and queues the call
+ * @param[in] handle    Awaiting coroutine
+ */
+void S7XGWaiter::await_suspend(std::coroutine_handle<> handle) {
+    _handle = handle;
+    _session->_queue(this);
+}
+
+/**
+ * @brief               Queues the call with module.async()
+ * @return              False if the module queue was full, nothing has been queued then
+ */
+bool S7XGWaiter::_start() {
+    S7XG & module = *_session->_module;
+    S7XGAsync call = module.async(_callback, this);
+    _issue(module);
+    return !call.failed();
+}
+
+/**
+ * @brief               Stores the result and schedules the awaiting coroutine
+ * @param[in] status    S7XG_STATUS_* value
+ * @param[in] response  Last line from the module (can be NULL)
+ */
+void S7XGWaiter::_complete(uint8_t status, const char * response) {
+    _result.status = status;
+    _store(response);
+    _session->_status = status;
+    _session->_pending--;
+    _session->_executor->_schedule(_handle);
+}
+
+/**
+ * @brief               Keeps the response for await_resume
+ * @param[in] response  Last line from the module (can be NULL), truncated to S7XG_CORO_RESPONSE_SIZE
+ */
+void S7XGWaiter::_store(const char * response) {
+    strncpy(_result.response, response ? response : "", S7XG_CORO_RESPONSE_SIZE - 1);
+    _result.response[S7XG_CORO_RESPONSE_SIZE - 1] = 0;
+}
+
+/**
+ * @brief               Async callback, completes the operation or waits for its event
+ * @param[in] status    Call status
+ * @param[in] response  Module response
+ * @param[in] arg       Operation
+ */
+void S7XGWaiter::_callback(uint8_t status, char * response, void * arg) {
+    S7XGWaiter * waiter = (S7XGWaiter *) arg;
+    if ((S7XG_STATUS_OK == status) && (S7XG_CORO_WAIT_NONE != waiter->_wait)) {
+        waiter->_session->_accepted(waiter);
+    } else {
+        waiter->_complete(status, response);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Session
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Binds a module to an executor
+ * @details             The session takes over the module TX and join callbacks (onTxDone and onJoin)
+ *                      and the executor calls the module loop(), there should be no other async calls
+ *                      or queued uplinks on the module.
+ * @param[in] module    Module, already started with begin()
+ * @param[in] executor  Executor resuming the coroutines awaiting this module
+ */
+S7XGSession::S7XGSession(S7XG & module, S7XGExecutor & executor) : _module(&module), _executor(&executor) {
+    _module->onTxDone(_txDone, this);
+    _module->onJoin(_joined, this);
+    _executor->_attach(this);
+}
+
+/**
+ * @brief               Releases the module, destroy the session once no coroutine is awaiting it
+ */
+S7XGSession::~S7XGSession() {
+    _executor->_detach(this);
+    _module->onTxDone(NULL);
+    _module->onJoin(NULL);
+}
+
+/**
+ * @brief               Module the session drives
+ * @return              Module
+ */
+S7XG & S7XGSession::module() {
+    return *_module;
+}
+
+/**
+ * @brief               Returns the result of the last completed operation
+ * @return              One of S7XG_STATUS_OK, S7XG_STATUS_ERROR or S7XG_STATUS_TIMEOUT
+ */
+uint8_t S7XGSession::getStatus() {
+    return _status;
+}
+
+/**
+ * @brief               Number of operations awaited and not completed yet
+ * @return              Operation count
+ */
+uint32_t S7XGSession::pending() {
+    return _pending;
+}
+
+/**
+ * @brief               Moves the module on, queues the calls that did not fit and expires the event waits
+ */
+void S7XGSession::_service() {
+
+    _module->loop();
+
+    while (_blocked.head && _blocked.head->_start()) _pop(_blocked);
+
+    // Results arrive in order, so only the oldest wait can be overdue
+    uint32_t now = millis();
+    if (_tx.head && (now - _tx.head->_since >= S7XG_CORO_TX_TIMEOUT)) _pop(_tx)->_complete(S7XG_STATUS_TIMEOUT, NULL);
+    if (_join.head && (now - _join.head->_since >= S7XG_CORO_JOIN_TIMEOUT)) _pop(_join)->_complete(S7XG_STATUS_TIMEOUT, NULL);
+
+}
+
+/**
+ * @brief               Queues the call of an awaited operation
+ * @details             Calls wait in order behind the ones that did not fit in the module queue.
+ * @param[in] waiter    Operation
+ */
+void S7XGSession::_queue(S7XGWaiter * waiter) {
+    _pending++;
+    if (_blocked.head || !waiter->_start()) _push(_blocked, waiter);
+}
+
+/**
+ * @brief               The module accepted the command, waits for the result event
+ * @param[in] waiter    Operation
+ */
+void S7XGSession::_accepted(S7XGWaiter * waiter) {
+    waiter->_since = millis();
+    _push((S7XG_CORO_WAIT_TX == waiter->_wait) ? _tx : _join, waiter);
+}
+
+/**
+ * @brief               Completes the oldest operation waiting for an event
+ * @param[in] list      Waiting operations
+ * @param[in] success   Event result
+ * @param[in] response  Event line
+ */
+void S7XGSession::_event(list_t & list, bool success, const char * response) {
+    S7XGWaiter * waiter = _pop(list);
+    if (waiter) waiter->_complete(success ? S7XG_STATUS_OK : S7XG_STATUS_ERROR, response);
+}
+
+/**
+ * @brief               Appends an operation to a list
+ * @param[in] list      List
+ * @param[in] waiter    Operation
+ */
+void S7XGSession::_push(list_t & list, S7XGWaiter * waiter) {
+    waiter->_next = NULL;
+    if (list.tail) {
+        list.tail->_next = waiter;
+    } else {
+        list.head = waiter;
+    }
+    list.tail = waiter;
+}
+
+/**
+ * @brief               Removes the oldest operation from a list
+ * @param[in] list      List
+ * @return              Operation, NULL if the list is empty
+ */
+S7XGWaiter * S7XGSession::_pop(list_t & list) {
+    S7XGWaiter * waiter = list.head;
+    if (!waiter) return NULL;
+    list.head = waiter->_next;
+    if (!list.head) list.tail = NULL;
+    return waiter;
+}
+
+/**
+ * @brief               TX result callback
+ * @param[in] success   True for tx_ok or a downlink
+ * @param[in] arg       Session
+ */
+void S7XGSession::_txDone(bool success, void * arg) {
+    S7XGSession * session = (S7XGSession *) arg;
+    session->_event(session->_tx, success, success ? "tx_ok" : "err");
+}
+
+/**
+ * @brief               Join result callback
+ * @param[in] success   True if accepted
+ * @param[in] arg       Session
+ */
+void S7XGSession::_joined(bool success, void * arg) {
+    S7XGSession * session = (S7XGSession *) arg;
+    session->_event(session->_join, success, success ? "accepted" : "unsuccess");
+}
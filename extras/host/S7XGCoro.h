@@ -0,0 +1,342 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+C++20 coroutines on top of the async calls, host build only:
+
+  S7XGTask provision(S7XGSession & session) {
+      if (!co_await session.macJoinOTAA(deveui, appeui, appkey)) co_return;
+      co_await session.macSend(payload, sizeof(payload));
+  }
+
+  executor.spawn(provision(session));
+  executor.run();
+
+Every awaitable queues its call with module.async() and suspends, the
+callback hands the coroutine back to the executor, which resumes it from
+run() once loop() has moved the module on. An outstanding operation only
+costs the coroutine frame it is awaited from: no thread, no blocking wait.
+Everything runs on the thread calling run().
+
+*/
+
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+#error "S7XGCoro.h needs a C++20 compiler with coroutine support"
+#endif
+
+#include <coroutine>
+#include <deque>
+#include <vector>
+
+#include <Arduino.h>
+#include "S7XG.h"
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+// Defaults, override them with build flags (for example -DS7XG_CORO_RESPONSE_SIZE=128)
+#ifndef S7XG_CORO_RESPONSE_SIZE
+#define S7XG_CORO_RESPONSE_SIZE               64
+#endif
+#ifndef S7XG_CORO_TX_TIMEOUT
+#define S7XG_CORO_TX_TIMEOUT                  S7XG_CONFIRM_TIMEOUT
+#endif
+#ifndef S7XG_CORO_JOIN_TIMEOUT
+#define S7XG_CORO_JOIN_TIMEOUT                S7XG_JOIN_TIMEOUT
+#endif
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+
+// What an operation waits for once the module has accepted the command
+enum {
+  S7XG_CORO_WAIT_NONE = 0,
+  S7XG_CORO_WAIT_TX,        // TX result of an uplink (tx_ok, err or a downlink)
+  S7XG_CORO_WAIT_JOIN,      // OTAA join result (accepted or unsuccess)
+};
+
+typedef struct {
+  uint8_t status;           // S7XG_STATUS_*
+  char response[S7XG_CORO_RESPONSE_SIZE];   // Last line from the module, truncated
+} s7xg_coro_result_t;
+
+class S7XGExecutor;
+class S7XGSession;
+
+// ----------------------------------------------------------------------------
+// Task
+// ----------------------------------------------------------------------------
+
+class S7XGTask {
+
+  public:
+
+    struct promise_type {
+
+      S7XGExecutor * executor = NULL;       // Set when spawned, the frame is then owned by the executor
+      std::coroutine_handle<> continuation; // Coroutine awaiting this one
+
+      struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+        void await_resume() noexcept {}
+      };
+
+      S7XGTask get_return_object() { return S7XGTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      final_awaiter final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { abort(); }
+
+      static void * operator new(size_t size);
+      static void operator delete(void * frame, size_t size);
+
+    };
+
+    S7XGTask(S7XGTask && other) : _handle(other._handle) { other._handle = NULL; }
+    S7XGTask(const S7XGTask &) = delete;
+    ~S7XGTask();
+
+    bool done();
+
+    // Awaiting a task runs it to completion before resuming the caller
+    bool await_ready() { return !_handle || _handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller);
+    void await_resume() {}
+
+    static uint32_t frames();
+    static uint32_t frameBytes();
+
+  protected:
+
+    friend class S7XGExecutor;
+
+    explicit S7XGTask(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+    std::coroutine_handle<promise_type> _handle;
+
+    static uint32_t _frames;
+    static uint32_t _frame_bytes;
+
+};
+
+// ----------------------------------------------------------------------------
+// Executor
+// ----------------------------------------------------------------------------
+
+class S7XGExecutor {
+
+  public:
+
+    void spawn(S7XGTask && task);
+    bool step();
+    void run();
+    uint32_t tasks();
+
+  protected:
+
+    friend class S7XGTask;
+    friend class S7XGSession;
+    friend class S7XGWaiter;
+
+    void _schedule(std::coroutine_handle<> handle);
+    void _attach(S7XGSession * session);
+    void _detach(S7XGSession * session);
+
+    std::deque<std::coroutine_handle<>> _ready;
+    std::vector<S7XGSession *> _sessions;
+    uint32_t _tasks = 0;
+
+};
+
+// ----------------------------------------------------------------------------
+// Operations
+// ----------------------------------------------------------------------------
+
+// Untyped part of an operation, sessions keep them in intrusive lists
+class S7XGWaiter {
+
+  public:
+
+    S7XGWaiter(S7XGSession & session, uint8_t wait) : _session(&session), _wait(wait) {}
+    S7XGWaiter(const S7XGWaiter &) = delete;
+
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+
+  protected:
+
+    friend class S7XGSession;
+
+    virtual void _issue(S7XG & module) = 0;
+    virtual void _store(const char * response);
+    bool _start();
+    void _complete(uint8_t status, const char * response);
+    static void _callback(uint8_t status, char * response, void * arg);
+
+    S7XGSession * _session;
+    uint8_t _wait;
+    std::coroutine_handle<> _handle;
+    S7XGWaiter * _next = NULL;
+    uint32_t _since = 0;
+    s7xg_coro_result_t _result = { S7XG_STATUS_PENDING, { 0 } };
+
+};
+
+// Method call queued with module.async(), resumes with the result
+template<typename F> class S7XGOperation : public S7XGWaiter {
+
+  public:
+
+    S7XGOperation(S7XGSession & session, F issue, uint8_t wait = S7XG_CORO_WAIT_NONE) : S7XGWaiter(session, wait), _call(issue) {}
+    s7xg_coro_result_t await_resume() { return _result; }
+
+  protected:
+
+    void _issue(S7XG & module) { _call(module); }
+
+    F _call;
+
+};
+
+// Same, resumes with true if the call succeeded
+template<typename F> class S7XGCheck : public S7XGOperation<F> {
+
+  public:
+
+    S7XGCheck(S7XGSession & session, F issue, uint8_t wait = S7XG_CORO_WAIT_NONE) : S7XGOperation<F>(session, issue, wait) {}
+    bool await_resume() { return S7XG_STATUS_OK == this->_result.status; }
+
+};
+
+// Same, resumes with the parsed "gps get_data" response
+template<typename F> class S7XGGpsRead : public S7XGOperation<F> {
+
+  public:
+
+    S7XGGpsRead(S7XGSession & session, F issue) : S7XGOperation<F>(session, issue) {}
+    gps_message_t await_resume() { return _message; }
+
+  protected:
+
+    // The response does not fit in the result, it is parsed from the module buffer
+    void _store(const char * response) {
+      S7XG::gpsParse((S7XG_STATUS_OK == this->_result.status) ? response : NULL, _message);
+    }
+
+    gps_message_t _message;
+
+};
+
+// ----------------------------------------------------------------------------
+// Session
+// ----------------------------------------------------------------------------
+
+class S7XGSession {
+
+  public:
+
+    S7XGSession(S7XG & module, S7XGExecutor & executor);
+    S7XGSession(const S7XGSession &) = delete;
+    ~S7XGSession();
+
+    S7XG & module();
+    uint8_t getStatus();
+    uint32_t pending();
+
+    // Any method, example: co_await session.call([](S7XG & module) { module.macClass(S7XG_MAC_CLASS_C); });
+    template<typename F> S7XGOperation<F> call(F issue) {
+      return S7XGOperation<F>(*this, issue);
+    }
+
+    // LoRaWAN
+    auto macSend(const uint8_t * data, uint8_t len, bool confirmed = false, uint8_t port = 1) {
+      return S7XGCheck(*this, [=](S7XG & module) { module.macSend(data, len, confirmed, port); }, S7XG_CORO_WAIT_TX);
+    }
+    auto macSend(const char * data, bool confirmed = false, uint8_t port = 1) {
+      return macSend((const uint8_t *) data, strlen(data), confirmed, port);
+    }
+    auto macJoinABP(const char * devaddr, const char * nwkskey, const char * appskey) {
+      return S7XGCheck(*this, [=](S7XG & module) { module.macJoinABP(devaddr, nwkskey, appskey); });
+    }
+    auto macJoinOTAA(const char * deveui, const char * appeui, const char * appkey) {
+      return S7XGCheck(*this, [=](S7XG & module) { module.macJoinOTAA(deveui, appeui, appkey); }, S7XG_CORO_WAIT_JOIN);
+    }
+    auto macSave() {
+      return S7XGCheck(*this, [](S7XG & module) { module.macSave(); });
+    }
+    auto macPower(uint8_t power) {
+      return S7XGCheck(*this, [=](S7XG & module) { module.macPower(power); });
+    }
+    auto macDatarate(uint8_t dr) {
+      return S7XGCheck(*this, [=](S7XG & module) { module.macDatarate(dr); });
+    }
+    auto macADR(bool adr) {
+      return S7XGCheck(*this, [=](S7XG & module) { module.macADR(adr); });
+    }
+
+    // GPS
+    auto gpsInit() {
+      return S7XGCheck(*this, [](S7XG & module) { module.gpsInit(); });
+    }
+    auto gpsMode(uint8_t mode) {
+      return S7XGCheck(*this, [=](S7XG & module) { module.gpsMode(mode); });
+    }
+    auto gpsData() {
+      return S7XGGpsRead(*this, [](S7XG & module) { module.gpsData(); });
+    }
+
+    // Info
+    auto getVersion() {
+      return call([](S7XG & module) { module.getVersion(); });
+    }
+
+  protected:
+
+    friend class S7XGExecutor;
+    friend class S7XGWaiter;
+
+    struct list_t {
+      S7XGWaiter * head = NULL;
+      S7XGWaiter * tail = NULL;
+    };
+
+    void _service();
+    void _queue(S7XGWaiter * waiter);
+    void _accepted(S7XGWaiter * waiter);
+    void _event(list_t & list, bool success, const char * response);
+    static void _push(list_t & list, S7XGWaiter * waiter);
+    static S7XGWaiter * _pop(list_t & list);
+    static void _txDone(bool success, void * arg);
+    static void _joined(bool success, void * arg);
+
+    S7XG * _module;
+    S7XGExecutor * _executor;
+    list_t _blocked;        // Not queued yet, the module queue was full
+    list_t _tx;             // Uplinks accepted, waiting for the TX result
+    list_t _join;           // OTAA join accepted, waiting for the answer
+    uint32_t _pending = 0;
+    uint8_t _status = S7XG_STATUS_PENDING;
+
+};
@@ -0,0 +1,1083 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+Simulated S76G/S78G module. It answers the command set in S7XG.h with
+the same ">> " framing as the real module, so the S7XG class (and any
+other code talking to the module) can run without hardware.
+
+Commands are processed as soon as the host starts reading (the library
+does not send a line terminator), or when a CR or LF is received.
+
+Once "gps set_nmea" has been called and the GPS is on, it also outputs
+the requested RMC, GGA, GSA and GSV sentences every second, built from
+the canned fixes, in between the command answers.
+
+*/
+
+#include "S7XGSimulator.h"
+
+// ----------------------------------------------------------------------------
+// Defaults
+// ----------------------------------------------------------------------------
+
+const char * const S7XG_SIM_DEFAULTS[][2] = {
+    { "ver", "v1.6.5" },
+    { "hw_model", "S76G" },
+    { "hw_model_ver", "module=S76G ver=v1.6.5" },
+    { "uuid", "uuid=002400413630373619473630" },
+    { "batt_resistor", "100000 200000" },
+    { "batt_volt", "battery volt(4197 mv)" },
+    { "storage", "00000000" },
+    { "deveui", "0000000000000000" },
+    { "appeui", "0000000000000000" },
+    { "appkey", "00000000000000000000000000000000" },
+    { "devaddr", "00000000" },
+    { "nwkskey", "00000000000000000000000000000000" },
+    { "appskey", "00000000000000000000000000000000" },
+    { "band", "868" },
+    { "dr", "5" },
+    { "power", "14" },
+    { "adr", "off" },
+    { "txretry", "7" },
+    { "rxdelay", "1000 2000" },
+    { "rx2", "0 869525000" },
+    { "sync", "34" },
+    { "dc_ctl", "on" },
+    { "join_ch", "0 1 2" },
+    { "upcnt", "0" },
+    { "downcnt", "0" },
+    { "class", "A" },
+    { "tx_mode", "no_cycle" },
+    { "batt", "255" },
+    { "tx_confirm", "off" },
+    { "lbt", "off" },
+    { "uplink_dwell", "off" },
+    { "downlink_dwell", "off" },
+    { "max_eirp", "16" },
+    { "ch_count", "16 16" },
+    { "tx_interval", "60000" },
+    { "rx1_freq", "0 0 0" },
+    { "auto_join", "off otaa 0" },
+    { "power_index", "1" },
+    { "ttff", "0" },
+};
+
+// NMEA sentences, bit i of the set_nmea mask
+const char * const S7XG_SIM_NMEA[] = { "rmc", "gga", "gsa", "gsv" };
+
+// Maximum payload (bytes) per EU868 data rate
+const uint8_t S7XG_SIM_MAX_PAYLOAD[] = { 51, 51, 51, 115, 222, 222, 222, 222 };
+
+// ----------------------------------------------------------------------------
+// Init
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Creates a simulated module with default settings
+ */
+S7XGSimulator::S7XGSimulator() {
+    _downlink[0] = 0;
+    _defaults();
+}
+
+// ----------------------------------------------------------------------------
+// Stream
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Number of bytes the module has sent and are ready to be read
+ * @return              Number of bytes available
+ */
+int S7XGSimulator::available() {
+    _process();
+    int count = 0;
+    uint32_t now = millis();
+    for (uint8_t i=0; i<_line_count; i++) {
+        s7xg_sim_line_t * line = &_lines[(_line_head + i) % S7XG_SIM_LINES];
+        if ((int32_t) (now - line->due) < 0) break;
+        count += line->length - line->position;
+    }
+    return count;
+}
+
+/**
+ * @brief               Reads a byte from the module
+ * @return              Next byte or -1 if none available
+ */
+int S7XGSimulator::read() {
+    int ch = peek();
+    if (ch < 0) return ch;
+    s7xg_sim_line_t * line = &_lines[_line_head];
+    if (++line->position == line->length) {
+        _line_head = (_line_head + 1) % S7XG_SIM_LINES;
+        _line_count--;
+    }
+    _bytes_sent++;
+    return ch;
+}
+
+/**
+ * @brief               Returns the next byte without removing it
+ * @return              Next byte or -1 if none available
+ */
+int S7XGSimulator::peek() {
+    _process();
+    if (0 == _line_count) return -1;
+    s7xg_sim_line_t * line = &_lines[_line_head];
+    if ((int32_t) (millis() - line->due) < 0) return -1;
+    return (uint8_t) line->data[line->position];
+}
+
+/**
+ * @brief               Reads up to length bytes that are ready, never waits
+ * @param[out] buffer   Destination
+ * @param[in] length    Maximum number of bytes
+ * @return              Number of bytes read
+ */
+size_t S7XGSimulator::readBytes(char * buffer, size_t length) {
+    _process();
+    size_t count = 0;
+    uint32_t now = millis();
+    while ((count < length) && (_line_count > 0)) {
+        s7xg_sim_line_t * line = &_lines[_line_head];
+        if ((int32_t) (now - line->due) < 0) break;
+        size_t size = line->length - line->position;
+        if (size > length - count) size = length - count;
+        memcpy(&buffer[count], &line->data[line->position], size);
+        count += size;
+        line->position += size;
+        if (line->position == line->length) {
+            _line_head = (_line_head + 1) % S7XG_SIM_LINES;
+            _line_count--;
+        }
+    }
+    _bytes_sent += count;
+    return count;
+}
+
+/**
+ * @brief               Receives a byte from the host
+ * @param[in] ch        Byte
+ * @return              Number of bytes written (always 1)
+ */
+size_t S7XGSimulator::write(uint8_t ch) {
+    _bytes_received++;
+    if (!_clean()) return 1;
+    if (_input_length < S7XG_SIM_INPUT_SIZE - 1) _input[_input_length++] = ch;
+    if ((0x0A == ch) || (0x0D == ch)) _process();
+    return 1;
+}
+
+/**
+ * @brief               Receives a buffer from the host
+ * @param[in] buffer    Bytes to write
+ * @param[in] size      Number of bytes
+ * @return              Number of bytes written
+ */
+size_t S7XGSimulator::write(const uint8_t * buffer, size_t size) {
+    for (size_t i=0; i<size; i++) write(buffer[i]);
+    return size;
+}
+
+/**
+ * @brief               Nothing to flush, output is available immediately
+ */
+void S7XGSimulator::flush() {
+}
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Seeds the pseudo-random generator used for jitter and errors
+ * @param[in] seed      Any non-zero value
+ */
+void S7XGSimulator::seed(uint32_t seed) {
+    _seed = seed ? seed : 1;
+}
+
+/**
+ * @brief               Sets the default response latency
+ * @param[in] latency   Milliseconds until the module answers
+ * @param[in] jitter    Maximum random milliseconds added to the latency (defaults to 0)
+ */
+void S7XGSimulator::setLatency(uint32_t latency, uint32_t jitter) {
+    _latency_base = latency;
+    _latency_jitter = jitter;
+}
+
+/**
+ * @brief               Sets the response latency for the commands starting with a given prefix
+ * @param[in] prefix    Command prefix, like "gps set_mode" (must be a static string)
+ * @param[in] latency   Milliseconds until the module answers
+ * @param[in] jitter    Maximum random milliseconds added to the latency (defaults to 0)
+ * @return              False if there is no room for more overrides
+ */
+bool S7XGSimulator::setLatency(const char * prefix, uint32_t latency, uint32_t jitter) {
+    for (uint8_t i=0; i<_override_count; i++) {
+        if (0 == strcmp(_overrides[i].prefix, prefix)) {
+            _overrides[i].latency = latency;
+            _overrides[i].jitter = jitter;
+            return true;
+        }
+    }
+    if (S7XG_SIM_OVERRIDES == _override_count) return false;
+    _overrides[_override_count++] = { prefix, latency, jitter };
+    return true;
+}
+
+/**
+ * @brief               Sets the time between "mac tx" being accepted and the TX result
+ * @param[in] ms        Milliseconds
+ */
+void S7XGSimulator::setAirtime(uint32_t ms) {
+    _airtime = ms;
+}
+
+/**
+ * @brief               Sets the time between "mac join" being accepted and the join result
+ * @param[in] ms        Milliseconds
+ */
+void S7XGSimulator::setJoinTime(uint32_t ms) {
+    _join_time = ms;
+}
+
+/**
+ * @brief               Sets the time the GPS takes to get a fix after entering manual or auto mode
+ * @param[in] ms        Milliseconds
+ */
+void S7XGSimulator::setTTFF(uint32_t ms) {
+    _ttff = ms;
+}
+
+/**
+ * @brief               Makes a percentage of the commands fail
+ * @param[in] percent   Probability of a command failing (0-100)
+ * @param[in] response  Response for the failed commands (defaults to "busy", must be a static string)
+ */
+void S7XGSimulator::setErrorRate(uint8_t percent, const char * response) {
+    _error_rate = percent;
+    _error_response = response;
+}
+
+/**
+ * @brief               Makes a percentage of the commands go unanswered
+ * @param[in] percent   Probability of a command being ignored (0-100)
+ */
+void S7XGSimulator::setDropRate(uint8_t percent) {
+    _drop_rate = percent;
+}
+
+/**
+ * @brief               Makes a percentage of the confirmed uplinks not being acknowledged
+ * @param[in] percent   Probability of an ACK being lost (0-100)
+ */
+void S7XGSimulator::setAckLossRate(uint8_t percent) {
+    _ack_loss_rate = percent;
+}
+
+/**
+ * @brief               Makes a percentage of the OTAA joins being denied ("unsuccess")
+ * @param[in] percent   Probability of a join failing (0-100)
+ */
+void S7XGSimulator::setJoinFailRate(uint8_t percent) {
+    _join_fail_rate = percent;
+}
+
+/**
+ * @brief               Forces the response to the next command
+ * @param[in] response  Response (must be a static string) or NULL to ignore the next command
+ */
+void S7XGSimulator::failNext(const char * response) {
+    _fail_next = true;
+    _fail_response = response;
+}
+
+/**
+ * @brief               Adds a canned GPS fix, "gps get_data dd" cycles through them
+ * @param[in] fix       Fix data
+ * @return              False if there is no room for more fixes
+ */
+bool S7XGSimulator::addFix(const s7xg_sim_fix_t & fix) {
+    if (S7XG_SIM_FIXES == _fix_count) return false;
+    _fixes[_fix_count++] = fix;
+    return true;
+}
+
+/**
+ * @brief               Removes all canned GPS fixes
+ */
+void S7XGSimulator::clearFixes() {
+    _fix_count = 0;
+    _fix_next = 0;
+}
+
+/**
+ * @brief               Outputs an unsolicited line, like "mac rx 4 1234abcd"
+ * @param[in] line      Line contents, without the ">> " prefix
+ * @param[in] delay     Milliseconds from now (defaults to 0)
+ * @return              False if the output queue is full
+ */
+bool S7XGSimulator::inject(const char * line, uint32_t delay) {
+    if (S7XG_SIM_LINES == _line_count) return false;
+    _reply(line, delay);
+    return true;
+}
+
+/**
+ * @brief               Sets the downlink to receive after the next uplink
+ * @param[in] port      LoRaWAN port
+ * @param[in] data      Hexa-string with the payload
+ */
+void S7XGSimulator::setDownlink(uint8_t port, const char * data) {
+    _downlink_port = port;
+    strncpy(_downlink, data, sizeof(_downlink) - 1);
+    _downlink[sizeof(_downlink) - 1] = 0;
+}
+
+/**
+ * @brief               Changes the host side line speed, like a UART would
+ * @details             While the host and the module speeds differ the module does not understand anything.
+ * @param[in] baudrate  Host baudrate
+ * @return              Always true, to be used from a baudrate callback
+ */
+bool S7XGSimulator::setBaudrate(uint32_t baudrate) {
+    _host_baudrate = baudrate;
+    _input_length = 0;
+    return true;
+}
+
+/**
+ * @brief               Current module line speed, as set with sip set_baudrate
+ * @return              Module baudrate
+ */
+uint32_t S7XGSimulator::getModuleBaudrate() {
+    return _baudrate;
+}
+
+// ----------------------------------------------------------------------------
+// Statistics
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Number of commands processed
+ * @return              Command count
+ */
+uint32_t S7XGSimulator::commands() {
+    return _commands;
+}
+
+/**
+ * @brief               Number of bytes received from the host
+ * @return              Byte count
+ */
+uint32_t S7XGSimulator::bytesReceived() {
+    return _bytes_received;
+}
+
+/**
+ * @brief               Number of bytes read by the host
+ * @return              Byte count
+ */
+uint32_t S7XGSimulator::bytesSent() {
+    return _bytes_sent;
+}
+
+// ----------------------------------------------------------------------------
+// Private
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Executes any command in the input buffer
+ */
+void S7XGSimulator::_process() {
+
+    _nmeaOutput();
+
+    if (0 == _input_length) return;
+    _input[_input_length] = 0;
+    _input_length = 0;
+
+    char * command = _input;
+    while (command) {
+        char * end = strpbrk(command, "\r\n");
+        if (end) *end++ = 0;
+        if (command[0]) _execute(command);
+        command = end;
+    }
+
+}
+
+/**
+ * @brief               Executes a single command
+ * @param[in] command   Command line
+ */
+void S7XGSimulator::_execute(char * command) {
+
+    _commands++;
+
+    // Any input wakes the module up
+    if (_sleeping) {
+        _sleeping = false;
+        _reply("Ok");
+        return;
+    }
+
+    // Error injection
+    if (_fail_next) {
+        _fail_next = false;
+        if (_fail_response) _reply(_fail_response, _latency(command));
+        return;
+    }
+    if (_random(100) < _drop_rate) return;
+    if (_random(100) < _error_rate) {
+        _reply(_error_response, _latency(command));
+        return;
+    }
+
+    char * group = strtok(command, " ");
+    char * verb = strtok(NULL, " ");
+    char * args = strtok(NULL, "");
+    if (!verb) {
+        _reply("Invalid", _latency(command));
+        return;
+    }
+
+    if (0 == strcmp(group, "sip")) {
+        _sip(verb, args);
+    } else if (0 == strcmp(group, "mac")) {
+        _mac(verb, args);
+    } else if (0 == strcmp(group, "gps")) {
+        _gps(verb, args);
+    } else {
+        _reply("Invalid", _latency(command));
+    }
+
+}
+
+/**
+ * @brief               SIP commands
+ * @param[in] verb      Command name
+ * @param[in] args      Arguments or NULL
+ */
+void S7XGSimulator::_sip(char * verb, char * args) {
+
+    uint32_t latency = _latency("sip");
+
+    if (0 == strcmp(verb, "reset")) {
+        if (!_session_saved) _joined_pending = false;
+        _reply("S76G - v1.6.5 - Jul  2 2018 - 12:00:00", latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "factory_reset")) {
+        _defaults();
+        _joined_pending = false;
+        _session_saved = false;
+        _gps_init = false;
+        _reply(_get("ver"), latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "set_baudrate")) {
+        char * password = args ? strchr(args, ' ') : NULL;
+        uint32_t baudrate = args ? atol(args) : 0;
+        bool valid = (9600 == baudrate) || (19200 == baudrate) || (57600 == baudrate) || (115200 == baudrate);
+        if (!valid || !password || !password[1]) {
+            _reply("Invalid", latency);
+            return;
+        }
+        _reply("Ok", latency);
+        _baudrate = baudrate;
+        return;
+    }
+
+    if (0 == strcmp(verb, "sleep")) {
+        uint32_t seconds = args ? atol(args) : 0;
+        if ((seconds < 10) || (seconds % 10)) {
+            _reply("Invalid", latency);
+            return;
+        }
+        _sleeping = true;
+        _replyf(latency, "sleep %lu sec %s", (unsigned long) seconds, strchr(args, ' ') ? strchr(args, ' ') + 1 : "uart_on");
+        return;
+    }
+
+    if ((0 == strncmp(verb, "get_", 4)) && _get(verb + 4)) {
+        _reply(_get(verb + 4), latency);
+        return;
+    }
+
+    // User data kept in flash, like the MAC settings
+    if (0 == strcmp(verb, "set_storage")) {
+        _reply((args && _set("storage", args)) ? "Ok" : "Invalid", latency);
+        return;
+    }
+
+    if (0 == strncmp(verb, "set_", 4)) {
+        _reply(args ? "Ok" : "Invalid", latency);
+        return;
+    }
+
+    _reply("Invalid", latency);
+
+}
+
+/**
+ * @brief               MAC commands
+ * @param[in] verb      Command name
+ * @param[in] args      Arguments or NULL
+ */
+void S7XGSimulator::_mac(char * verb, char * args) {
+
+    uint32_t latency = _latency("mac");
+
+    if (0 == strcmp(verb, "tx")) {
+        _tx(args);
+        return;
+    }
+
+    if (0 == strcmp(verb, "join")) {
+        _join(args);
+        return;
+    }
+
+    if (0 == strcmp(verb, "save")) {
+        _session_saved = _joined();
+        _reply("Ok", latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "set_linkchk")) {
+        _reply("Ok", latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "get_join_status")) {
+        _reply(_joined() ? "joined" : "unjoined", latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "set_keys")) {
+        const char * keys[] = { "deveui", "appeui", "appkey", "devaddr", "nwkskey", "appskey" };
+        char * value = args ? strtok(args, " ") : NULL;
+        for (uint8_t i=0; i<6; i++) {
+            if (!value) break;
+            _set(keys[i], value);
+            value = strtok(NULL, " ");
+        }
+        _reply("Ok", latency);
+        return;
+    }
+
+    if (0 == strncmp(verb, "get_", 4)) {
+        const char * value = _get(verb + 4);
+        _reply(value ? value : "Invalid", latency);
+        return;
+    }
+
+    if (0 == strncmp(verb, "set_", 4)) {
+
+        const char * key = verb + 4;
+        if (!args) {
+            _reply("Invalid", latency);
+            return;
+        }
+
+        // Some validation
+        if (0 == strcmp(key, "power")) {
+            uint8_t power = atoi(args);
+            if ((power != 2) && (power != 5) && (power != 8) && (power != 11) && (power != 14) && (power != 20)) {
+                _reply("Invalid", latency);
+                return;
+            }
+        }
+        if ((0 == strcmp(key, "dr")) && (atoi(args) > 7)) {
+            _reply("Invalid", latency);
+            return;
+        }
+        if ((0 == strcmp(key, "class")) && (args[0] != 'A') && (args[0] != 'C')) {
+            _reply("Invalid", latency);
+            return;
+        }
+        if ((0 == strcmp(key, "adr")) || (0 == strcmp(key, "dc_ctl")) || (0 == strcmp(key, "tx_confirm")) || (0 == strcmp(key, "lbt"))) {
+            if (!_onoff(args)) {
+                _reply("Invalid", latency);
+                return;
+            }
+        }
+        if (0 == strcmp(key, "rxdelay1")) key = "rxdelay";
+        if ((0 == strcmp(key, "upcnt")) || (0 == strcmp(key, "downcnt")) || (0 == strcmp(key, "tx_interval"))) {
+            char value[12];
+            snprintf(value, sizeof(value), "%lu", (unsigned long) strtoul(args, NULL, 10));
+            _set(key, value);
+        } else {
+            _set(key, args);
+        }
+        _reply("Ok", latency);
+        return;
+
+    }
+
+    _reply("Invalid", latency);
+
+}
+
+/**
+ * @brief               GPS commands
+ * @param[in] verb      Command name
+ * @param[in] args      Arguments or NULL
+ */
+void S7XGSimulator::_gps(char * verb, char * args) {
+
+    uint32_t latency = _latency("gps");
+
+    if (0 == strcmp(verb, "get_data")) {
+        _gpsData();
+        return;
+    }
+
+    if (0 == strcmp(verb, "set_mode")) {
+        latency = _latency("gps set_mode");
+        if (!args) {
+            _reply("Invalid", latency);
+            return;
+        }
+        uint8_t mode =
+            (0 == strcmp(args, "idle")) ? S7XG_GPS_MODE_IDLE :
+            (0 == strcmp(args, "manual")) ? S7XG_GPS_MODE_MANUAL :
+            (0 == strcmp(args, "auto")) ? S7XG_GPS_MODE_AUTO :
+            0xFF;
+        if (0xFF == mode) {
+            _reply("Invalid", latency);
+            return;
+        }
+        if ((S7XG_GPS_MODE_IDLE != mode) && (!_gps_init || (S7XG_GPS_MODE_IDLE == _gps_mode))) {
+            _gps_start = millis();
+        }
+        _gps_init = true;
+        _gps_mode = mode;
+        _reply("Ok", latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "get_mode")) {
+        _reply(
+            !_gps_init ? "gps_not_init" :
+            S7XG_GPS_MODE_IDLE == _gps_mode ? "idle" :
+            S7XG_GPS_MODE_MANUAL == _gps_mode ? "manual" :
+            "auto", latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "get_ttff")) {
+        _reply(_get("ttff"), latency);
+        return;
+    }
+
+    if ((0 == strcmp(verb, "sleep")) || (0 == strcmp(verb, "reset"))) {
+        _reply("Ok", latency);
+        return;
+    }
+
+    if (0 == strcmp(verb, "set_nmea")) {
+        if (!args) {
+            _reply("Invalid", latency);
+            return;
+        }
+        _nmea = 0;
+        for (uint8_t i=0; i<sizeof(S7XG_SIM_NMEA) / sizeof(S7XG_SIM_NMEA[0]); i++) {
+            if (strstr(args, S7XG_SIM_NMEA[i])) _nmea |= (1 << i);
+        }
+        _nmea_pending = 0;
+        _reply("Ok", latency);
+        return;
+    }
+
+    if (0 == strncmp(verb, "set_", 4)) {
+        _reply(args ? "Ok" : "Invalid", latency);
+        return;
+    }
+
+    _reply("Invalid", latency);
+
+}
+
+/**
+ * @brief               Uplink, answers "Ok" and then the TX result after the airtime
+ * @param[in] args      "<cnf|ucnf> <port> <hex>"
+ */
+void S7XGSimulator::_tx(char * args) {
+
+    uint32_t latency = _latency("mac tx");
+
+    char * type = args ? strtok(args, " ") : NULL;
+    char * port = type ? strtok(NULL, " ") : NULL;
+    char * data = port ? strtok(NULL, " ") : NULL;
+    bool confirmed = type && (0 == strcmp(type, "cnf"));
+    if (!data || (!confirmed && strcmp(type, "ucnf")) || (atoi(port) < 1) || (atoi(port) > 223)) {
+        _reply("Invalid", latency);
+        return;
+    }
+
+    size_t len = strlen(data);
+    if (len % 2) {
+        _reply("Invalid", latency);
+        return;
+    }
+    if (len > 500) {
+        _reply("exceeded_data_length", latency);
+        return;
+    }
+    uint8_t dr = atoi(_get("dr"));
+    if (len / 2 > S7XG_SIM_MAX_PAYLOAD[dr & 0x07]) {
+        _reply("invalid_data_length", latency);
+        return;
+    }
+    if (!_joined()) {
+        _reply("not_joined", latency);
+        return;
+    }
+
+    char counter[12];
+    snprintf(counter, sizeof(counter), "%lu", strtoul(_get("upcnt"), NULL, 10) + 1);
+    _set("upcnt", counter);
+
+    _reply("Ok", latency);
+    if (confirmed && (_random(100) < _ack_loss_rate)) {
+        _reply("err", latency + _airtime);
+    } else if (_downlink_port) {
+        _replyf(latency + _airtime, "mac rx %d %s", _downlink_port, _downlink);
+        _downlink_port = 0;
+    } else {
+        _reply("tx_ok", latency + _airtime);
+    }
+
+}
+
+/**
+ * @brief               Join, answers "Ok" and then "accepted" (or "unsuccess", see setJoinFailRate) after the join time
+ * @param[in] args      "<otaa|abp>"
+ */
+void S7XGSimulator::_join(char * args) {
+
+    uint32_t latency = _latency("mac join");
+
+    bool otaa = args && (0 == strcmp(args, "otaa"));
+    if (!otaa && (!args || strcmp(args, "abp"))) {
+        _reply("Invalid", latency);
+        return;
+    }
+
+    const char * key = otaa ? "appkey" : "nwkskey";
+    if (0 == strcmp(_get(key), "00000000000000000000000000000000")) {
+        _reply("keys_not_init", latency);
+        return;
+    }
+
+    uint32_t delay = latency + (otaa ? _join_time : 0);
+    bool accepted = !otaa || (_random(100) >= _join_fail_rate);
+    _joined_pending = accepted;
+    _joined_at = millis() + delay;
+    _session_saved = false;
+    _reply("Ok", latency);
+    _reply(accepted ? "accepted" : "unsuccess", delay);
+
+}
+
+/**
+ * @brief               "gps get_data dd", returns the next canned fix after the TTFF
+ */
+void S7XGSimulator::_gpsData() {
+
+    uint32_t latency = _latency("gps get_data");
+
+    if (!_gps_init) {
+        _reply("gps_not_init", latency);
+        return;
+    }
+    if (S7XG_GPS_MODE_IDLE == _gps_mode) {
+        _reply("gps_in_idle", latency);
+        return;
+    }
+
+    uint32_t elapsed = millis() - _gps_start;
+    if ((0 == _fix_count) || (elapsed < _ttff)) {
+        _replyf(latency, "POSITIONING( %lu.%lus )", (unsigned long) (elapsed / 1000), (unsigned long) ((elapsed / 100) % 10));
+        return;
+    }
+
+    s7xg_sim_fix_t * fix = &_fixes[_fix_next];
+    _fix_next = (_fix_next + 1) % _fix_count;
+    uint32_t lat = fix->latitude < 0 ? -fix->latitude : fix->latitude;
+    uint32_t lon = fix->longitude < 0 ? -fix->longitude : fix->longitude;
+    _replyf(latency,
+        "DD UTC( %04u/%02u/%02u %02u:%02u:%02u ) LAT( %lu.%06lu %c ) LONG( %lu.%06lu %c ) POSITIONING( %u.%us )",
+        fix->year, fix->month, fix->day, fix->hour, fix->minute, fix->second,
+        (unsigned long) (lat / 1000000), (unsigned long) (lat % 1000000), fix->latitude < 0 ? 'S' : 'N',
+        (unsigned long) (lon / 1000000), (unsigned long) (lon % 1000000), fix->longitude < 0 ? 'W' : 'E',
+        fix->positioning / 10, fix->positioning % 10);
+
+}
+
+/**
+ * @brief               Outputs the NMEA sentences due, one set per second while the GPS is on
+ * @details             Sentences are queued one at a time leaving room for command answers,
+ *                      a set not fully queued is completed on the next calls.
+ */
+void S7XGSimulator::_nmeaOutput() {
+
+    if (!_nmea || !_gps_init || (S7XG_GPS_MODE_IDLE == _gps_mode) || _sleeping) return;
+
+    uint32_t now = millis();
+    if (0 == _nmea_pending) {
+        if ((int32_t) (now - _nmea_next) < 0) return;
+        _nmea_next = now + S7XG_SIM_NMEA_PERIOD;
+        _nmea_pending = _nmea;
+    }
+
+    bool positioned = _fix_count && (now - _gps_start >= _ttff);
+    s7xg_sim_fix_t * fix = _fix_count ? &_fixes[_nmea_fix % _fix_count] : NULL;
+    char latitude[16] = ",";
+    char longitude[16] = ",";
+    if (positioned) {
+        _coordinate(latitude, sizeof(latitude), fix->latitude, false);
+        _coordinate(longitude, sizeof(longitude), fix->longitude, true);
+    }
+
+    while (_nmea_pending && (_line_count < S7XG_SIM_LINES - 2)) {
+
+        if (_nmea_pending & 0x01) {
+            _nmea_pending &= ~0x01;
+            if (positioned) {
+                _sentence("GPRMC,%02u%02u%02u.00,A,%s,%s,0.50,54.70,%02u%02u%02u,,,A",
+                    fix->hour, fix->minute, fix->second, latitude, longitude,
+                    fix->day, fix->month, fix->year % 100);
+            } else {
+                _sentence("GPRMC,,V,,,,,,,,,,N");
+            }
+        } else if (_nmea_pending & 0x02) {
+            _nmea_pending &= ~0x02;
+            if (positioned) {
+                _sentence("GPGGA,%02u%02u%02u.00,%s,%s,1,04,1.20,123.4,M,49.8,M,,",
+                    fix->hour, fix->minute, fix->second, latitude, longitude);
+            } else {
+                _sentence("GPGGA,,,,,,0,00,99.99,,,,,,");
+            }
+        } else if (_nmea_pending & 0x04) {
+            _nmea_pending &= ~0x04;
+            if (positioned) {
+                _sentence("GPGSA,A,3,05,13,15,24,,,,,,,,,2.10,1.20,1.70");
+            } else {
+                _sentence("GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+            }
+        } else {
+            _nmea_pending = 0;
+            _sentence("GPGSV,1,1,04,05,61,127,42,13,38,284,39,15,23,052,35,24,70,201,44");
+        }
+
+        // Next fix once the whole set is out
+        if (0 == _nmea_pending) _nmea_fix++;
+
+    }
+
+}
+
+/**
+ * @brief               Queues an NMEA sentence, adding the delimiters and the checksum
+ * @param[in] format    printf-like format string for the sentence body (between '$' and '*')
+ * @param[in] ...       Any values to set the placeholders to
+ */
+void S7XGSimulator::_sentence(const char * format, ...) {
+    char body[S7XG_SIM_LINE_SIZE - 8];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(body, sizeof(body), format, args);
+    va_end(args);
+    uint8_t checksum = 0;
+    for (char * p = body; *p; p++) checksum ^= *p;
+    char line[S7XG_SIM_LINE_SIZE];
+    snprintf(line, sizeof(line), "$%s*%02X", body, checksum);
+    _reply(line, 0, false);
+}
+
+/**
+ * @brief               Formats a coordinate the NMEA way, "ddmm.mmmmm,N"
+ * @param[out] buffer   Destination
+ * @param[in] size      Destination size
+ * @param[in] value     Millionths of a degree
+ * @param[in] longitude True for a longitude (three digit degrees, E/W)
+ */
+void S7XGSimulator::_coordinate(char * buffer, size_t size, int32_t value, bool longitude) {
+    uint32_t absolute = value < 0 ? -value : value;
+    uint32_t minutes = (absolute % 1000000) * 6;
+    snprintf(buffer, size, longitude ? "%03lu%02lu.%05lu,%c" : "%02lu%02lu.%05lu,%c",
+        (unsigned long) (absolute / 1000000), (unsigned long) (minutes / 100000), (unsigned long) (minutes % 100000),
+        longitude ? (value < 0 ? 'W' : 'E') : (value < 0 ? 'S' : 'N'));
+}
+
+/**
+ * @brief               Queues a response line
+ * @param[in] line      Line contents, without the ">> " prefix
+ * @param[in] delay     Milliseconds from now (defaults to 0)
+ * @param[in] prompt    Adds the ">> " prefix (defaults to true)
+ */
+void S7XGSimulator::_reply(const char * line, uint32_t delay, bool prompt) {
+
+    if (S7XG_SIM_LINES == _line_count) return;
+
+    // Keep lines ordered by due time
+    uint32_t due = millis() + delay;
+    uint8_t position = _line_count;
+    while (position > 0) {
+        s7xg_sim_line_t * previous = &_lines[(_line_head + position - 1) % S7XG_SIM_LINES];
+        if ((int32_t) (due - previous->due) >= 0) break;
+        if ((1 == position) && (previous->position > 0)) break;
+        _lines[(_line_head + position) % S7XG_SIM_LINES] = *previous;
+        position--;
+    }
+
+    s7xg_sim_line_t * target = &_lines[(_line_head + position) % S7XG_SIM_LINES];
+    int length = snprintf(target->data, sizeof(target->data), prompt ? ">> %s\r\n" : "%s\r\n", line);
+    target->due = due;
+    target->length = (length < (int) sizeof(target->data)) ? length : sizeof(target->data) - 1;
+    target->position = 0;
+    _line_count++;
+
+}
+
+/**
+ * @brief               Queues a formatted response line
+ * @param[in] delay     Milliseconds from now
+ * @param[in] format    printf-like format string
+ * @param[in] ...       Any values to set the placeholders to
+ */
+void S7XGSimulator::_replyf(uint32_t delay, const char * format, ...) {
+    char line[S7XG_SIM_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    _reply(line, delay);
+}
+
+/**
+ * @brief               Calculates the latency for a given command
+ * @param[in] command   Command (or command prefix)
+ * @return              Milliseconds
+ */
+uint32_t S7XGSimulator::_latency(const char * command) {
+    uint32_t latency = _latency_base;
+    uint32_t jitter = _latency_jitter;
+    for (uint8_t i=0; i<_override_count; i++) {
+        if (0 == strncmp(command, _overrides[i].prefix, strlen(_overrides[i].prefix))) {
+            latency = _overrides[i].latency;
+            jitter = _overrides[i].jitter;
+            break;
+        }
+    }
+    return latency + (jitter ? _random(jitter + 1) : 0);
+}
+
+/**
+ * @brief               Xorshift pseudo-random generator, deterministic for a given seed
+ * @param[in] max       Upper limit (excluded)
+ * @return              Random value in [0, max)
+ */
+uint32_t S7XGSimulator::_random(uint32_t max) {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return max ? _seed % max : 0;
+}
+
+/**
+ * @brief               Loads the default values for all settings
+ */
+void S7XGSimulator::_defaults() {
+    _value_count = 0;
+    for (uint8_t i=0; i<sizeof(S7XG_SIM_DEFAULTS) / sizeof(S7XG_SIM_DEFAULTS[0]); i++) {
+        _set(S7XG_SIM_DEFAULTS[i][0], S7XG_SIM_DEFAULTS[i][1]);
+    }
+}
+
+/**
+ * @brief               Gets a setting
+ * @param[in] key       Setting name
+ * @return              Value or NULL if not found
+ */
+const char * S7XGSimulator::_get(const char * key) {
+    for (uint8_t i=0; i<_value_count; i++) {
+        if (0 == strcmp(_values[i].key, key)) return _values[i].value;
+    }
+    return NULL;
+}
+
+/**
+ * @brief               Stores a setting
+ * @param[in] key       Setting name
+ * @param[in] value     Value
+ * @return              False if there is no room for more settings
+ */
+bool S7XGSimulator::_set(const char * key, const char * value) {
+    s7xg_sim_value_t * target = NULL;
+    for (uint8_t i=0; i<_value_count; i++) {
+        if (0 == strcmp(_values[i].key, key)) {
+            target = &_values[i];
+            break;
+        }
+    }
+    if (!target) {
+        if (S7XG_SIM_VALUES == _value_count) return false;
+        target = &_values[_value_count++];
+        strncpy(target->key, key, sizeof(target->key) - 1);
+        target->key[sizeof(target->key) - 1] = 0;
+    }
+    strncpy(target->value, value, sizeof(target->value) - 1);
+    target->value[sizeof(target->value) - 1] = 0;
+    return true;
+}
+
+/**
+ * @brief               Checks an on/off argument
+ * @param[in] value     Argument
+ * @return              True if valid
+ */
+bool S7XGSimulator::_onoff(const char * value) {
+    return (0 == strcmp(value, "on")) || (0 == strcmp(value, "off"));
+}
+
+/**
+ * @brief               Checks if the (simulated) join procedure has finished
+ * @return              True if joined
+ */
+bool S7XGSimulator::_joined() {
+    return _joined_pending && ((int32_t) (millis() - _joined_at) >= 0);
+}
+
+/**
+ * @brief               Checks if host and module understand each other
+ * @return              True if both use the same speed
+ */
+bool S7XGSimulator::_clean() {
+    return _host_baudrate == _baudrate;
+}
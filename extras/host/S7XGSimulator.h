@@ -0,0 +1,203 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "S7XG.h"
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+#define S7XG_SIM_INPUT_SIZE                   544
+#define S7XG_SIM_LINES                        8
+#define S7XG_SIM_LINE_SIZE                    128
+#define S7XG_SIM_VALUES                       48
+#define S7XG_SIM_KEY_SIZE                     20
+#define S7XG_SIM_VALUE_SIZE                   40
+#define S7XG_SIM_FIXES                        8
+#define S7XG_SIM_OVERRIDES                    8
+
+#define S7XG_SIM_LATENCY                      10
+#define S7XG_SIM_AIRTIME                      1000
+#define S7XG_SIM_JOIN_TIME                    2000
+#define S7XG_SIM_TTFF                         3000
+#define S7XG_SIM_BAUDRATE                     115200
+#define S7XG_SIM_NMEA_PERIOD                  1000
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+
+typedef struct {
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  int32_t latitude;     // millionths of a degree
+  int32_t longitude;    // millionths of a degree
+  uint16_t positioning; // tenths of a second
+} s7xg_sim_fix_t;
+
+typedef struct {
+  uint32_t due;
+  uint8_t length;
+  uint8_t position;
+  char data[S7XG_SIM_LINE_SIZE];
+} s7xg_sim_line_t;
+
+typedef struct {
+  char key[S7XG_SIM_KEY_SIZE];
+  char value[S7XG_SIM_VALUE_SIZE];
+} s7xg_sim_value_t;
+
+typedef struct {
+  const char * prefix;
+  uint32_t latency;
+  uint32_t jitter;
+} s7xg_sim_override_t;
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+class S7XGSimulator : public Stream {
+
+  public:
+
+    S7XGSimulator();
+
+    // Stream
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(char * buffer, size_t length);
+    size_t write(uint8_t ch);
+    size_t write(const uint8_t * buffer, size_t size);
+    void flush();
+
+    // Configuration
+    void seed(uint32_t seed);
+    void setLatency(uint32_t latency, uint32_t jitter = 0);
+    bool setLatency(const char * prefix, uint32_t latency, uint32_t jitter = 0);
+    void setAirtime(uint32_t ms);
+    void setJoinTime(uint32_t ms);
+    void setTTFF(uint32_t ms);
+    void setErrorRate(uint8_t percent, const char * response = "busy");
+    void setDropRate(uint8_t percent);
+    void setAckLossRate(uint8_t percent);
+    void setJoinFailRate(uint8_t percent);
+    void failNext(const char * response);
+    bool addFix(const s7xg_sim_fix_t & fix);
+    void clearFixes();
+    bool inject(const char * line, uint32_t delay = 0);
+    void setDownlink(uint8_t port, const char * data);
+    bool setBaudrate(uint32_t baudrate);
+    uint32_t getModuleBaudrate();
+
+    // Statistics
+    uint32_t commands();
+    uint32_t bytesReceived();
+    uint32_t bytesSent();
+
+  protected:
+
+    void _process();
+    void _execute(char * command);
+    void _reply(const char * line, uint32_t delay = 0, bool prompt = true);
+    void _replyf(uint32_t delay, const char * format, ...);
+    uint32_t _latency(const char * command);
+    uint32_t _random(uint32_t max);
+
+    void _sip(char * verb, char * args);
+    void _mac(char * verb, char * args);
+    void _gps(char * verb, char * args);
+    void _tx(char * args);
+    void _join(char * args);
+    void _gpsData();
+    void _nmeaOutput();
+    void _sentence(const char * format, ...);
+    static void _coordinate(char * buffer, size_t size, int32_t value, bool longitude);
+
+    void _defaults();
+    const char * _get(const char * key);
+    bool _set(const char * key, const char * value);
+    bool _onoff(const char * value);
+    bool _joined();
+    bool _clean();
+
+    char _input[S7XG_SIM_INPUT_SIZE];
+    uint16_t _input_length = 0;
+
+    s7xg_sim_line_t _lines[S7XG_SIM_LINES];
+    uint8_t _line_head = 0;
+    uint8_t _line_count = 0;
+
+    s7xg_sim_value_t _values[S7XG_SIM_VALUES];
+    uint8_t _value_count = 0;
+
+    s7xg_sim_fix_t _fixes[S7XG_SIM_FIXES];
+    uint8_t _fix_count = 0;
+    uint8_t _fix_next = 0;
+
+    s7xg_sim_override_t _overrides[S7XG_SIM_OVERRIDES];
+    uint8_t _override_count = 0;
+
+    uint32_t _seed = 0x5EED5EED;
+    uint32_t _latency_base = S7XG_SIM_LATENCY;
+    uint32_t _latency_jitter = 0;
+    uint32_t _airtime = S7XG_SIM_AIRTIME;
+    uint32_t _join_time = S7XG_SIM_JOIN_TIME;
+    uint32_t _ttff = S7XG_SIM_TTFF;
+    uint8_t _error_rate = 0;
+    const char * _error_response = "busy";
+    uint8_t _drop_rate = 0;
+    uint8_t _ack_loss_rate = 0;
+    uint8_t _join_fail_rate = 0;
+    bool _fail_next = false;
+    const char * _fail_response = NULL;
+
+    uint8_t _downlink_port = 0;
+    char _downlink[S7XG_SIM_VALUE_SIZE];
+
+    uint32_t _baudrate = S7XG_SIM_BAUDRATE;
+    uint32_t _host_baudrate = S7XG_SIM_BAUDRATE;
+
+    bool _sleeping = false;
+    bool _joined_pending = false;
+    uint32_t _joined_at = 0;
+    bool _session_saved = false;
+    bool _gps_init = false;
+    uint8_t _gps_mode = S7XG_GPS_MODE_IDLE;
+    uint32_t _gps_start = 0;
+    uint8_t _nmea = 0;
+    uint8_t _nmea_pending = 0;
+    uint8_t _nmea_fix = 0;
+    uint32_t _nmea_next = 0;
+
+    uint32_t _commands = 0;
+    uint32_t _bytes_received = 0;
+    uint32_t _bytes_sent = 0;
+
+};
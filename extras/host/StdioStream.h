@@ -0,0 +1,44 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "Stream.h"
+
+// Console stream (stdin/stdout), used as the host "Serial" object
+class StdioStream : public Stream {
+
+  public:
+
+    void begin(unsigned long baud = 0) { (void) baud; }
+
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t ch);
+    size_t write(const uint8_t * buffer, size_t size);
+    void flush();
+
+  protected:
+
+    int _peeked = -1;
+
+};
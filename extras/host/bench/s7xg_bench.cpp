@@ -0,0 +1,360 @@
+/*
+
+S7XG library
+
+Benchmarks for the host build
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XG.h"
+#include "S7XGMulti.h"
+#include "S7XGSimulator.h"
+#include "S7XGThread.h"
+#include "S7XGTrack.h"
+#include "S7XGTrackLog.h"
+
+#include <time.h>
+#include <ucontext.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+// Usage: s7xg_bench [-n iterations] [-l latency_ms] [-f text|json|csv]
+//
+// Command benchmarks run against the simulator, with no latency by default,
+// so they measure the library overhead (formatting, framing, parsing).
+// Stack usage is measured running one call on a painted stack.
+
+#define BENCH_STACK_SIZE                      (64 * 1024)
+#define BENCH_STACK_PAINT                     0xA5
+#define BENCH_MODULES                         4
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    const char * name;
+    uint32_t iterations;
+    double min_us;
+    double p50_us;
+    double p99_us;
+    double max_us;
+    double mean_us;
+    double cpu_us;
+    double bytes_per_second;
+    size_t stack_bytes;
+} bench_result_t;
+
+typedef std::function<size_t()> bench_function_t;
+
+// ----------------------------------------------------------------------------
+// Globals
+// ----------------------------------------------------------------------------
+
+S7XGSimulator simulator;
+S7XG module;
+S7XGSimulator multi_simulators[BENCH_MODULES];
+S7XG multi_modules[BENCH_MODULES];
+S7XGMulti multi;
+S7XGSimulator thread_simulator;
+S7XG thread_module;
+S7XGThread worker;
+std::vector<bench_result_t> results;
+
+static ucontext_t _main_context;
+static ucontext_t _bench_context;
+static bench_function_t * _stack_function;
+
+// ----------------------------------------------------------------------------
+// Measurement
+// ----------------------------------------------------------------------------
+
+static double _now_us(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void _stack_trampoline() {
+    (*_stack_function)();
+}
+
+/**
+ * @brief               Runs the function once on a painted stack
+ * @param[in] function  Function to run
+ * @return              Maximum number of stack bytes used
+ */
+static size_t _stack_usage(bench_function_t & function) {
+    static uint8_t stack[BENCH_STACK_SIZE];
+    memset(stack, BENCH_STACK_PAINT, sizeof(stack));
+    _stack_function = &function;
+    getcontext(&_bench_context);
+    _bench_context.uc_stack.ss_sp = stack;
+    _bench_context.uc_stack.ss_size = sizeof(stack);
+    _bench_context.uc_link = &_main_context;
+    makecontext(&_bench_context, _stack_trampoline, 0);
+    swapcontext(&_main_context, &_bench_context);
+    size_t untouched = 0;
+    while ((untouched < sizeof(stack)) && (BENCH_STACK_PAINT == stack[untouched])) untouched++;
+    return sizeof(stack) - untouched;
+}
+
+/**
+ * @brief               Runs a benchmark and stores the results
+ * @param[in] name      Benchmark name
+ * @param[in] iterations Number of runs
+ * @param[in] function  Function to benchmark, returns the number of bytes processed (0 if not relevant)
+ */
+static void _bench(const char * name, uint32_t iterations, bench_function_t function) {
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    size_t bytes = 0;
+
+    // Warm up
+    function();
+
+    double cpu_start = _now_us(CLOCK_THREAD_CPUTIME_ID);
+    double wall_start = _now_us(CLOCK_MONOTONIC);
+    for (uint32_t i=0; i<iterations; i++) {
+        double start = _now_us(CLOCK_MONOTONIC);
+        bytes += function();
+        samples.push_back(_now_us(CLOCK_MONOTONIC) - start);
+    }
+    double wall = _now_us(CLOCK_MONOTONIC) - wall_start;
+    double cpu = _now_us(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+    std::sort(samples.begin(), samples.end());
+    bench_result_t result;
+    result.name = name;
+    result.iterations = iterations;
+    result.min_us = samples.front();
+    result.p50_us = samples[iterations / 2];
+    result.p99_us = samples[(iterations * 99) / 100];
+    result.max_us = samples.back();
+    result.mean_us = wall / iterations;
+    result.cpu_us = cpu / iterations;
+    result.bytes_per_second = bytes ? bytes / (wall / 1e6) : 0;
+    result.stack_bytes = _stack_usage(function);
+    results.push_back(result);
+
+}
+
+/**
+ * @brief               Runs a benchmark from several threads at once and stores the merged results
+ * @details             Each thread runs the function the given number of times, the latency of every
+ *                      call is measured from the calling thread. CPU time is for the whole process.
+ * @param[in] name      Benchmark name
+ * @param[in] threads   Number of threads
+ * @param[in] iterations Number of runs per thread
+ * @param[in] function  Function to benchmark, receives the thread number
+ */
+static void _bench_threads(const char * name, uint8_t threads, uint32_t iterations, std::function<void(uint8_t)> function) {
+
+    std::vector<std::vector<double>> samples(threads);
+    std::vector<std::thread> runners;
+
+    double cpu_start = _now_us(CLOCK_PROCESS_CPUTIME_ID);
+    double wall_start = _now_us(CLOCK_MONOTONIC);
+    for (uint8_t t=0; t<threads; t++) {
+        runners.emplace_back([&, t]() {
+            samples[t].reserve(iterations);
+            for (uint32_t i=0; i<iterations; i++) {
+                double start = _now_us(CLOCK_MONOTONIC);
+                function(t);
+                samples[t].push_back(_now_us(CLOCK_MONOTONIC) - start);
+            }
+        });
+    }
+    for (std::thread & runner : runners) runner.join();
+    double wall = _now_us(CLOCK_MONOTONIC) - wall_start;
+    double cpu = _now_us(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+
+    std::vector<double> all;
+    for (std::vector<double> & s : samples) all.insert(all.end(), s.begin(), s.end());
+    std::sort(all.begin(), all.end());
+    uint32_t total = all.size();
+    bench_result_t result;
+    result.name = name;
+    result.iterations = total;
+    result.min_us = all.front();
+    result.p50_us = all[total / 2];
+    result.p99_us = all[(total * 99) / 100];
+    result.max_us = all.back();
+    result.mean_us = wall / total;
+    result.cpu_us = cpu / total;
+    result.bytes_per_second = 0;
+    result.stack_bytes = 0;
+    results.push_back(result);
+
+}
+
+// ----------------------------------------------------------------------------
+// Output
+// ----------------------------------------------------------------------------
+
+static void _print(const char * format) {
+
+    if (0 == strcmp(format, "json")) {
+        printf("[\n");
+        for (size_t i=0; i<results.size(); i++) {
+            bench_result_t & r = results[i];
+            printf(
+                "  {\"name\": \"%s\", \"iterations\": %u, \"min_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, "
+                "\"max_us\": %.3f, \"mean_us\": %.3f, \"cpu_us\": %.3f, \"bytes_per_second\": %.0f, \"stack_bytes\": %zu}%s\n",
+                r.name, r.iterations, r.min_us, r.p50_us, r.p99_us, r.max_us, r.mean_us, r.cpu_us,
+                r.bytes_per_second, r.stack_bytes, i + 1 < results.size() ? "," : "");
+        }
+        printf("]\n");
+        return;
+    }
+
+    if (0 == strcmp(format, "csv")) {
+        printf("name,iterations,min_us,p50_us,p99_us,max_us,mean_us,cpu_us,bytes_per_second,stack_bytes\n");
+        for (bench_result_t & r : results) {
+            printf("%s,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.0f,%zu\n",
+                r.name, r.iterations, r.min_us, r.p50_us, r.p99_us, r.max_us, r.mean_us, r.cpu_us,
+                r.bytes_per_second, r.stack_bytes);
+        }
+        return;
+    }
+
+    printf("%-24s %8s %10s %10s %10s %10s %10s %12s %7s\n", "name", "iter", "min_us", "p50_us", "p99_us", "max_us", "cpu_us", "bytes/s", "stack");
+    for (bench_result_t & r : results) {
+        printf("%-24s %8u %10.2f %10.2f %10.2f %10.2f %10.2f %12.0f %7zu\n",
+            r.name, r.iterations, r.min_us, r.p50_us, r.p99_us, r.max_us, r.cpu_us,
+            r.bytes_per_second, r.stack_bytes);
+    }
+
+}
+
+// ----------------------------------------------------------------------------
+// Main
+// ----------------------------------------------------------------------------
+
+int main(int argc, char ** argv) {
+
+    uint32_t iterations = 1000;
+    uint32_t latency = 0;
+    const char * format = "text";
+    for (int i=1; i<argc-1; i++) {
+        if (0 == strcmp(argv[i], "-n")) iterations = strtoul(argv[++i], NULL, 10);
+        else if (0 == strcmp(argv[i], "-l")) latency = strtoul(argv[++i], NULL, 10);
+        else if (0 == strcmp(argv[i], "-f")) format = argv[++i];
+    }
+    if (0 == iterations) iterations = 1;
+
+    simulator.setLatency(latency);
+    simulator.setAirtime(0);
+    simulator.setJoinTime(0);
+    simulator.setTTFF(0);
+    simulator.addFix({ 2019, 9, 2, 12, 33, 34, 41601215, 2622485, 36 });
+    module.begin(simulator);
+    for (uint8_t i=0; i<BENCH_MODULES; i++) {
+        multi_simulators[i].setLatency(latency);
+        multi_modules[i].begin(multi_simulators[i]);
+        multi.add(multi_modules[i]);
+    }
+    thread_simulator.setLatency(latency);
+    thread_module.begin(thread_simulator);
+    worker.begin(thread_module);
+
+    const char * devaddr = "26011433";
+    const char * nwkskey = "5DE49A0F0C9649B8D466B9032DAAB331";
+    const char * appskey = "EE0080DAB519CEF94E2EC83A110AA43A";
+
+    uint8_t payload[222];
+    for (size_t i=0; i<sizeof(payload); i++) payload[i] = i * 7;
+    char hex[sizeof(payload) * 2 + 1];
+
+    // Commands (alternating values or clearing the cache so every call reaches the module)
+    uint8_t power = 14;
+    _bench("getVersion", iterations, [&]() -> size_t { module.invalidate(); module.getVersion(); return 0; });
+    _bench("macPower", iterations, [&]() -> size_t { module.macPower(power ^= 6); return 0; });
+    _bench("macBand", iterations, [&]() -> size_t { module.invalidate(); module.macBand(); return 0; });
+    _bench("macJoinABP", iterations, [&]() -> size_t { module.macJoinABP(devaddr, nwkskey, appskey); return 0; });
+    _bench("macSend_16", iterations, [&]() -> size_t { module.macSend(payload, 16); return 0; });
+    _bench("macSend_51", iterations, [&]() -> size_t { module.macSend(payload, 51); return 0; });
+    _bench("gpsInit", iterations / 10 + 1, [&]() -> size_t { module.invalidate(); module.gpsInit(); return 0; });
+    _bench("gpsData", iterations, [&]() -> size_t { module.gpsData(); return 0; });
+    _bench("async_macPower", iterations, [&]() -> size_t {
+        module.async(NULL)->macPower(power ^= 6);
+        while (module.busy()) module.loop();
+        return 0;
+    });
+    _bench("multi_macPower_x4", iterations, [&]() -> size_t {
+        power ^= 6;
+        for (uint8_t i=0; i<BENCH_MODULES; i++) multi_modules[i].async(NULL)->macPower(power);
+        multi.wait();
+        return 0;
+    });
+
+    // Threaded backend, a call per iteration from one and from four application threads
+    int8_t channels[BENCH_MODULES + 1];
+    for (uint8_t i=0; i<=BENCH_MODULES; i++) channels[i] = worker.attach();
+    s7xg_thread_call_t toggle = [](S7XG & m, void *) -> bool {
+        static uint8_t power = 14;      // Only touched by the worker
+        return m.macPower(power ^= 6);
+    };
+    _bench("thread_macPower", iterations, [&]() -> size_t { worker.call(channels[0], toggle); return 0; });
+    _bench_threads("thread_macPower_x4", BENCH_MODULES, iterations, [&](uint8_t t) { worker.call(channels[t + 1], toggle); });
+    worker.end();
+
+    // Cached
+    _bench("cached_getVersion", iterations, [&]() -> size_t { module.getVersion(); return 0; });
+    _bench("cached_macPower", iterations, [&]() -> size_t { module.macPower(power); return 0; });
+    _bench("cached_gpsInit", iterations, [&]() -> size_t { module.gpsInit(); return 0; });
+
+    // Utils
+    uint32_t loops = iterations * 10;
+    const char * dd = "DD UTC( 2019/09/02 12:33:34 ) LAT( 41.601215 N ) LONG( 2.622485 E ) POSITIONING( 3.6s )";
+    _bench("gpsParse", loops, [&]() -> size_t { gps_message_t message; S7XG::gpsParse(dd, message); return strlen(dd); });
+    const char * nmea =
+        "$GPRMC,123334.00,A,4136.07290,N,00237.34910,E,0.50,54.70,020919,,,A*6F\r\n"
+        "$GPGGA,123334.00,4136.07290,N,00237.34910,E,1,04,1.20,123.4,M,49.8,M,,*5B\r\n";
+    S7XGNmea parser;
+    _bench("nmea_feed", loops, [&]() -> size_t {
+        const char * p = nmea;
+        while (*p) parser.feed(*p++);
+        return p - nmea;
+    });
+    S7XGTrack track;
+    _bench("track_encode", loops, [&]() -> size_t {
+        track.clear();
+        for (uint32_t i=0; !track.full(); i++) track.add(1567427614 + i * 10, 41601215 + i * 93, 2622485 - i * 61);
+        return track.length();
+    });
+    s7xg_track_point_t points[S7XG_UPLINK_SIZE];
+    _bench("track_decode", loops, [&]() -> size_t {
+        S7XGTrack::decode(track.data(), track.length(), points, S7XG_UPLINK_SIZE);
+        return track.length();
+    });
+    static S7XGTrackLog<360> history;
+    s7xg_log_fix_t entry = { 1567427614, 41601215, 2622485, 36, true };
+    _bench("log_append", loops, [&]() -> size_t { entry.time += 10; history.append(entry); return 0; });
+    volatile uint16_t index;
+    _bench("log_since", loops, [&]() -> size_t { index = history.since(entry.time - 1800); return 0; });
+    _bench("hexlify_222", loops, [&]() -> size_t { module.hexlify(payload, hex, sizeof(payload)); return sizeof(payload); });
+    _bench("unhexlify_222", loops, [&]() -> size_t { module.unhexlify(hex, payload, sizeof(payload)); return sizeof(payload); });
+
+    _print(format);
+    return 0;
+
+}
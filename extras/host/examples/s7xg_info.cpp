@@ -0,0 +1,87 @@
+/*
+
+S7XG library
+
+Module information tool for POSIX hosts
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XG.h"
+#include "S7XGSimulator.h"
+#include "PosixSerial.h"
+
+// Usage: s7xg_info [device [baudrate [password]]]
+// Without a device it runs against the simulated module.
+// With a password the fastest baudrate up to the given one is negotiated.
+
+static bool setBaudrate(uint32_t baudrate, void * arg) {
+    return ((PosixSerial *) arg)->setBaudrate(baudrate);
+}
+
+int main(int argc, char ** argv) {
+
+    PosixSerial serial;
+    S7XGSimulator simulator;
+    S7XG module;
+
+    if (argc > 1) {
+        uint32_t baud = (argc > 2) ? strtoul(argv[2], NULL, 10) : 115200;
+        if (!serial.begin(argv[1], baud)) {
+            fprintf(stderr, "[ERROR] Could not open %s at %u bauds\n", argv[1], baud);
+            return 1;
+        }
+        if (argc > 3) {
+            if (!module.begin(serial, setBaudrate, argv[3], baud, &serial)) {
+                fprintf(stderr, "[ERROR] Could not find the module at any baudrate\n");
+                return 1;
+            }
+        } else {
+            module.begin(serial);
+        }
+    } else {
+        module.begin(simulator);
+    }
+
+    char * version = module.getVersion();
+    if (!version || !version[0]) {
+        fprintf(stderr, "[ERROR] No answer from the module\n");
+        return 1;
+    }
+    printf("Version    : %s\n", version);
+    if (module.getBaudrate()) printf("Baudrate   : %u\n", module.getBaudrate());
+    printf("Hardware   : %s\n", module.getHardware());
+    printf("Device EUI : %s\n", module.getEUI());
+    printf("Band       : %u\n", module.macBand());
+    printf("Joined     : %s\n", module.macJoined() ? "yes" : "no");
+    printf("Up counter : %u\n", module.macUpCounter());
+
+    const char * kinds[S7XG_KIND_COUNT] = { "sip", "mac set", "mac get", "mac tx", "mac join", "gps" };
+    printf("\n%-10s %6s %6s %6s %8s %8s %8s %8s\n", "kind", "count", "errors", "tmout", "min_ms", "p50_ms", "p99_ms", "max_ms");
+    for (uint8_t kind=0; kind<S7XG_KIND_COUNT; kind++) {
+        const s7xg_stats_t & stats = module.getStats(kind);
+        if (0 == stats.count) continue;
+        printf("%-10s %6u %6u %6u %8.1f %8u %8u %8.1f\n", kinds[kind], stats.count, stats.errors, stats.timeouts,
+            stats.min_us / 1000.0, module.getLatencyPercentile(kind, 50), module.getLatencyPercentile(kind, 99),
+            stats.max_us / 1000.0);
+    }
+    const s7xg_link_stats_t & link = module.getLinkStats();
+    printf("\nSent %u bytes, received %u bytes (%u discarded)\n", link.bytes_sent, link.bytes_received, link.bytes_discarded);
+
+    return 0;
+
+}
@@ -0,0 +1,113 @@
+/*
+
+S7XG library
+
+Provisions many simulated modules concurrently with coroutines
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGCoro.h"
+#include "S7XGSimulator.h"
+
+#include <memory>
+
+// Usage: s7xg_sessions [sessions [uplinks [latency_ms]]]
+// Every session joins, configures the radio, sends a few uplinks and reads
+// the GPS, all of them at the same time from a single thread.
+
+typedef struct {
+  uint32_t joined;
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t fixes;
+} counters_t;
+
+struct device_t {
+  S7XGSimulator simulator;
+  S7XG module;
+};
+
+static counters_t counters = { 0, 0, 0, 0 };
+
+static S7XGTask configure(S7XGSession & session) {
+    bool ok = co_await session.macPower(14);
+    ok &= co_await session.macDatarate(5);
+    ok &= co_await session.macADR(false);
+    if (!ok) counters.failed++;
+}
+
+static S7XGTask provision(S7XGSession & session, uint32_t index, uint32_t uplinks) {
+
+    // The GPS looks for a fix while the module joins
+    co_await session.gpsInit();
+
+    char deveui[17];
+    snprintf(deveui, sizeof(deveui), "00000000%08X", index);
+    if (!co_await session.macJoinOTAA(deveui, "70B3D57ED0000000", "000102030405060708090A0B0C0D0E0F")) {
+        counters.failed++;
+        co_return;
+    }
+    counters.joined++;
+
+    co_await configure(session);
+
+    uint8_t payload[4] = { (uint8_t) (index >> 24), (uint8_t) (index >> 16), (uint8_t) (index >> 8), (uint8_t) index };
+    for (uint32_t i=0; i<uplinks; i++) {
+        if (co_await session.macSend(payload, sizeof(payload), false, 1)) {
+            counters.sent++;
+        } else {
+            counters.failed++;
+        }
+    }
+
+    gps_message_t message = co_await session.gpsData();
+    if (message.valid & S7XG_GPS_VALID_POSITION) counters.fixes++;
+
+}
+
+int main(int argc, char ** argv) {
+
+    uint32_t count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 500;
+    uint32_t uplinks = (argc > 2) ? strtoul(argv[2], NULL, 10) : 3;
+    uint32_t latency = (argc > 3) ? strtoul(argv[3], NULL, 10) : 20;
+
+    S7XGExecutor executor;
+    std::vector<std::unique_ptr<device_t>> devices;
+    std::vector<std::unique_ptr<S7XGSession>> sessions;
+    for (uint32_t i=0; i<count; i++) {
+        device_t * device = new device_t;
+        device->simulator.seed(i + 1);
+        device->simulator.addFix({ 2019, 9, 2, 12, 33, 34, 41601215, 2622485, 36 });
+        device->module.begin(device->simulator);
+        device->simulator.setLatency(latency, latency / 4);
+        devices.emplace_back(device);
+        sessions.emplace_back(new S7XGSession(device->module, executor));
+    }
+
+    uint32_t start = millis();
+    for (uint32_t i=0; i<count; i++) executor.spawn(provision(*sessions[i], i, uplinks));
+    uint32_t frames = S7XGTask::frames();
+    uint32_t bytes = S7XGTask::frameBytes();
+    executor.run();
+    uint32_t elapsed = millis() - start;
+
+    printf("%u sessions, %u coroutine frames (%u bytes each) on one thread\n", count, frames, frames ? bytes / frames : 0);
+    printf("joined %u, uplinks %u, gps fixes %u, failed %u in %u ms\n", counters.joined, counters.sent, counters.fixes, counters.failed, elapsed);
+    return counters.failed ? 1 : 0;
+
+}
@@ -0,0 +1,74 @@
+/*
+
+S7XG library
+
+Serves a simulated module on a pseudo-terminal
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGSimulator.h"
+#include "PosixSerial.h"
+
+#include <poll.h>
+
+// Usage: s7xg_simd [latency_ms [jitter_ms]]
+// Prints the pseudo-terminal path, then any program (including s7xg_info)
+// can open it as if it was the serial port of a real module.
+
+// Like the real module, a command is considered complete when the line has been idle for a while
+#define S7XG_SIMD_IDLE_MS                     5
+
+int main(int argc, char ** argv) {
+
+    S7XGSimulator simulator;
+    if (argc > 1) simulator.setLatency(strtoul(argv[1], NULL, 10), argc > 2 ? strtoul(argv[2], NULL, 10) : 0);
+    simulator.addFix({ 2019, 9, 2, 12, 33, 34, 41601215, 2622485, 36 });
+
+    PosixSerial pty;
+    const char * name = pty.openPty();
+    if (!name) {
+        perror("[ERROR] Could not open pseudo-terminal");
+        return 1;
+    }
+    printf("%s\n", name);
+    fflush(stdout);
+
+    uint32_t last = 0;
+    bool pending = false;
+    while (true) {
+
+        struct pollfd pfd = { pty.fd(), POLLIN, 0 };
+        poll(&pfd, 1, 1);
+
+        // Host to module
+        while (pty.available()) {
+            simulator.write(pty.read());
+            last = millis();
+            pending = true;
+        }
+
+        // Module to host
+        if (pending && (millis() - last < S7XG_SIMD_IDLE_MS)) continue;
+        pending = false;
+        while (simulator.available()) pty.write(simulator.read());
+
+    }
+
+    return 0;
+
+}
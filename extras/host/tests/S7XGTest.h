@@ -0,0 +1,104 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+Minimal test harness for the host tests, run by ctest. Every test program
+calls S7XG_TEST() for each case and returns s7xg_test_result(); a failed
+check prints its location and the program exits with 1.
+
+Simulated modules answer in real time, keep latencies and airtimes short.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "S7XG.h"
+#include "S7XGSimulator.h"
+
+static uint32_t s7xg_test_checks = 0;
+static uint32_t s7xg_test_failures = 0;
+static const char * s7xg_test_name = "";
+
+#define S7XG_CHECK(condition) \
+  s7xg_test_check((condition), #condition, __FILE__, __LINE__)
+
+#define S7XG_CHECK_EQUAL(expected, actual) \
+  s7xg_test_equal((long long) (expected), (long long) (actual), #actual, __FILE__, __LINE__)
+
+#define S7XG_CHECK_STRING(expected, actual) \
+  s7xg_test_string((expected), (actual), #actual, __FILE__, __LINE__)
+
+#define S7XG_TEST(test) \
+  do { s7xg_test_name = #test; test(); } while (0)
+
+static inline bool s7xg_test_check(bool condition, const char * text, const char * file, int line) {
+    s7xg_test_checks++;
+    if (!condition) {
+        s7xg_test_failures++;
+        printf("%s:%d: %s: check failed: %s\n", file, line, s7xg_test_name, text);
+    }
+    return condition;
+}
+
+static inline bool s7xg_test_equal(long long expected, long long actual, const char * text, const char * file, int line) {
+    s7xg_test_checks++;
+    if (expected != actual) {
+        s7xg_test_failures++;
+        printf("%s:%d: %s: %s is %lld, expected %lld\n", file, line, s7xg_test_name, text, actual, expected);
+    }
+    return expected == actual;
+}
+
+static inline bool s7xg_test_string(const char * expected, const char * actual, const char * text, const char * file, int line) {
+    s7xg_test_checks++;
+    bool equal = actual && (0 == strcmp(expected, actual));
+    if (!equal) {
+        s7xg_test_failures++;
+        printf("%s:%d: %s: %s is \"%s\", expected \"%s\"\n", file, line, s7xg_test_name, text, actual ? actual : "(null)", expected);
+    }
+    return equal;
+}
+
+/**
+ * @brief               Calls the module loop() until a condition holds
+ * @param[in] module    Module
+ * @param[in] timeout   Maximum time to wait in milliseconds
+ * @param[in] done      Condition, example: [&] { return !module.busy(); }
+ * @return              False if the time ran out
+ */
+template<typename F> bool s7xg_test_until(S7XG & module, uint32_t timeout, F done) {
+    uint32_t start = millis();
+    while (!done()) {
+        if (millis() - start >= timeout) return false;
+        module.loop();
+        delay(1);
+    }
+    return true;
+}
+
+/**
+ * @brief               Prints the summary
+ * @return              Exit code, 0 if every check passed
+ */
+static inline int s7xg_test_result() {
+    printf("%u checks, %u failed\n", s7xg_test_checks, s7xg_test_failures);
+    return s7xg_test_failures ? 1 : 0;
+}
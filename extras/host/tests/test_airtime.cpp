@@ -0,0 +1,89 @@
+/*
+
+S7XG library
+
+Airtime tests: time on air against the Semtech calculator and the duty cycle budget
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+// Usable at compile time
+static_assert(S7XG::uplinkAirtime(868, S7XG_DR_SF7BW125_EU, 10) == 61696, "SF7BW125, 10 bytes");
+static_assert(S7XG::dutyCycle(868) == 10, "1% in EU868");
+
+static void timeOnAir() {
+
+    // Semtech LoRa calculator: 4/5, explicit header, CRC, 8 symbols preamble
+    S7XG_CHECK_EQUAL(1024, S7XG::symbolTime(7, 125));
+    S7XG_CHECK_EQUAL(32768, S7XG::symbolTime(12, 125));
+    S7XG_CHECK_EQUAL(61696, S7XG::timeOnAir(7, 125, 23));
+    S7XG_CHECK_EQUAL(1482752, S7XG::timeOnAir(12, 125, 23));
+    S7XG_CHECK_EQUAL(23168, S7XG::timeOnAir(7, 250, 13));
+
+    // Low data rate optimisation only for 16 ms symbols and longer
+    S7XG_CHECK_EQUAL(S7XG::timeOnAir(11, 125, 23), S7XG::uplinkAirtime(868, S7XG_DR_SF11BW125_EU, 10));
+    S7XG_CHECK_EQUAL(823296, S7XG::timeOnAir(11, 125, 23));
+}
+
+static void dataRates() {
+    S7XG_CHECK_EQUAL(12, S7XG::spreadingFactor(868, S7XG_DR_SF12BW125_EU));
+    S7XG_CHECK_EQUAL(7, S7XG::spreadingFactor(868, S7XG_DR_SF7BW250_EU));
+    S7XG_CHECK_EQUAL(250, S7XG::bandwidth(868, S7XG_DR_SF7BW250_EU));
+    S7XG_CHECK_EQUAL(125, S7XG::bandwidth(470, 6));
+    S7XG_CHECK_EQUAL(10, S7XG::spreadingFactor(915, S7XG_DR_SF10BW125_US));
+    S7XG_CHECK_EQUAL(8, S7XG::spreadingFactor(915, S7XG_DR_SF8BW500_US));
+    S7XG_CHECK_EQUAL(500, S7XG::bandwidth(915, S7XG_DR_SF8BW500_US));
+    S7XG_CHECK_EQUAL(1000, S7XG::dutyCycle(915));
+}
+
+static void budget() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setAirtime(5);
+    module.begin(sim);
+    S7XG_CHECK_EQUAL(868, module.macBand());
+    S7XG_CHECK(module.macDatarate(S7XG_DR_SF7BW125_EU));
+    S7XG_CHECK(module.macJoinABP("26011B1B", "00112233445566770011223344556677", "00112233445566770011223344556677"));
+
+    uint32_t capacity = S7XG_DUTY_CYCLE_WINDOW * 10;
+    S7XG_CHECK_EQUAL(capacity, module.airtimeBudget());
+    S7XG_CHECK_EQUAL(0, module.nextUplinkIn(10));
+    S7XG_CHECK_EQUAL(255, module.uplinksInBudget(10));
+
+    // Every accepted uplink spends its airtime, time earns it back at 1%
+    uint32_t start = millis();
+    S7XG_CHECK(module.macSend((const uint8_t *) "0123456789", 10));
+    uint32_t spent = capacity - module.airtimeBudget();
+    uint32_t earned = (millis() - start) * 10;
+    S7XG_CHECK(spent <= 61696);
+    S7XG_CHECK(spent + earned >= 61696);
+
+    // Until the budget is gone
+    S7XG_CHECK(module.macDatarate(S7XG_DR_SF12BW125_EU));
+    uint32_t slow = S7XG::uplinkAirtime(868, S7XG_DR_SF12BW125_EU, 51);
+    S7XG_CHECK_EQUAL(module.airtimeBudget() / slow, module.uplinksInBudget(51));
+}
+
+int main() {
+    S7XG_TEST(timeOnAir);
+    S7XG_TEST(dataRates);
+    S7XG_TEST(budget);
+    return s7xg_test_result();
+}
@@ -0,0 +1,120 @@
+/*
+
+S7XG library
+
+Baudrate negotiation tests: locating the module, switching up and falling back
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+static const char PASSWORD[] = "12345678";
+
+static bool baudrate(uint32_t baudrate, void * arg) {
+    return ((S7XGSimulator *) arg)->setBaudrate(baudrate);
+}
+
+// Leaves the simulated module at the given speed, like a previous session would
+static void previous(S7XGSimulator & sim, uint32_t speed) {
+    S7XG module;
+    module.setTimeouts(10, 200);
+    S7XG_CHECK(module.begin(sim, baudrate, PASSWORD, speed, &sim));
+    S7XG_CHECK_EQUAL(speed, sim.getModuleBaudrate());
+}
+
+static void fastest() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.setTimeouts(10, 200);
+    S7XG_CHECK(module.begin(sim, baudrate, PASSWORD, 115200, &sim));
+    S7XG_CHECK_EQUAL(115200, module.getBaudrate());
+    S7XG_CHECK_STRING("v1.6.5", module.getVersion());
+}
+
+static void located() {
+    S7XGSimulator sim;
+    sim.setLatency(1);
+    previous(sim, 9600);
+
+    // Found at 9600 and moved up to the limit
+    S7XG module;
+    module.setTimeouts(10, 200);
+    S7XG_CHECK(module.begin(sim, baudrate, PASSWORD, 57600, &sim));
+    S7XG_CHECK_EQUAL(57600, module.getBaudrate());
+    S7XG_CHECK_EQUAL(57600, sim.getModuleBaudrate());
+    S7XG_CHECK(module.macPower(14));
+
+    // Already there, nothing to switch
+    uint32_t commands = sim.commands();
+    S7XG_CHECK_EQUAL(57600, module.negotiateBaudrate(baudrate, PASSWORD, 57600, &sim));
+    S7XG_CHECK_EQUAL(commands + 1, sim.commands());
+}
+
+static void rejected() {
+    S7XGSimulator sim;
+    sim.setLatency(1);
+    previous(sim, 9600);
+
+    // A wrong password, the module refuses every speed and stays where it was found
+    S7XG module;
+    module.setTimeouts(10, 200);
+    S7XG_CHECK(module.begin(sim, baudrate, "", 115200, &sim));
+    S7XG_CHECK_EQUAL(9600, module.getBaudrate());
+    S7XG_CHECK_EQUAL(9600, sim.getModuleBaudrate());
+    S7XG_CHECK(module.macPower(14));
+}
+
+static void limited() {
+    S7XGSimulator sim;
+    sim.setLatency(1);
+    previous(sim, 9600);
+
+    // The host cannot do 115200, the module is not asked for it
+    struct { S7XGSimulator * sim; uint32_t max; } host = { &sim, 57600 };
+    S7XG module;
+    module.setTimeouts(10, 200);
+    S7XG_CHECK(module.begin(sim, [](uint32_t speed, void * arg) {
+        decltype(host) * h = (decltype(host) *) arg;
+        return (speed <= h->max) && h->sim->setBaudrate(speed);
+    }, PASSWORD, 115200, &host));
+    S7XG_CHECK_EQUAL(57600, module.getBaudrate());
+    S7XG_CHECK_EQUAL(57600, sim.getModuleBaudrate());
+    S7XG_CHECK(module.macPower(14));
+}
+
+static void missing() {
+    S7XGSimulator sim;
+    sim.setLatency(1);
+    sim.setDropRate(100);
+
+    // Nobody answers at any speed
+    S7XG module;
+    module.setTimeouts(10, 50);
+    S7XG_CHECK(!module.begin(sim, baudrate, PASSWORD, 115200, &sim));
+    S7XG_CHECK_EQUAL(0, module.getBaudrate());
+}
+
+int main() {
+    S7XG_TEST(fastest);
+    S7XG_TEST(located);
+    S7XG_TEST(rejected);
+    S7XG_TEST(limited);
+    S7XG_TEST(missing);
+    return s7xg_test_result();
+}
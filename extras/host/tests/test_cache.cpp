@@ -0,0 +1,124 @@
+/*
+
+S7XG library
+
+Configuration cache tests: skipped setters, constant getters and invalidation
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+static void setters() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+
+    // The same value again is answered from the cache
+    uint32_t commands = sim.commands();
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(commands + 1, sim.commands());
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(commands + 1, sim.commands());
+    S7XG_CHECK_EQUAL(S7XG_STATUS_OK, module.getStatus());
+    S7XG_CHECK_STRING("Ok", module.getResponse());
+
+    // Another value is sent
+    S7XG_CHECK(module.macPower(20));
+    S7XG_CHECK_EQUAL(commands + 2, sim.commands());
+
+    // A failed setter forgets the value
+    sim.failNext("busy");
+    S7XG_CHECK(!module.macPower(14));
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(commands + 4, sim.commands());
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(commands + 4, sim.commands());
+}
+
+static void queued() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+
+    // Checked when they reach the head of the queue, not when queued
+    uint32_t commands = sim.commands();
+    module.async(NULL)->macPower(14);
+    module.async(NULL)->macPower(14);
+    S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return !module.busy(); }));
+    S7XG_CHECK_EQUAL(commands + 1, sim.commands());
+}
+
+static void getters() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+
+    uint32_t commands = sim.commands();
+    S7XG_CHECK_STRING("v1.6.5", module.getVersion());
+    S7XG_CHECK_STRING("S76G", module.getHardware());
+    S7XG_CHECK_EQUAL(868, module.macBand());
+    S7XG_CHECK_EQUAL(commands + 3, sim.commands());
+    S7XG_CHECK_STRING("v1.6.5", module.getVersion());
+    S7XG_CHECK_STRING("S76G", module.getHardware());
+    S7XG_CHECK_EQUAL(868, module.macBand());
+    S7XG_CHECK_EQUAL(commands + 3, sim.commands());
+
+    // The up counter is known once set
+    S7XG_CHECK(module.macUpCounter(5));
+    commands = sim.commands();
+    S7XG_CHECK_EQUAL(5, module.macUpCounter());
+    S7XG_CHECK_EQUAL(commands, sim.commands());
+
+    // Down counters are always read
+    S7XG_CHECK(module.macDownCounter(3));
+    commands = sim.commands();
+    S7XG_CHECK_EQUAL(3, module.macDownCounter());
+    S7XG_CHECK_EQUAL(commands + 1, sim.commands());
+}
+
+static void invalidated() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK(module.getVersion());
+
+    uint32_t commands = sim.commands();
+    module.invalidate();
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_STRING("v1.6.5", module.getVersion());
+    S7XG_CHECK_EQUAL(commands + 2, sim.commands());
+
+    // So does a reset
+    module.reset();
+    commands = sim.commands();
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(commands + 1, sim.commands());
+}
+
+int main() {
+    S7XG_TEST(setters);
+    S7XG_TEST(queued);
+    S7XG_TEST(getters);
+    S7XG_TEST(invalidated);
+    return s7xg_test_result();
+}
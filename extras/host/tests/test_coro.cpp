@@ -0,0 +1,153 @@
+/*
+
+S7XG library
+
+Coroutine API tests: resuming after the module answers, completion and failures
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+#include "S7XGCoro.h"
+
+#define DEVEUI                                "0011223344556677"
+#define APPEUI                                "70B3D57ED0000000"
+#define APPKEY                                "000102030405060708090A0B0C0D0E0F"
+
+typedef struct {
+    uint8_t steps;
+    bool joined;
+    bool configured;
+    bool sent;
+    uint32_t waited;
+} progress_t;
+
+static S7XGTask configure(S7XGSession & session, progress_t & progress) {
+    bool ok = co_await session.macPower(14);
+    ok &= co_await session.macADR(false);
+    progress.configured = ok;
+    progress.steps++;
+}
+
+static S7XGTask provision(S7XGSession & session, progress_t & progress) {
+    progress.steps++;
+    progress.joined = co_await session.macJoinOTAA(DEVEUI, APPEUI, APPKEY);
+    if (!progress.joined) co_return;
+    co_await configure(session, progress);
+    progress.sent = co_await session.macSend("hi", false, 2);
+    progress.steps++;
+}
+
+static S7XGTask timed(S7XGSession & session, progress_t & progress) {
+    uint32_t start = millis();
+    progress.configured = co_await session.macPower(14);
+    progress.waited = millis() - start;
+    progress.steps++;
+}
+
+static S7XGTask refused(S7XGSession & session, progress_t & progress) {
+    progress.sent = co_await session.macSend("hi");
+    s7xg_coro_result_t result = co_await session.call([](S7XG & module) { module.macPower(99); });
+    progress.configured = (S7XG_STATUS_OK == result.status);
+    progress.steps++;
+}
+
+static void completion() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setAirtime(20);
+    sim.setJoinTime(20);
+    module.begin(sim);
+    S7XGExecutor executor;
+    S7XGSession session(module, executor);
+    progress_t progress = {};
+
+    // Spawned coroutines start on the next step and are freed when they finish
+    executor.spawn(provision(session, progress));
+    S7XG_CHECK_EQUAL(0, progress.steps);
+    S7XG_CHECK_EQUAL(1, executor.tasks());
+    executor.run();
+
+    S7XG_CHECK(progress.joined);
+    S7XG_CHECK(progress.configured);
+    S7XG_CHECK(progress.sent);
+    S7XG_CHECK_EQUAL(3, progress.steps);
+    S7XG_CHECK_EQUAL(0, executor.tasks());
+    S7XG_CHECK_EQUAL(0, S7XGTask::frames());
+    S7XG_CHECK_EQUAL(0, session.pending());
+    S7XG_CHECK(module.macJoined());
+    S7XG_CHECK_EQUAL(1, module.macUpCounter());
+}
+
+static void resume() {
+    S7XGSimulator sims[2];
+    S7XG modules[2];
+    S7XGExecutor executor;
+    progress_t progress[2] = {};
+    for (uint8_t i=0; i<2; i++) {
+        sims[i].setLatency(20);
+        modules[i].begin(sims[i]);
+    }
+    S7XGSession first(modules[0], executor);
+    S7XGSession second(modules[1], executor);
+
+    // The coroutines stay suspended until their module answers, and wait at the same time
+    executor.spawn(timed(first, progress[0]));
+    executor.spawn(timed(second, progress[1]));
+    uint32_t start = millis();
+    S7XG_CHECK(executor.step());
+    S7XG_CHECK(executor.step());
+    S7XG_CHECK_EQUAL(0, progress[0].steps + progress[1].steps);
+    S7XG_CHECK_EQUAL(2, first.pending() + second.pending());
+    executor.run();
+    uint32_t elapsed = millis() - start;
+
+    for (uint8_t i=0; i<2; i++) {
+        S7XG_CHECK_EQUAL(1, progress[i].steps);
+        S7XG_CHECK(progress[i].configured);
+        S7XG_CHECK(progress[i].waited >= 15);
+    }
+    S7XG_CHECK(elapsed < 40);
+}
+
+static void failures() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XGExecutor executor;
+    S7XGSession session(module, executor);
+    progress_t progress = {};
+
+    // Errors resume the coroutine too, with the status of the call
+    progress.sent = true;
+    progress.configured = true;
+    executor.spawn(refused(session, progress));
+    executor.run();
+    S7XG_CHECK_EQUAL(1, progress.steps);
+    S7XG_CHECK(!progress.sent);
+    S7XG_CHECK(!progress.configured);
+    S7XG_CHECK_EQUAL(0, S7XGTask::frames());
+}
+
+int main() {
+    S7XG_TEST(completion);
+    S7XG_TEST(resume);
+    S7XG_TEST(failures);
+    return s7xg_test_result();
+}
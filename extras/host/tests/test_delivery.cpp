@@ -0,0 +1,223 @@
+/*
+
+S7XG library
+
+Uplink queue and delivery tests: coalescing, retries, frame counter correlation, timeouts and dropped frames
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+#define DELIVERIES                            8
+
+typedef struct {
+    uint8_t ok;
+    uint8_t failed;
+} results_t;
+
+typedef struct {
+    uint8_t count;
+    s7xg_delivery_t items[DELIVERIES];
+    uint8_t data[DELIVERIES][4];
+} deliveries_t;
+
+static void recorder(bool success, void * arg) {
+    results_t * results = (results_t *) arg;
+    if (success) {
+        results->ok++;
+    } else {
+        results->failed++;
+    }
+}
+
+static void delivered(const s7xg_delivery_t & delivery, void * arg) {
+    deliveries_t * deliveries = (deliveries_t *) arg;
+    if (deliveries->count == DELIVERIES) return;
+    uint8_t index = deliveries->count++;
+    deliveries->items[index] = delivery;
+    if (delivery.data) memcpy(deliveries->data[index], delivery.data, delivery.len < 4 ? delivery.len : 4);
+    deliveries->items[index].data = delivery.data ? deliveries->data[index] : NULL;
+}
+
+static void setup(S7XGSimulator & sim, S7XG & module, results_t & results) {
+    sim.setLatency(1);
+    sim.setAirtime(20);
+    sim.setJoinTime(0);
+    module.begin(sim);
+    module.onTxDone(recorder, &results);
+    module.macJoinABP("26011B1B", "00112233445566770011223344556677", "00112233445566770011223344556677");
+}
+
+static void setup(S7XGSimulator & sim, S7XG & module, results_t & results, deliveries_t & deliveries) {
+    setup(sim, module, results);
+    module.onDelivery(delivered, &deliveries);
+    module.macUpCounter(100);
+}
+
+static void queued() {
+    S7XGSimulator sim;
+    S7XG module;
+    results_t results = {};
+    setup(sim, module, results);
+
+    // A newer coalescing frame for the same port replaces the pending one
+    S7XG_CHECK(module.macQueue((const uint8_t *) "aa", 3, 2, S7XG_PRIORITY_LOW, S7XG_UPLINK_COALESCE));
+    S7XG_CHECK(module.macQueue((const uint8_t *) "bb", 3, 2, S7XG_PRIORITY_LOW, S7XG_UPLINK_COALESCE));
+    S7XG_CHECK(module.macQueue((const uint8_t *) "cc", 3, 3, S7XG_PRIORITY_HIGH));
+    S7XG_CHECK_EQUAL(2, module.macQueued());
+
+    S7XG_CHECK(s7xg_test_until(module, 3000, [&] { return results.ok + results.failed >= 2; }));
+    S7XG_CHECK_EQUAL(2, results.ok);
+    S7XG_CHECK_EQUAL(0, results.failed);
+    S7XG_CHECK_EQUAL(0, module.macQueued());
+    S7XG_CHECK_EQUAL(2, module.macUpCounter());
+}
+
+static void retried() {
+    S7XGSimulator sim;
+    S7XG module;
+    results_t results = {};
+    setup(sim, module, results);
+
+    // A busy module keeps the frame in the queue until it goes out
+    sim.failNext("busy");
+    S7XG_CHECK(module.macQueue((const uint8_t *) "dd", 3, 4));
+    S7XG_CHECK(s7xg_test_until(module, 3000, [&] { return results.ok >= 1; }));
+    S7XG_CHECK_EQUAL(0, results.failed);
+    S7XG_CHECK_EQUAL(0, module.macQueued());
+}
+
+static void acked() {
+    S7XGSimulator sim;
+    S7XG module;
+    results_t results = {};
+    deliveries_t deliveries = {};
+    setup(sim, module, results, deliveries);
+
+    S7XG_CHECK(module.macQueue((const uint8_t *) "aa", 3, 2, S7XG_PRIORITY_NORMAL, S7XG_UPLINK_CONFIRMED));
+    S7XG_CHECK(module.macQueue((const uint8_t *) "bb", 3, 3));
+    S7XG_CHECK(module.macQueue((const uint8_t *) "cc", 3, 4, S7XG_PRIORITY_NORMAL, S7XG_UPLINK_CONFIRMED));
+    S7XG_CHECK(s7xg_test_until(module, 3000, [&] { return deliveries.count >= 2; }));
+
+    // Unconfirmed uplinks are not reported, frame counters follow the module's
+    S7XG_CHECK_EQUAL(2, deliveries.count);
+    S7XG_CHECK_EQUAL(S7XG_DELIVERY_ACKED, deliveries.items[0].status);
+    S7XG_CHECK_EQUAL(100, deliveries.items[0].counter);
+    S7XG_CHECK_EQUAL(2, deliveries.items[0].port);
+    S7XG_CHECK_EQUAL(1, deliveries.items[0].attempts);
+    S7XG_CHECK_EQUAL(3, deliveries.items[0].len);
+    S7XG_CHECK_STRING("aa", (const char *) deliveries.items[0].data);
+    S7XG_CHECK_EQUAL(102, deliveries.items[1].counter);
+    S7XG_CHECK_EQUAL(4, deliveries.items[1].port);
+    S7XG_CHECK(deliveries.items[1].latency_ms < 1000);
+
+    // macSend uplinks are reported too, without the payload
+    S7XG_CHECK(module.macSend("dd", true, 5));
+    S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return deliveries.count >= 3; }));
+    S7XG_CHECK_EQUAL(S7XG_DELIVERY_ACKED, deliveries.items[2].status);
+    S7XG_CHECK_EQUAL(103, deliveries.items[2].counter);
+    S7XG_CHECK(NULL == deliveries.items[2].data);
+
+    const s7xg_link_stats_t & stats = module.getLinkStats();
+    S7XG_CHECK_EQUAL(3, stats.confirmed);
+    S7XG_CHECK_EQUAL(3, stats.acked);
+    S7XG_CHECK_EQUAL(0, module.macInFlight());
+}
+
+static void resent() {
+    S7XGSimulator sim;
+    S7XG module;
+    results_t results = {};
+    deliveries_t deliveries = {};
+    setup(sim, module, results, deliveries);
+    sim.setAckLossRate(100);
+    module.setConfirmPolicy(2);
+
+    // Sent three times, then given up
+    S7XG_CHECK(module.macQueue((const uint8_t *) "ee", 3, 6, S7XG_PRIORITY_NORMAL, S7XG_UPLINK_CONFIRMED));
+    S7XG_CHECK(s7xg_test_until(module, 10000, [&] { return deliveries.count >= 1; }));
+    S7XG_CHECK_EQUAL(S7XG_DELIVERY_NACKED, deliveries.items[0].status);
+    S7XG_CHECK_EQUAL(3, deliveries.items[0].attempts);
+    S7XG_CHECK_EQUAL(102, deliveries.items[0].counter);
+    S7XG_CHECK_EQUAL(0, module.macQueued());
+
+    const s7xg_link_stats_t & stats = module.getLinkStats();
+    S7XG_CHECK_EQUAL(3, stats.confirmed);
+    S7XG_CHECK_EQUAL(3, stats.unacked);
+    S7XG_CHECK_EQUAL(1, stats.abandoned);
+}
+
+static void expired() {
+    S7XGSimulator sim;
+    S7XG module;
+    results_t results = {};
+    deliveries_t deliveries = {};
+    setup(sim, module, results, deliveries);
+
+    // The result comes after the confirm timeout
+    sim.setAirtime(500);
+    module.setConfirmPolicy(0, 100);
+    S7XG_CHECK(module.macSend("ff", true, 7));
+    S7XG_CHECK_EQUAL(1, module.macInFlight());
+    S7XG_CHECK(s7xg_test_until(module, 2000, [&] { return deliveries.count >= 1; }));
+    S7XG_CHECK_EQUAL(S7XG_DELIVERY_TIMEOUT, deliveries.items[0].status);
+    S7XG_CHECK_EQUAL(0, module.macInFlight());
+
+    // The late tx_ok is not taken for another uplink
+    S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return !module.busy(); }));
+    delay(600);
+    module.loop();
+    S7XG_CHECK_EQUAL(1, deliveries.count);
+}
+
+static void dropped() {
+    S7XGSimulator sim;
+    S7XG module;
+    results_t results = {};
+    deliveries_t deliveries = {};
+    setup(sim, module, results, deliveries);
+
+    // A full queue drops its newest lowest priority frame for a more important one, confirmed or not
+    for (uint8_t i=0; i<S7XG_UPLINK_QUEUE_SIZE; i++) {
+        uint8_t payload[3] = { 'a', (uint8_t) ('0' + i), 0 };
+        S7XG_CHECK(module.macQueue(payload, 3, 2, S7XG_PRIORITY_LOW));
+    }
+    S7XG_CHECK(!module.macQueue((const uint8_t *) "xx", 3, 3, S7XG_PRIORITY_LOW));
+    S7XG_CHECK_EQUAL(0, results.failed);
+    S7XG_CHECK(module.macQueue((const uint8_t *) "hh", 3, 4, S7XG_PRIORITY_HIGH));
+    S7XG_CHECK_EQUAL(1, results.failed);
+    S7XG_CHECK_EQUAL(1, deliveries.count);
+    S7XG_CHECK_EQUAL(S7XG_DELIVERY_DROPPED, deliveries.items[0].status);
+    S7XG_CHECK_EQUAL(2, deliveries.items[0].port);
+    S7XG_CHECK_EQUAL(0, deliveries.items[0].attempts);
+    S7XG_CHECK_EQUAL(3, deliveries.items[0].len);
+    char last[3] = { 'a', (char) ('0' + S7XG_UPLINK_QUEUE_SIZE - 1), 0 };
+    S7XG_CHECK_STRING(last, (const char *) deliveries.items[0].data);
+    S7XG_CHECK_EQUAL(1, module.getLinkStats().dropped);
+    S7XG_CHECK_EQUAL(S7XG_UPLINK_QUEUE_SIZE, module.macQueued());
+}
+
+int main() {
+    S7XG_TEST(queued);
+    S7XG_TEST(retried);
+    S7XG_TEST(acked);
+    S7XG_TEST(resent);
+    S7XG_TEST(expired);
+    S7XG_TEST(dropped);
+    return s7xg_test_result();
+}
@@ -0,0 +1,142 @@
+/*
+
+S7XG library
+
+Join manager tests: background OTAA join, backoff, giving up and saved sessions
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+// Every join waits a random delay of up to S7XG_JOIN_BACKOFF before the first request
+static const char DEVEUI[] = "0011223344556677";
+static const char APPEUI[] = "70B3D57ED0000000";
+static const char APPKEY[] = "000102030405060708090A0B0C0D0E0F";
+
+typedef struct {
+    uint8_t accepted;
+    uint8_t rejected;
+} joins_t;
+
+static void counter(bool success, void * arg) {
+    joins_t * joins = (joins_t *) arg;
+    if (success) {
+        joins->accepted++;
+    } else {
+        joins->rejected++;
+    }
+}
+
+static bool settled(S7XG & module, uint32_t timeout) {
+    return s7xg_test_until(module, timeout, [&] { return module.macJoinState() >= S7XG_JOIN_JOINED; });
+}
+
+static void accepted() {
+    S7XGSimulator sim;
+    S7XG module;
+    joins_t joins = { 0, 0 };
+    sim.setLatency(1);
+    sim.setJoinTime(50);
+    module.begin(sim);
+    module.onJoin(counter, &joins);
+
+    S7XG_CHECK(!module.macAutoJoin(NULL, APPEUI, APPKEY));
+    S7XG_CHECK(module.macAutoJoin(DEVEUI, APPEUI, APPKEY));
+    S7XG_CHECK(module.macJoinState() != S7XG_JOIN_IDLE);
+    S7XG_CHECK(module.macJoinNext() < S7XG_JOIN_BACKOFF);
+    S7XG_CHECK(settled(module, S7XG_JOIN_BACKOFF + 1000));
+    S7XG_CHECK_EQUAL(S7XG_JOIN_JOINED, module.macJoinState());
+    S7XG_CHECK_EQUAL(1, module.macJoinAttempts());
+    S7XG_CHECK_EQUAL(1, joins.accepted);
+    S7XG_CHECK(module.macJoined());
+
+    // The session was saved, the next boot does not join again
+    S7XG next;
+    next.begin(sim);
+    next.onJoin(counter, &joins);
+    S7XG_CHECK(next.macAutoJoin(DEVEUI, APPEUI, APPKEY));
+    S7XG_CHECK(settled(next, 1000));
+    S7XG_CHECK_EQUAL(S7XG_JOIN_JOINED, next.macJoinState());
+    S7XG_CHECK_EQUAL(0, next.macJoinAttempts());
+    S7XG_CHECK_EQUAL(2, joins.accepted);
+}
+
+static void unsaved() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setJoinTime(50);
+    module.begin(sim);
+    S7XG_CHECK(module.macAutoJoin(DEVEUI, APPEUI, APPKEY, false));
+    S7XG_CHECK(settled(module, S7XG_JOIN_BACKOFF + 1000));
+    S7XG_CHECK_EQUAL(S7XG_JOIN_JOINED, module.macJoinState());
+
+    // A reset forgets the session
+    module.reset();
+    S7XG_CHECK(!module.macJoined());
+}
+
+static void rejected() {
+    S7XGSimulator sim;
+    S7XG module;
+    joins_t joins = { 0, 0 };
+    sim.setLatency(1);
+    sim.setJoinTime(50);
+    sim.setJoinFailRate(100);
+    module.begin(sim);
+    module.onJoin(counter, &joins);
+
+    S7XG_CHECK(module.macAutoJoin(DEVEUI, APPEUI, APPKEY, true, 2));
+    S7XG_CHECK(s7xg_test_until(module, S7XG_JOIN_BACKOFF + 1000, [&] { return joins.rejected > 0; }));
+
+    // Backing off between half and all of S7XG_JOIN_BACKOFF
+    S7XG_CHECK_EQUAL(S7XG_JOIN_WAITING, module.macJoinState());
+    S7XG_CHECK_EQUAL(1, module.macJoinAttempts());
+    S7XG_CHECK(module.macJoinNext() > S7XG_JOIN_BACKOFF / 2 - 100);
+    S7XG_CHECK(module.macJoinNext() <= S7XG_JOIN_BACKOFF);
+
+    // Gives up after the second request
+    S7XG_CHECK(settled(module, S7XG_JOIN_BACKOFF + 1000));
+    S7XG_CHECK_EQUAL(S7XG_JOIN_FAILED, module.macJoinState());
+    S7XG_CHECK_EQUAL(2, module.macJoinAttempts());
+    S7XG_CHECK_EQUAL(2, joins.rejected);
+    S7XG_CHECK_EQUAL(0, joins.accepted);
+    S7XG_CHECK(!module.macJoined());
+}
+
+static void concurrent() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XG_CHECK(module.macAutoJoin(DEVEUI, APPEUI, APPKEY, true, 1));
+
+    // Everything else keeps working while joining
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK(module.macDatarate(3));
+    S7XG_CHECK(settled(module, S7XG_JOIN_BACKOFF + 5000));
+    S7XG_CHECK_EQUAL(S7XG_JOIN_JOINED, module.macJoinState());
+}
+
+int main() {
+    S7XG_TEST(accepted);
+    S7XG_TEST(unsaved);
+    S7XG_TEST(rejected);
+    S7XG_TEST(concurrent);
+    return s7xg_test_result();
+}
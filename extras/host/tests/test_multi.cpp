@@ -0,0 +1,157 @@
+/*
+
+S7XG library
+
+Multi-module tests: round-robin turns, fairness and serving while blocked
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+#include "S7XGMulti.h"
+
+#define MODULES                               3
+
+typedef struct {
+    uint8_t count;
+    uint8_t order[16];
+} completions_t;
+
+typedef struct {
+    completions_t * completions;
+    uint8_t index;
+} tag_t;
+
+static void completed(uint8_t status, char * response, void * arg) {
+    (void) response;
+    tag_t * tag = (tag_t *) arg;
+    if (S7XG_STATUS_OK != status) return;
+    completions_t * completions = tag->completions;
+    if (completions->count < sizeof(completions->order)) completions->order[completions->count++] = tag->index;
+}
+
+static void rotation() {
+    S7XGSimulator sims[MODULES];
+    S7XG modules[MODULES];
+    S7XGMulti multi;
+    completions_t completions = {};
+    tag_t tags[MODULES];
+    for (uint8_t i=0; i<MODULES; i++) {
+        sims[i].setLatency(0);
+        modules[i].begin(sims[i]);
+        S7XG_CHECK(multi.add(modules[i]));
+        tags[i] = { &completions, i };
+    }
+    S7XG_CHECK_EQUAL(MODULES, multi.count());
+    S7XG_CHECK(!multi.add(modules[0]));
+
+    // Every pass gives each module a turn, the one served first moves on
+    for (uint8_t pass=0; pass<MODULES; pass++) {
+        for (uint8_t i=0; i<MODULES; i++) modules[i].async(completed, &tags[i])->macUpCounter(pass + 1);
+        while (multi.busy() && (completions.count < (pass + 1) * MODULES)) {
+            delay(2);
+            multi.loop();
+        }
+    }
+    S7XG_CHECK_EQUAL(MODULES * MODULES, completions.count);
+    for (uint8_t pass=1; pass<MODULES; pass++) {
+        S7XG_CHECK(completions.order[pass * MODULES] != completions.order[(pass - 1) * MODULES]);
+    }
+    for (uint8_t i=0; i<MODULES; i++) S7XG_CHECK_EQUAL(multi.turns(0), multi.turns(i));
+}
+
+static void fairness() {
+    S7XGSimulator sims[2];
+    S7XG modules[2];
+    S7XGMulti multi;
+    completions_t completions = {};
+    tag_t tags[2] = { { &completions, 0 }, { &completions, 1 } };
+    for (uint8_t i=0; i<2; i++) {
+        sims[i].setLatency(0);
+        modules[i].begin(sims[i]);
+        multi.add(modules[i]);
+    }
+
+    // A long queue on the first module does not hold back the second one
+    for (uint8_t i=0; i<4; i++) modules[0].async(completed, &tags[0])->macUpCounter(i + 1);
+    modules[1].async(completed, &tags[1])->macPower(14);
+    uint8_t passes = 0;
+    while (multi.busy() && (passes < 100)) {
+        uint8_t before = completions.count;
+        delay(2);
+        multi.loop();
+        passes++;
+        S7XG_CHECK(completions.count - before <= 2);
+    }
+    S7XG_CHECK_EQUAL(5, completions.count);
+    uint8_t second = 0;
+    while (1 != completions.order[second]) second++;
+    S7XG_CHECK(second <= 1);
+}
+
+static void blocking() {
+    S7XGSimulator sims[2];
+    S7XG modules[2];
+    S7XGMulti multi;
+    completions_t completions = {};
+    tag_t tag = { &completions, 1 };
+    for (uint8_t i=0; i<2; i++) {
+        sims[i].setLatency(20);
+        modules[i].begin(sims[i]);
+        multi.add(modules[i]);
+    }
+
+    // The second module answers while the first one blocks
+    modules[1].async(completed, &tag)->macPower(14);
+    uint32_t start = millis();
+    S7XG_CHECK(modules[0].macPower(14));
+    S7XG_CHECK(millis() - start < 40);
+    S7XG_CHECK_EQUAL(1, completions.count);
+    S7XG_CHECK_EQUAL(0, multi.turns(0));
+    S7XG_CHECK(multi.turns(1) > 0);
+    S7XG_CHECK(multi.wait(1000));
+}
+
+static void removed() {
+    S7XGSimulator sim;
+    S7XGMulti multi;
+    S7XG first;
+    first.begin(sim);
+    S7XG_CHECK(multi.add(first));
+    {
+        S7XG second;
+        second.begin(sim);
+        S7XG_CHECK(multi.add(second));
+        S7XG_CHECK_EQUAL(2, multi.count());
+    }
+
+    // A module leaves its manager when it is destroyed
+    S7XG_CHECK_EQUAL(1, multi.count());
+    S7XG_CHECK(&first == multi.get(0));
+    S7XG_CHECK(NULL == multi.get(1));
+    S7XG_CHECK(multi.remove(first));
+    S7XG_CHECK(!multi.remove(first));
+    S7XG_CHECK_EQUAL(0, multi.count());
+}
+
+int main() {
+    S7XG_TEST(rotation);
+    S7XG_TEST(fairness);
+    S7XG_TEST(blocking);
+    S7XG_TEST(removed);
+    return s7xg_test_result();
+}
@@ -0,0 +1,142 @@
+/*
+
+S7XG library
+
+NMEA parser tests: sentences, checksums and the NMEA output of the simulator
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+// Feeds a sentence body with its checksum, returns the result of the last character
+static uint8_t sentence(S7XGNmea & nmea, const char * body, bool corrupt = false) {
+    uint8_t checksum = 0;
+    for (const char * p = body; *p; p++) checksum ^= *p;
+    if (corrupt) checksum ^= 0x01;
+    char line[128];
+    snprintf(line, sizeof(line), "$%s*%02X\r\n", body, checksum);
+    uint8_t result = S7XG_NMEA_NONE;
+    for (const char * p = line; *p; p++) {
+        uint8_t type = nmea.feed(*p);
+        if (S7XG_NMEA_NONE != type) result = type;
+    }
+    return result;
+}
+
+static void rmc() {
+    S7XGNmea nmea;
+    S7XG_CHECK_EQUAL(S7XG_NMEA_RMC, sentence(nmea, "GPRMC,123334.00,A,4136.07290,N,00237.34910,E,0.50,54.70,020919,,,A"));
+    const gps_fix_t & fix = nmea.fix();
+    S7XG_CHECK(fix.valid & S7XG_NMEA_VALID_TIME);
+    S7XG_CHECK(fix.valid & S7XG_NMEA_VALID_DATE);
+    S7XG_CHECK(fix.valid & S7XG_NMEA_VALID_POSITION);
+    S7XG_CHECK_EQUAL(41601215, fix.latitude_e6);
+    S7XG_CHECK_EQUAL(2622485, fix.longitude_e6);
+    S7XG_CHECK_EQUAL(5470, fix.course_cdeg);
+    S7XG_CHECK_EQUAL(2019, fix.year);
+    S7XG_CHECK_EQUAL(9, fix.month);
+    S7XG_CHECK_EQUAL(2, fix.day);
+    S7XG_CHECK_EQUAL(12, fix.hour);
+    S7XG_CHECK_EQUAL(33, fix.minute);
+    S7XG_CHECK_EQUAL(34, fix.second);
+    S7XG_CHECK_EQUAL(1, nmea.sentences());
+}
+
+static void hemispheres() {
+    S7XGNmea nmea;
+    S7XG_CHECK_EQUAL(S7XG_NMEA_RMC, sentence(nmea, "GNRMC,010203.00,A,3352.12800,S,15112.54600,W,0.00,0.00,311220,,,A"));
+    S7XG_CHECK_EQUAL(-33868800, nmea.fix().latitude_e6);
+    S7XG_CHECK_EQUAL(-151209100, nmea.fix().longitude_e6);
+    S7XG_CHECK_EQUAL(2020, nmea.fix().year);
+    S7XG_CHECK_EQUAL(31, nmea.fix().day);
+}
+
+static void gga() {
+    S7XGNmea nmea;
+    S7XG_CHECK_EQUAL(S7XG_NMEA_GGA, sentence(nmea, "GPGGA,123334.00,4136.07290,N,00237.34910,E,1,04,1.20,123.4,M,49.8,M,,"));
+    const gps_fix_t & fix = nmea.fix();
+    S7XG_CHECK(fix.valid & S7XG_NMEA_VALID_ALTITUDE);
+    S7XG_CHECK_EQUAL(12340, fix.altitude_cm);
+    S7XG_CHECK_EQUAL(1, fix.quality);
+    S7XG_CHECK_EQUAL(4, fix.satellites_used);
+    S7XG_CHECK_EQUAL(120, fix.hdop);
+}
+
+static void gsa() {
+    S7XGNmea nmea;
+    S7XG_CHECK_EQUAL(S7XG_NMEA_GSA, sentence(nmea, "GPGSA,A,3,05,13,15,24,,,,,,,,,2.10,1.20,1.70"));
+    S7XG_CHECK_EQUAL(3, nmea.fix().fix_type);
+    S7XG_CHECK_EQUAL(210, nmea.fix().pdop);
+    S7XG_CHECK_EQUAL(170, nmea.fix().vdop);
+}
+
+static void errors() {
+    S7XGNmea nmea;
+
+    // Bad checksums never publish
+    S7XG_CHECK_EQUAL(S7XG_NMEA_ERROR, sentence(nmea, "GPRMC,123334.00,A,4136.07290,N,00237.34910,E,0.50,54.70,020919,,,A", true));
+    S7XG_CHECK_EQUAL(0, nmea.fix().valid);
+    S7XG_CHECK_EQUAL(1, nmea.errors());
+
+    // A sentence cut by another one
+    const char * cut = "$GPGGA,123334.00,4136.07";
+    for (const char * p = cut; *p; p++) nmea.feed(*p);
+    S7XG_CHECK_EQUAL(S7XG_NMEA_RMC, sentence(nmea, "GPRMC,,V,,,,,,,,,,N"));
+    S7XG_CHECK_EQUAL(2, nmea.errors());
+    S7XG_CHECK(0 == (nmea.fix().valid & S7XG_NMEA_VALID_POSITION));
+
+    S7XG_CHECK_EQUAL(S7XG_NMEA_OTHER, sentence(nmea, "GPVTG,54.70,T,,M,0.50,N,0.93,K,A"));
+
+    nmea.reset();
+    S7XG_CHECK_EQUAL(0, nmea.errors());
+    S7XG_CHECK_EQUAL(0, nmea.sentences());
+}
+
+static void simulator() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setTTFF(0);
+    sim.addFix({ 2019, 9, 2, 12, 33, 34, 41601215, 2622485, 36 });
+    module.begin(sim);
+
+    struct { uint32_t count; gps_fix_t fix; } result = { 0, {} };
+    module.onGpsFix([](const gps_fix_t & fix, void * arg) {
+        ((decltype(result) *) arg)->count++;
+        ((decltype(result) *) arg)->fix = fix;
+    }, &result);
+
+    S7XG_CHECK(module.gpsInit());
+    S7XG_CHECK(module.gpsNmea("rmc gga"));
+    S7XG_CHECK(module.gpsMode(S7XG_GPS_MODE_MANUAL));
+    S7XG_CHECK(s7xg_test_until(module, 3000, [&] { return result.count > 0; }));
+    S7XG_CHECK(result.fix.valid & S7XG_NMEA_VALID_POSITION);
+    S7XG_CHECK_EQUAL(41601215, result.fix.latitude_e6);
+    S7XG_CHECK_EQUAL(2622485, result.fix.longitude_e6);
+    S7XG_CHECK_EQUAL(0, module.getLinkStats().nmea_errors);
+}
+
+int main() {
+    S7XG_TEST(rmc);
+    S7XG_TEST(hemispheres);
+    S7XG_TEST(gga);
+    S7XG_TEST(gsa);
+    S7XG_TEST(errors);
+    S7XG_TEST(simulator);
+    return s7xg_test_result();
+}
@@ -0,0 +1,331 @@
+/*
+
+S7XG library
+
+Simulator tests: the library against S7XGSimulator, command by command
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+static const char DEVADDR[] = "26011B1B";
+static const char KEY[] = "00112233445566770011223344556677";
+
+static void info() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XG_CHECK_STRING("v1.6.5", module.getVersion());
+    S7XG_CHECK_STRING("S76G", module.getHardware());
+    S7XG_CHECK_EQUAL(868, module.macBand());
+    S7XG_CHECK(sim.commands() > 0);
+}
+
+static void setters() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(S7XG_STATUS_OK, module.getStatus());
+    S7XG_CHECK(!module.macPower(3));
+    S7XG_CHECK_EQUAL(S7XG_STATUS_ERROR, module.getStatus());
+    S7XG_CHECK(!module.macDatarate(9));
+    S7XG_CHECK(module.macClass(S7XG_MAC_CLASS_C));
+    S7XG_CHECK(!module.macClass('B'));
+}
+
+static void errors() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+
+    sim.failNext("busy");
+    S7XG_CHECK(!module.macDatarate(3));
+    S7XG_CHECK(module.macDatarate(3));
+
+    // Same seed, same answers
+    bool first[20];
+    bool second[20];
+    for (uint8_t run=0; run<2; run++) {
+        S7XGSimulator noisy;
+        S7XG other;
+        noisy.setLatency(1);
+        other.begin(noisy);
+        noisy.seed(42);
+        noisy.setErrorRate(50);
+        for (uint8_t i=0; i<20; i++) (run ? second : first)[i] = other.macUpCounter(i + 1);
+    }
+    uint8_t failed = 0;
+    for (uint8_t i=0; i<20; i++) {
+        S7XG_CHECK_EQUAL(first[i], second[i]);
+        if (!first[i]) failed++;
+    }
+    S7XG_CHECK(failed > 0);
+    S7XG_CHECK(failed < 20);
+}
+
+static void latency() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    sim.setLatency(30);
+    uint32_t start = millis();
+    S7XG_CHECK(module.macUpCounter(5));
+    S7XG_CHECK(millis() - start >= 30);
+    S7XG_CHECK_EQUAL(5, module.macUpCounter());
+}
+
+static void uplinks() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setAirtime(20);
+    module.begin(sim);
+
+    S7XG_CHECK(!module.macSend("hi"));
+    S7XG_CHECK(module.macJoinABP(DEVADDR, KEY, KEY));
+    S7XG_CHECK(module.macJoined());
+
+    struct { bool done; bool success; uint8_t port; uint8_t len; uint8_t data[4]; } result = { false, false, 0, 0, { 0 } };
+    module.onTxDone([](bool success, void * arg) {
+        ((decltype(result) *) arg)->done = true;
+        ((decltype(result) *) arg)->success = success;
+    }, &result);
+    module.onDownlink([](uint8_t port, uint8_t * data, uint8_t len, void * arg) {
+        decltype(result) * r = (decltype(result) *) arg;
+        r->port = port;
+        r->len = len;
+        memcpy(r->data, data, len < 4 ? len : 4);
+    }, &result);
+
+    S7XG_CHECK(module.macSend("hi", false, 2));
+    S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return result.done; }));
+    S7XG_CHECK(result.success);
+    S7XG_CHECK_EQUAL(1, module.macUpCounter());
+
+    result.done = false;
+    sim.setDownlink(10, "CAFE");
+    S7XG_CHECK(module.macSend("hi", true, 2));
+    S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return result.done; }));
+    S7XG_CHECK_EQUAL(10, result.port);
+    S7XG_CHECK_EQUAL(2, result.len);
+    S7XG_CHECK_EQUAL(0xCA, result.data[0]);
+    S7XG_CHECK_EQUAL(0xFE, result.data[1]);
+}
+
+static void answers() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setAirtime(200);
+    module.begin(sim);
+    S7XG_CHECK(module.macJoinABP(DEVADDR, KEY, KEY));
+
+    struct { uint8_t ok; uint8_t error; } results = { 0, 0 };
+    module.onTxDone([](bool success, void * arg) {
+        (success ? ((decltype(results) *) arg)->ok : ((decltype(results) *) arg)->error)++;
+    }, &results);
+
+    // An "err" answer while an uplink result is expected belongs to the command
+    S7XG_CHECK(module.macSend("hi", false, 2));
+    sim.failNext("err");
+    uint32_t start = millis();
+    S7XG_CHECK(!module.macPower(20));
+    S7XG_CHECK_STRING("err", module.getResponse());
+    S7XG_CHECK(millis() - start < 100);
+    S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return results.ok > 0; }));
+    S7XG_CHECK_EQUAL(0, results.error);
+}
+
+static void late() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XG_CHECK(module.macDownCounter(5));
+
+    // The answer comes after the timeout but before the one of the next command, which must not take it
+    uint16_t timeout = module.getTimeout(S7XG_KIND_MAC_SET, false);
+    sim.setLatency(timeout / 2);
+    sim.failNext(NULL);
+    sim.inject("Ok", timeout + 50);
+    S7XG_CHECK(!module.macPower(14));
+    S7XG_CHECK_EQUAL(S7XG_STATUS_TIMEOUT, module.getStatus());
+    S7XG_CHECK_EQUAL(5, module.macDownCounter());
+    S7XG_CHECK_EQUAL(S7XG_STATUS_OK, module.getStatus());
+
+    // An answer that never comes only holds the next command for another timeout
+    sim.failNext(NULL);
+    S7XG_CHECK(!module.macDownCounter(6));
+    S7XG_CHECK(module.macDownCounter(7));
+    S7XG_CHECK_EQUAL(7, module.macDownCounter());
+}
+
+static void gps() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setTTFF(0);
+    sim.addFix({ 2019, 9, 2, 12, 33, 34, 41601215, 2622485, 36 });
+    module.begin(sim);
+
+    gps_message_t message = module.gpsData();
+    S7XG_CHECK_EQUAL(S7XG_GPS_STATUS_NOT_INIT, message.status);
+
+    S7XG_CHECK(module.gpsInit());
+    S7XG_CHECK(module.gpsMode(S7XG_GPS_MODE_MANUAL));
+    message = module.gpsData();
+    S7XG_CHECK_EQUAL(S7XG_GPS_STATUS_OK, message.status);
+    S7XG_CHECK(message.valid & S7XG_GPS_VALID_POSITION);
+    S7XG_CHECK_EQUAL(41601215, message.latitude_e6);
+    S7XG_CHECK_EQUAL(2622485, message.longitude_e6);
+    S7XG_CHECK_EQUAL(2019, message.year);
+    S7XG_CHECK_EQUAL(34, message.second);
+}
+
+static void cached(uint8_t status, char * response, void * arg) {
+    (void) status;
+    (void) response;
+    ((S7XG *) arg)->async(NULL)->macPower(14);
+}
+
+static void pipelined() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XG_CHECK(module.macPower(14));
+
+    // The callback queues the cached setter right behind the blocking call, which keeps its own answer
+    S7XG_CHECK(module.async(cached, &module)->macUpCounter(5));
+    S7XG_CHECK_STRING("v1.6.5", module.getVersion());
+    S7XG_CHECK_EQUAL(S7XG_STATUS_OK, module.getStatus());
+    S7XG_CHECK(module.async(cached, &module)->macUpCounter(6));
+    S7XG_CHECK(!module.macPower(3));
+    S7XG_CHECK_EQUAL(S7XG_STATUS_ERROR, module.getStatus());
+    S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return !module.busy(); }));
+}
+
+static void keys() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+
+    // All six values in one command
+    uint32_t commands = sim.commands();
+    S7XG_CHECK(module.macKeys("0011223344556677", "70B3D57ED0000000", KEY, DEVADDR, KEY, KEY));
+    S7XG_CHECK_EQUAL(commands + 1, sim.commands());
+
+    // Joins only set their own keys
+    commands = sim.commands();
+    S7XG_CHECK(module.macJoinABP(DEVADDR, KEY, KEY));
+    S7XG_CHECK_EQUAL(commands + 4, sim.commands());
+    commands = sim.commands();
+    S7XG_CHECK(module.macKeys(NULL, "70B3D57ED0000000", KEY, DEVADDR, KEY, KEY));
+    S7XG_CHECK_EQUAL(commands + 5, sim.commands());
+
+    // A busy module does not tell if set_keys is supported, an unknown command does
+    S7XG other;
+    other.begin(sim);
+    sim.failNext("busy");
+    commands = sim.commands();
+    S7XG_CHECK(other.macKeys("0011223344556677", "70B3D57ED0000000", KEY, DEVADDR, KEY, KEY));
+    S7XG_CHECK_EQUAL(commands + 7, sim.commands());
+    sim.failNext("Invalid");
+    commands = sim.commands();
+    S7XG_CHECK(other.macKeys("0011223344556677", "70B3D57ED0000000", KEY, DEVADDR, KEY, KEY));
+    S7XG_CHECK_EQUAL(commands + 7, sim.commands());
+    commands = sim.commands();
+    S7XG_CHECK(other.macKeys("0011223344556677", "70B3D57ED0000000", KEY, DEVADDR, KEY, KEY));
+    S7XG_CHECK_EQUAL(commands + 6, sim.commands());
+}
+
+static void settings() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+
+    s7xg_settings_t settings = S7XG_SETTINGS_KEEP;
+    settings.gps_mode = S7XG_GPS_MODE_AUTO + 1;
+    uint32_t commands = sim.commands();
+    S7XG_CHECK(!module.configure(settings));
+    S7XG_CHECK(module.configure(S7XG_SETTINGS_KEEP));
+    S7XG_CHECK_EQUAL(commands, sim.commands());
+
+    settings.gps_mode = S7XG_KEEP;
+    settings.power = 20;
+    settings.devaddr = DEVADDR;
+    settings.nwkskey = KEY;
+    settings.appskey = KEY;
+    settings.save = true;
+    S7XG_CHECK(module.configure(settings));
+    S7XG_CHECK(module.macJoined());
+    commands = sim.commands();
+    S7XG_CHECK(module.configure(settings));
+    S7XG_CHECK_EQUAL(commands, sim.commands());
+
+    // After a reboot the hash in the module storage tells the flash is up to date, only the session is checked
+    S7XG next;
+    next.begin(sim);
+    commands = sim.commands();
+    S7XG_CHECK(next.configure(settings));
+    S7XG_CHECK_EQUAL(commands + 2, sim.commands());
+
+    // Different settings are read back and written
+    settings.power = 14;
+    commands = sim.commands();
+    S7XG_CHECK(next.configure(settings));
+    S7XG_CHECK(sim.commands() > commands + 2);
+    next.invalidate();
+    commands = sim.commands();
+    S7XG_CHECK(next.configure(settings));
+    S7XG_CHECK_EQUAL(commands + 2, sim.commands());
+}
+
+static void sleeping() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    S7XG_CHECK(!module.sleep(5));
+    S7XG_CHECK(module.sleep(10));
+    S7XG_CHECK(module.wake());
+    S7XG_CHECK(module.macPower(14));
+}
+
+int main() {
+    S7XG_TEST(info);
+    S7XG_TEST(setters);
+    S7XG_TEST(errors);
+    S7XG_TEST(latency);
+    S7XG_TEST(uplinks);
+    S7XG_TEST(answers);
+    S7XG_TEST(late);
+    S7XG_TEST(gps);
+    S7XG_TEST(pipelined);
+    S7XG_TEST(keys);
+    S7XG_TEST(settings);
+    S7XG_TEST(sleeping);
+    return s7xg_test_result();
+}
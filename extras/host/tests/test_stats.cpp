@@ -0,0 +1,111 @@
+/*
+
+S7XG library
+
+Statistics tests: counters and latency histograms per kind of command, link counters
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+static void buckets() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    module.resetStats();
+
+    // Round-trips between 16 and 32 ms
+    sim.setLatency(20);
+    for (uint8_t i=0; i<4; i++) S7XG_CHECK(module.macUpCounter(i + 1));
+    const s7xg_stats_t & stats = module.getStats(S7XG_KIND_MAC_SET);
+    S7XG_CHECK_EQUAL(4, stats.count);
+    S7XG_CHECK_EQUAL(4, stats.buckets[5]);
+    S7XG_CHECK(stats.min_us >= 16000);
+    S7XG_CHECK(stats.max_us < 32000);
+    S7XG_CHECK_EQUAL(32, module.getLatencyPercentile(S7XG_KIND_MAC_SET, 50));
+
+    // One faster than 2 ms, the median stays
+    sim.setLatency(0);
+    S7XG_CHECK(module.macUpCounter(10));
+    S7XG_CHECK_EQUAL(1, stats.buckets[0] + stats.buckets[1]);
+    S7XG_CHECK_EQUAL(32, module.getLatencyPercentile(S7XG_KIND_MAC_SET, 50));
+    S7XG_CHECK(module.getLatencyPercentile(S7XG_KIND_MAC_SET, 10) <= 2);
+
+    // Other kinds are counted apart
+    S7XG_CHECK_EQUAL(10, module.macUpCounter());
+    S7XG_CHECK_EQUAL(0, module.getStats(S7XG_KIND_GPS).count);
+    S7XG_CHECK_EQUAL(0, module.getLatencyPercentile(S7XG_KIND_GPS, 50));
+    S7XG_CHECK_EQUAL(0, module.getStats(S7XG_KIND_COUNT).count);
+}
+
+static void outcomes() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    module.resetStats();
+    const s7xg_stats_t & stats = module.getStats(S7XG_KIND_MAC_SET);
+
+    // Answered from the cache, not part of the histogram
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(2, stats.count);
+    S7XG_CHECK_EQUAL(1, stats.cached);
+
+    // Errors are, timeouts are not
+    sim.failNext("busy");
+    S7XG_CHECK(!module.macPower(20));
+    sim.failNext(NULL);
+    S7XG_CHECK(!module.macPower(20));
+    S7XG_CHECK_EQUAL(4, stats.count);
+    S7XG_CHECK_EQUAL(1, stats.errors);
+    S7XG_CHECK_EQUAL(1, stats.timeouts);
+    uint32_t samples = 0;
+    for (uint8_t i=0; i<S7XG_STATS_BUCKETS; i++) samples += stats.buckets[i];
+    S7XG_CHECK_EQUAL(2, samples);
+
+    module.resetStats();
+    S7XG_CHECK_EQUAL(0, stats.count);
+}
+
+static void link() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+    module.resetStats();
+
+    S7XG_CHECK(module.macPower(14));
+    const s7xg_link_stats_t & link = module.getLinkStats();
+    S7XG_CHECK_EQUAL(sim.bytesReceived(), link.bytes_sent);
+    S7XG_CHECK_EQUAL(sim.bytesSent(), link.bytes_received);
+
+    // Lines that are neither an answer nor an event
+    sim.inject("garbage");
+    S7XG_CHECK(s7xg_test_until(module, 100, [&] { return link.lines_discarded > 0; }));
+    S7XG_CHECK_EQUAL(1, link.lines_discarded);
+    S7XG_CHECK_EQUAL(0, link.events);
+}
+
+int main() {
+    S7XG_TEST(buckets);
+    S7XG_TEST(outcomes);
+    S7XG_TEST(link);
+    return s7xg_test_result();
+}
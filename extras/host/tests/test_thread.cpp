@@ -0,0 +1,125 @@
+/*
+
+S7XG library
+
+Threaded backend tests: concurrent calls, posted requests and channels that do not collect their replies
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+#include "S7XGThread.h"
+
+// Checks are not thread safe, the application threads only count
+#define THREADS                               4
+#define CALLS                                 200
+
+static bool counter(S7XG & module, void * arg) {
+    uint32_t value = (uint32_t) (uintptr_t) arg;
+    return module.macUpCounter(value) && (module.macUpCounter() == value);
+}
+
+static bool power(S7XG & module, void * arg) {
+    (void) arg;
+    return module.macPower(14);
+}
+
+static void concurrent() {
+    S7XGSimulator sim;
+    S7XG module;
+    S7XGThread worker;
+    sim.setLatency(0);
+    module.begin(sim);
+    S7XG_CHECK(worker.begin(module));
+
+    std::atomic<uint32_t> failed{0};
+    std::thread threads[THREADS];
+    for (uint8_t t=0; t<THREADS; t++) {
+        threads[t] = std::thread([&worker, &failed, t] {
+            int8_t channel = worker.attach();
+            if (channel < 0) {
+                failed++;
+                return;
+            }
+            for (uint32_t i=0; i<CALLS; i++) {
+                s7xg_thread_reply_t reply;
+                uintptr_t value = t * 1000 + i + 1;
+                if (!worker.call(channel, counter, (void *) value, &reply)) failed++;
+                if (S7XG_STATUS_OK != reply.status) failed++;
+            }
+        });
+    }
+    for (uint8_t t=0; t<THREADS; t++) threads[t].join();
+    worker.end();
+
+    S7XG_CHECK_EQUAL(0, failed.load());
+    S7XG_CHECK_EQUAL(0, worker.eventsDropped());
+    S7XG_CHECK(!worker.running());
+}
+
+static void posted() {
+    S7XGSimulator sim;
+    S7XG module;
+    S7XGThread worker;
+    sim.setLatency(0);
+    module.begin(sim);
+    S7XG_CHECK(worker.begin(module));
+    int8_t lazy = worker.attach();
+    int8_t busy = worker.attach();
+
+    // More requests than the replies ring holds, nobody collects them
+    uint16_t ids[S7XG_THREAD_QUEUE_SIZE * 2];
+    uint8_t count = 0;
+    for (uint8_t i=0; i<S7XG_THREAD_QUEUE_SIZE * 2; i++) {
+        uint16_t id = worker.post(lazy, power);
+        if (0 == id) {
+            delay(20);
+            id = worker.post(lazy, power);
+        }
+        if (id) ids[count++] = id;
+    }
+    S7XG_CHECK(count > S7XG_THREAD_QUEUE_SIZE);
+
+    // The replies of the posted requests would come first
+    S7XG_CHECK(!worker.call(lazy, power));
+
+    // The other channels keep being served
+    for (uint8_t i=0; i<10; i++) S7XG_CHECK(worker.call(busy, power));
+
+    // Every reply comes back, in order
+    s7xg_thread_reply_t reply;
+    uint8_t received = 0;
+    uint32_t start = millis();
+    while ((received < count) && (millis() - start < 2000)) {
+        if (worker.poll(lazy, reply)) {
+            S7XG_CHECK_EQUAL(ids[received], reply.id);
+            S7XG_CHECK(reply.result);
+            received++;
+        } else {
+            delay(1);
+        }
+    }
+    S7XG_CHECK_EQUAL(count, received);
+    S7XG_CHECK(worker.call(lazy, power));
+    worker.end();
+}
+
+int main() {
+    S7XG_TEST(concurrent);
+    S7XG_TEST(posted);
+    return s7xg_test_result();
+}
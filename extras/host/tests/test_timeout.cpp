@@ -0,0 +1,118 @@
+/*
+
+S7XG library
+
+Adaptive timeout tests: first sample, floor and ceiling, backoff after a timeout
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+
+static void initial() {
+    S7XGSimulator sim;
+    S7XG module;
+    module.begin(sim);
+    S7XG_CHECK_EQUAL(S7XG_TIMEOUT_INITIAL, module.getTimeout(S7XG_KIND_MAC_SET));
+    S7XG_CHECK_EQUAL(S7XG_TIMEOUT_CEILING, module.getTimeout(S7XG_KIND_MAC_SET, true));
+    S7XG_CHECK_EQUAL(S7XG_TIMEOUT_CEILING, module.getTimeout(S7XG_KIND_COUNT));
+}
+
+static void sampled() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(20);
+    module.begin(sim);
+    module.setTimeouts(10, 1000);
+
+    // The first answer sets the estimation and half of it as the deviation: 20 + 4 * 10 ms
+    S7XG_CHECK(module.macPower(14));
+    uint16_t timeout = module.getTimeout(S7XG_KIND_MAC_SET);
+    S7XG_CHECK(timeout >= 55);
+    S7XG_CHECK(timeout <= 70);
+
+    // Other kinds and the long commands of the same kind are learned apart
+    S7XG_CHECK_EQUAL(S7XG_TIMEOUT_INITIAL, module.getTimeout(S7XG_KIND_GPS));
+    S7XG_CHECK_EQUAL(1000, module.getTimeout(S7XG_KIND_MAC_SET, true));
+
+    // Steady answers narrow it down
+    for (uint8_t i=0; i<20; i++) S7XG_CHECK(module.macUpCounter(i + 1));
+    S7XG_CHECK(module.getTimeout(S7XG_KIND_MAC_SET) < timeout);
+    S7XG_CHECK(module.getTimeout(S7XG_KIND_MAC_SET) >= 20);
+}
+
+static void clamped() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    module.begin(sim);
+
+    // A fast module does not go under the floor
+    module.setTimeouts(200, 300);
+    S7XG_CHECK(module.macPower(14));
+    S7XG_CHECK_EQUAL(200, module.getTimeout(S7XG_KIND_MAC_SET));
+
+    // A slow one does not go over the ceiling, which also caps the initial timeouts
+    module.setTimeouts(10, 300);
+    S7XG_CHECK_EQUAL(300, module.getTimeout(S7XG_KIND_GPS, true));
+    sim.setLatency(250);
+    S7XG_CHECK(module.gpsPort(5));
+    S7XG_CHECK_EQUAL(300, module.getTimeout(S7XG_KIND_GPS));
+
+    // The ceiling is never below the floor
+    module.setTimeouts(400, 300);
+    S7XG_CHECK_EQUAL(400, module.getTimeout(S7XG_KIND_GPS));
+}
+
+static void backoff() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(20);
+    module.begin(sim);
+    module.setTimeouts(10, 1000);
+    S7XG_CHECK(module.macPower(14));
+    uint16_t timeout = module.getTimeout(S7XG_KIND_MAC_SET);
+
+    // A lost answer waits for the current timeout, then the estimation doubles
+    sim.failNext(NULL);
+    uint32_t start = millis();
+    S7XG_CHECK(!module.macPower(20));
+    S7XG_CHECK_EQUAL(S7XG_STATUS_TIMEOUT, module.getStatus());
+    S7XG_CHECK(millis() - start >= timeout);
+    S7XG_CHECK(millis() - start < timeout + 20U);
+    S7XG_CHECK(module.getTimeout(S7XG_KIND_MAC_SET) >= 2 * timeout);
+
+    // Up to the ceiling
+    module.setTimeouts(10, 300);
+    for (uint8_t i=0; i<3; i++) {
+        sim.failNext(NULL);
+        S7XG_CHECK(!module.macUpCounter(i + 1));
+    }
+    S7XG_CHECK_EQUAL(300, module.getTimeout(S7XG_KIND_MAC_SET));
+
+    // And it comes back down with the answers
+    for (uint8_t i=0; i<20; i++) S7XG_CHECK(module.macUpCounter(i + 10));
+    S7XG_CHECK(module.getTimeout(S7XG_KIND_MAC_SET) < 300);
+}
+
+int main() {
+    S7XG_TEST(initial);
+    S7XG_TEST(sampled);
+    S7XG_TEST(clamped);
+    S7XG_TEST(backoff);
+    return s7xg_test_result();
+}
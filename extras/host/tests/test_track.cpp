@@ -0,0 +1,170 @@
+/*
+
+S7XG library
+
+Track codec tests: delta encoding, decoding and the GPS sampler
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+#include "S7XGTrack.h"
+
+static void epoch() {
+    S7XG_CHECK_EQUAL(0, S7XGTrack::epoch(1970, 1, 1, 0, 0, 0));
+    S7XG_CHECK_EQUAL(951782400, S7XGTrack::epoch(2000, 2, 29, 0, 0, 0));
+    S7XG_CHECK_EQUAL(1567427614, S7XGTrack::epoch(2019, 9, 2, 12, 33, 34));
+    S7XG_CHECK_EQUAL(4102444799UL, S7XGTrack::epoch(2099, 12, 31, 23, 59, 59));
+}
+
+static void roundtrip() {
+    S7XGTrack track;
+    uint32_t time = 1567427614;
+    int32_t latitude = 41601215;
+    int32_t longitude = -2622485;
+    for (uint8_t i=0; i<5; i++) {
+        S7XG_CHECK(track.add(time + i * 10, latitude + i * 130, longitude - i * 70));
+    }
+    S7XG_CHECK_EQUAL(5, track.count());
+
+    // Header plus 4 deltas of a byte per value
+    S7XG_CHECK_EQUAL(S7XG_TRACK_HEADER_SIZE + 4 * 3, track.length());
+    S7XG_CHECK_EQUAL(S7XG_TRACK_VERSION, track.data()[0]);
+
+    s7xg_track_point_t points[8];
+    S7XG_CHECK_EQUAL(5, S7XGTrack::decode(track.data(), track.length(), points, 8));
+    for (uint8_t i=0; i<5; i++) {
+        S7XG_CHECK_EQUAL(time + i * 10, points[i].time);
+        S7XG_CHECK_EQUAL(41601220 + i * 130, points[i].latitude_e6);
+        S7XG_CHECK_EQUAL(-2622490 - i * 70, points[i].longitude_e6);
+    }
+
+    // Fewer slots than fixes
+    S7XG_CHECK_EQUAL(2, S7XGTrack::decode(track.data(), track.length(), points, 2));
+}
+
+static void limits() {
+    S7XGTrack track(20);
+    S7XG_CHECK(!track.full());
+    S7XG_CHECK(track.add(1000, 0, 0));
+    S7XG_CHECK(track.add(1010, 10, -10));
+    S7XG_CHECK(track.add(1020, 20, -20));
+    S7XG_CHECK_EQUAL(S7XG_TRACK_HEADER_SIZE + 6, track.length());
+    S7XG_CHECK(track.full());
+
+    // A long jump takes more bytes and does not fit
+    S7XG_CHECK(!track.add(100000, 45000000, 90000000));
+    S7XG_CHECK_EQUAL(3, track.count());
+
+    track.clear();
+    S7XG_CHECK_EQUAL(0, track.count());
+    S7XG_CHECK(track.add(100000, 45000000, 90000000));
+}
+
+static void malformed() {
+    s7xg_track_point_t points[4];
+    uint8_t data[S7XG_TRACK_HEADER_SIZE + 2] = { S7XG_TRACK_VERSION };
+    S7XG_CHECK_EQUAL(0, S7XGTrack::decode(data, S7XG_TRACK_HEADER_SIZE - 1, points, 4));
+    data[0] = S7XG_TRACK_VERSION + 1;
+    S7XG_CHECK_EQUAL(0, S7XGTrack::decode(data, S7XG_TRACK_HEADER_SIZE, points, 4));
+
+    // A cut varint ends the track
+    data[0] = S7XG_TRACK_VERSION;
+    data[S7XG_TRACK_HEADER_SIZE] = 0x02;
+    data[S7XG_TRACK_HEADER_SIZE + 1] = 0x80;
+    S7XG_CHECK_EQUAL(1, S7XGTrack::decode(data, sizeof(data), points, 4));
+}
+
+static void sampler() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setTTFF(0);
+    sim.addFix({ 2019, 9, 2, 12, 33, 34, 41601215, 2622485, 36 });
+    sim.addFix({ 2019, 9, 2, 12, 33, 44, 41601315, 2622585, 36 });
+    module.begin(sim);
+    S7XG_CHECK(module.gpsInit());
+    S7XG_CHECK(module.gpsMode(S7XG_GPS_MODE_MANUAL));
+
+    S7XGTrack track;
+    track.begin(module, 5, 20);
+    track.setMaxAge(200);
+    uint32_t start = millis();
+    while ((0 == module.macQueued()) && (millis() - start < 2000)) {
+        track.loop();
+        delay(1);
+    }
+    S7XG_CHECK_EQUAL(1, module.macQueued());
+    S7XG_CHECK(millis() - start >= 200);
+    S7XG_CHECK_EQUAL(0, track.count());
+}
+
+static void budget() {
+    S7XGSimulator sim;
+    S7XG module;
+    sim.setLatency(1);
+    sim.setAirtime(1);
+    sim.setTTFF(0);
+    sim.addFix({ 2019, 9, 2, 12, 33, 34, 41601215, 2622485, 36 });
+    module.begin(sim);
+    S7XG_CHECK(module.macJoinABP("26011B1B", "00112233445566770011223344556677", "00112233445566770011223344556677"));
+    S7XG_CHECK(module.gpsInit());
+    S7XG_CHECK(module.gpsMode(S7XG_GPS_MODE_MANUAL));
+
+    // Spend the budget until a 40 bytes track at SF12 barely fits, small SF7 uplinks for the last bit
+    uint8_t payload[S7XG_UPLINK_SIZE] = { 0 };
+    uint32_t target = S7XG::uplinkAirtime(868, S7XG_DR_SF12BW125_EU, 40);
+    uint32_t large = S7XG::uplinkAirtime(868, S7XG_DR_SF12BW125_EU, sizeof(payload));
+    S7XG_CHECK(module.macDatarate(S7XG_DR_SF12BW125_EU));
+    while (module.airtimeBudget() > target + large) {
+        S7XG_CHECK(module.macSend(payload, sizeof(payload)));
+        S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return !module.busy(); }));
+        delay(2);
+    }
+    S7XG_CHECK(module.macDatarate(S7XG_DR_SF7BW125_EU));
+    while (module.airtimeBudget() > target) {
+        S7XG_CHECK(module.macSend(payload, 1));
+        S7XG_CHECK(s7xg_test_until(module, 1000, [&] { return !module.busy(); }));
+        delay(2);
+    }
+    S7XG_CHECK(module.macDatarate(S7XG_DR_SF12BW125_EU));
+
+    // Sent before it is full, with what the budget allows
+    S7XGTrack track;
+    track.begin(module, 5, 5);
+    uint8_t count = 0;
+    uint32_t start = millis();
+    while ((0 == module.macQueued()) && (millis() - start < 2000)) {
+        count = track.count();
+        track.loop();
+        delay(1);
+    }
+    S7XG_CHECK_EQUAL(1, module.macQueued());
+    S7XG_CHECK(count > 1);
+    S7XG_CHECK(S7XG_TRACK_HEADER_SIZE + count * 3 < 40);
+    S7XG_CHECK_EQUAL(0, track.count());
+}
+
+int main() {
+    S7XG_TEST(epoch);
+    S7XG_TEST(roundtrip);
+    S7XG_TEST(limits);
+    S7XG_TEST(malformed);
+    S7XG_TEST(sampler);
+    S7XG_TEST(budget);
+    return s7xg_test_result();
+}
@@ -0,0 +1,129 @@
+/*
+
+S7XG library
+
+Track log tests: packing, ring buffer, search and drain
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "S7XGTest.h"
+#include "S7XGTrackLog.h"
+
+static s7xg_log_fix_t make(uint32_t time, int32_t latitude_e6, int32_t longitude_e6, uint16_t positioning_ds = 0, bool fix = true) {
+    s7xg_log_fix_t entry = { time, latitude_e6, longitude_e6, positioning_ds, fix };
+    return entry;
+}
+
+static void packing() {
+    S7XGTrackLog<4> log;
+    S7XG_CHECK(log.append(make(1567427614, 41601215, -2622485, 36)));
+    S7XG_CHECK(log.append(make(1567427624, -89999999, 179999999, 5000, false)));
+
+    s7xg_log_fix_t fix = {};
+    S7XG_CHECK(log.get(0, fix));
+    S7XG_CHECK_EQUAL(1567427614, fix.time);
+    S7XG_CHECK_EQUAL(41601220, fix.latitude_e6);
+    S7XG_CHECK_EQUAL(-2622490, fix.longitude_e6);
+    S7XG_CHECK_EQUAL(36, fix.positioning_ds);
+    S7XG_CHECK(fix.fix);
+
+    // Extremes are kept, positioning time saturates
+    S7XG_CHECK(log.get(1, fix));
+    S7XG_CHECK_EQUAL(-90000000, fix.latitude_e6);
+    S7XG_CHECK_EQUAL(180000000, fix.longitude_e6);
+    S7XG_CHECK_EQUAL(S7XG_LOG_POSITIONING_MAX, fix.positioning_ds);
+    S7XG_CHECK(!fix.fix);
+
+    S7XG_CHECK(!log.get(2, fix));
+}
+
+static void ring() {
+    S7XGTrackLog<3> log;
+    S7XG_CHECK_EQUAL(3, log.capacity());
+    for (uint32_t i=0; i<5; i++) log.append(make(100 + i, 0, 0));
+    S7XG_CHECK_EQUAL(3, log.count());
+    S7XG_CHECK_EQUAL(2, log.overwritten());
+
+    s7xg_log_fix_t fix = {};
+    S7XG_CHECK(log.pop(fix));
+    S7XG_CHECK_EQUAL(102, fix.time);
+    S7XG_CHECK_EQUAL(2, log.count());
+
+    log.clear();
+    S7XG_CHECK_EQUAL(0, log.count());
+    S7XG_CHECK(!log.pop(fix));
+}
+
+static void search() {
+    S7XGTrackLog<8> log;
+    for (uint32_t i=0; i<10; i++) log.append(make(1000 + i * 10, 0, 0));
+    S7XG_CHECK_EQUAL(0, log.since(0));
+    S7XG_CHECK_EQUAL(0, log.since(1020));
+    S7XG_CHECK_EQUAL(1, log.since(1021));
+    S7XG_CHECK_EQUAL(7, log.since(1090));
+    S7XG_CHECK_EQUAL(8, log.since(2000));
+}
+
+static void drain() {
+    S7XGTrackLog<16> log;
+    for (uint32_t i=0; i<12; i++) log.append(make(1000 + i * 10, 41601215 + i * 100, 2622485, 0, i != 3));
+
+    s7xg_log_fix_t fixes[2];
+    S7XG_CHECK_EQUAL(2, log.drain(fixes, 2));
+    S7XG_CHECK_EQUAL(1010, fixes[1].time);
+
+    // Fixes without a position are skipped, the rest stays for the next track
+    S7XGTrack track(S7XG_TRACK_HEADER_SIZE + 3 * 3);
+    S7XG_CHECK_EQUAL(4, log.drain(track));
+    S7XG_CHECK_EQUAL(4, track.count());
+    S7XG_CHECK_EQUAL(5, 10 - log.count());
+
+    s7xg_track_point_t points[4];
+    S7XG_CHECK_EQUAL(4, S7XGTrack::decode(track.data(), track.length(), points, 4));
+    S7XG_CHECK_EQUAL(1020, points[0].time);
+    S7XG_CHECK_EQUAL(1040, points[1].time);
+}
+
+static void messages() {
+    S7XGTrackLog<2> log;
+    gps_message_t message;
+    memset(&message, 0, sizeof(message));
+    S7XG_CHECK(!log.append(message));
+    message.valid = S7XG_GPS_VALID_TIME | S7XG_GPS_VALID_POSITION;
+    message.year = 2019;
+    message.month = 9;
+    message.day = 2;
+    message.latitude_e6 = 41601215;
+    message.positioning_ms = 3600;
+    S7XG_CHECK(log.append(message));
+
+    s7xg_log_fix_t fix = {};
+    S7XG_CHECK(log.get(0, fix));
+    S7XG_CHECK_EQUAL(S7XGTrack::epoch(2019, 9, 2, 0, 0, 0), fix.time);
+    S7XG_CHECK_EQUAL(36, fix.positioning_ds);
+    S7XG_CHECK(fix.fix);
+}
+
+int main() {
+    S7XG_TEST(packing);
+    S7XG_TEST(ring);
+    S7XG_TEST(search);
+    S7XG_TEST(drain);
+    S7XG_TEST(messages);
+    return s7xg_test_result();
+}
@@ -23,18 +23,132 @@ Module functions as per datasheet (included in the docs folder of the repo).
 
 */
 
+#define S7XG_COMMAND_NAMES
 #include "S7XG.h"
+#include "S7XGMulti.h"
+
+const char S7XG_HEX_DIGITS[] = "0123456789ABCDEF";
+const uint32_t S7XG_BAUDRATES[] = { 115200, 57600, 19200, 9600 };
+const char * const S7XG_GPS_MODES[] = { "idle", "manual", "auto" };
 
 // ----------------------------------------------------------------------------
 // Init
 // ----------------------------------------------------------------------------
 
+/**
+ * @brief               Leaves the manager the module belongs to, if any
+ */
+S7XG::~S7XG() {
+    if (_multi) _multi->remove(*this);
+}
+
 /**
  * @brief               Binds the library the the stream object
  * @param &stream       Serial object to communicate with the S7XG module
  */
 void S7XG::begin(Stream &stream) {
     _stream = &stream;
+    _job_count = 0;
+    _job_step = S7XG_STEP_IDLE;
+    _job_late = 0;
+    _tx_pending = 0;
+    _uplink_used = 0;
+    _uplink_sending = 0xFF;
+    _uplink_waiting = 0;
+    _inflight_count = 0;
+    _budget = 0xFFFFFFFF;
+    _budget_updated = millis();
+    _join_state = S7XG_JOIN_IDLE;
+    _join_issued = false;
+    _nmea.reset();
+    _gps_fresh = false;
+    invalidate();
+    resetStats();
+    memset(_rtt, 0, sizeof(_rtt));
+    memset(_rtt_var, 0, sizeof(_rtt_var));
+}
+
+/**
+ * @brief               Binds the library to the stream object and brings the link to the fastest speed
+ * @details             See negotiateBaudrate.
+ * @param &stream       Serial object to communicate with the S7XG module
+ * @param[in] callback  Function that changes the speed of the serial object, returns false if not supported
+ * @param[in] password  Password required by sip set_baudrate
+ * @param[in] max       Highest baudrate to use (defaults to 115200)
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ * @return              True if the module answers
+ */
+bool S7XG::begin(Stream &stream, s7xg_baudrate_callback_t callback, const char * password, uint32_t max, void * arg) {
+    begin(stream);
+    return 0 != negotiateBaudrate(callback, password, max, arg);
+}
+
+/**
+ * @brief               Finds the module and moves both sides to the fastest baudrate that works
+ * @details             The module is looked for at every supported speed (115200, 57600, 19200 and 9600)
+ *                      from the fastest down, so it does not matter what the module kept from a previous
+ *                      session. Then faster speeds up to max that the callback accepts are tried: the
+ *                      module is told to switch, the host follows and a sip get_ver round-trip checks the
+ *                      link. If the module refuses or does not answer at the new speed both sides go back
+ *                      to the previous one.
+ *                      Blocking, call it before queueing any async command.
+ * @param[in] callback  Function that changes the speed of the serial object, returns false if not supported
+ * @param[in] password  Password required by sip set_baudrate
+ * @param[in] max       Highest baudrate to use (defaults to 115200)
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ * @return              Baudrate in use, 0 if the module does not answer
+ */
+uint32_t S7XG::negotiateBaudrate(s7xg_baudrate_callback_t callback, const char * password, uint32_t max, void * arg) {
+
+    _baudrate_callback = callback;
+    _baudrate_arg = arg;
+
+    uint32_t current = _locate();
+    if (0 == current) return 0;
+
+    for (uint8_t i=0; i<sizeof(S7XG_BAUDRATES) / sizeof(S7XG_BAUDRATES[0]); i++) {
+        uint32_t baudrate = S7XG_BAUDRATES[i];
+        if (baudrate > max) continue;
+        if (baudrate == current) break;
+
+        // Only ask the module for speeds the host can follow
+        if (!_switchBaudrate(baudrate)) continue;
+        _switchBaudrate(current);
+        if (!_sendAndExpect(S7XG_JOB_SYNC, "Ok", NULL, SIP_SET_BAUDRATE, baudrate, password)) continue;
+        if (_switchBaudrate(baudrate) && _probe()) break;
+        S7XG_DEBUG(F("-- no answer at the new baudrate\n"));
+        if (_switchBaudrate(current) && _probe()) continue;
+        current = _locate();
+        if ((0 == current) || (current >= baudrate)) break;
+    }
+
+    return _baudrate;
+
+}
+
+/**
+ * @brief               Returns the baudrate agreed with the module
+ * @return              Baudrate, 0 if it has not been negotiated
+ */
+uint32_t S7XG::getBaudrate() {
+    return _baudrate;
+}
+
+/**
+ * @brief               Forgets every value cached from the module
+ * @details             Setters are skipped when the module already has the value and some getters
+ *                      (getVersion, getHardware, macBand, macUpCounter) are answered from memory.
+ *                      The cache is cleared on reset and factory reset, call this method if the module
+ *                      might have been reset or reconfigured behind the library's back.
+ */
+void S7XG::invalidate() {
+    _shadow_count = 0;
+    _version[0] = 0;
+    _hardware[0] = 0;
+    _band = 0;
+    _upcnt_valid = false;
+    _settings_hash = 0;
+    _dr = 0xFF;
 }
 
 /**
@@ -45,33 +159,503 @@ char * S7XG::getResponse() {
     return _buffer;
 }
 
+// ----------------------------------------------------------------------------
+// Async
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Runs the next method call asynchronously
+ * @details             Commands issued by the method are queued and the call returns immediately
+ *                      (true if queued). The callback is called from loop() once, when the last
+ *                      command completes or as soon as one of them fails. Getters return NULL or 0,
+ *                      the response is passed to the callback instead.
+ *                      Example: module.async(callback)->macPower(14);
+ * @param[in] callback  Function to call when done
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ * @return              Proxy object to call the method on
+ */
+S7XGAsync S7XG::async(s7xg_callback_t callback, void * arg) {
+    _closeGroup();
+    _group = _nextGroup();
+    _group_failed = false;
+    _group_callback = callback;
+    _group_arg = arg;
+    return S7XGAsync(this);
+}
+
+/**
+ * @brief               Closes the async call when the proxy goes out of scope
+ */
+S7XGAsync::~S7XGAsync() {
+    if (_module) _module->_closeGroup();
+}
+
+/**
+ * @brief               Tells whether a command of the call could not be queued
+ * @details             Check it after calling the method, the whole call is then cancelled when the
+ *                      proxy goes out of scope and the callback is never called.
+ *                      Example: S7XGAsync call = module.async(callback); call->macPower(14); if (call.failed()) {...}
+ * @return              True if the queue was full
+ */
+bool S7XGAsync::failed() {
+    return _module && _module->_group_failed;
+}
+
+/**
+ * @brief               Advances the command queue without blocking, call it from your main loop
+ * @details             Sends the next queued command, collects its response and calls the callback
+ *                      when done. Only one command is completed per call. Unsolicited lines
+ *                      (downlinks, TX and join results) are dispatched to the event callbacks.
+ */
+void S7XG::loop() {
+
+    // Publish the fix decoded from the NMEA output
+    if (_gps_fresh) {
+        _gps_fresh = false;
+        if (_gps_callback) _gps_callback(_nmea.fix(), _gps_arg);
+    }
+
+    // Move the join manager on, before releasing a queued uplink
+    if (_join_state && (_join_state < S7XG_JOIN_JOINED)) _joinStep();
+
+    // Give up on uplink results that never came
+    if (_inflight_count) _expire();
+
+    // Release a queued uplink if the module is free
+    if (_uplink_used) _schedule();
+
+    // Lines received between commands are never an answer
+    if ((0 == _job_count) || (S7XG_STEP_IDLE == _job_step)) {
+        if (_readLine()) {
+            uint8_t event = _rx_overflow ? (uint8_t) S7XG_EVENT_NONE : _classify();
+            if (S7XG_EVENT_NONE == event) {
+                _link.lines_discarded++;
+                _job_late = 0;
+            }
+            _notify(event);
+            return;
+        }
+
+        // After a timeout the next command waits for the late answer (dropped above) or for another timeout
+        if (_job_late && (millis() - _job_start >= _job_late)) _job_late = 0;
+        if ((0 == _job_count) || _job_late) return;
+    }
+    s7xg_job_t * job = &_jobs[_job_head];
+
+    // Send next command
+    if (S7XG_STEP_IDLE == _job_step) {
+        _start();
+        return;
+    }
+
+    // Wait for a response
+    bool longer = (S7XG_STEP_THEN == _job_step) || (job->flags & S7XG_JOB_LONG);
+    if (!_readLine()) {
+        uint16_t timeout = getTimeout(job->kind, longer);
+        if (millis() - _job_start >= timeout) {
+            S7XG_DEBUG(F("-- timeout\n"));
+            _learn(job->kind, longer, 0);
+            if (S7XG_STEP_REPLY == _job_step) {
+                _job_late = getTimeout(job->kind, longer);
+                _job_start = millis();
+            }
+            _buffer[0] = 0;
+            _done(S7XG_STATUS_TIMEOUT);
+        }
+        return;
+    }
+
+    // Unsolicited lines are dispatched, unless it is the join result the job is waiting for
+    uint8_t event = _rx_overflow ? (uint8_t) S7XG_EVENT_NONE : _classify();
+    bool answer = (S7XG_STEP_THEN == _job_step) && (job->flags & S7XG_JOB_JOIN) &&
+        ((S7XG_EVENT_JOIN_OK == event) || (S7XG_EVENT_JOIN_ERROR == event));
+    if (event && !answer) {
+        _notify(event);
+        return;
+    }
+
+    // Check response
+    uint32_t elapsed = millis() - _job_start;
+    _learn(job->kind, longer, elapsed ? elapsed : 1);
+    if (S7XG_STEP_REPLY == _job_step) {
+        if (_rx_overflow || !_match(job->expect, job->flags)) {
+            _done(S7XG_STATUS_ERROR);
+        } else {
+            if (job->flags & S7XG_JOB_TX) {
+                if (_tx_pending < 0xFF) _tx_pending++;
+                _tx_sent = millis();
+                _refill();
+                uint32_t airtime = _airtime(job->payload_len);
+                _budget = (_budget > airtime) ? _budget - airtime : 0;
+                _track(job);
+                _upcnt++;
+            }
+            if (job->then) {
+                _job_step = S7XG_STEP_THEN;
+                _job_start = millis();
+            } else {
+                _done(S7XG_STATUS_OK);
+            }
+        }
+    } else {
+        _done(_match(job->then, 0) ? S7XG_STATUS_OK : S7XG_STATUS_ERROR);
+    }
+
+    if (answer) _notify(event);
+
+    // Pipelining: the next command goes out right after the answer, unless there is more to read
+    // or a blocking call still has to pick its answer from the buffer
+    bool waited = _wait_id && (S7XG_STATUS_PENDING != _wait_status);
+    if (_job_count && (S7XG_STEP_IDLE == _job_step) && !waited && !_fill()) _start();
+
+}
+
+/**
+ * @brief               Checks if there are commands waiting in the queue
+ * @return              True if there are pending commands
+ */
+bool S7XG::busy() {
+    return _job_count > 0;
+}
+
+/**
+ * @brief               Returns the result of the last completed command
+ * @return              One of S7XG_STATUS_OK, S7XG_STATUS_ERROR or S7XG_STATUS_TIMEOUT
+ */
+uint8_t S7XG::getStatus() {
+    return _status;
+}
+
+/**
+ * @brief               Starts queueing the following method calls as a single batch
+ * @details             Commands are queued instead of sent and endBatch() sends them back to back,
+ *                      each one as soon as the previous one is answered. Methods return true if queued,
+ *                      getters return NULL or 0. Do not call async() inside a batch.
+ */
+void S7XG::beginBatch() {
+    _closeGroup();
+    _batch = _openBatch();
+}
+
+/**
+ * @brief               Runs the commands queued since beginBatch() and waits for them
+ * @details             Stops at the first failure, getReport() tells which step it was.
+ * @return              True if every command succeeded
+ */
+bool S7XG::endBatch() {
+    uint8_t group = _batch;
+    _batch = 0;
+    return _closeBatch(group);
+}
+
+/**
+ * @brief               Returns the outcome of the last call
+ * @details             For batches, async calls and methods that issue several commands, tells how many
+ *                      commands were run and which one failed. Also valid inside an async callback.
+ * @return              Reference to the report
+ */
+const s7xg_report_t & S7XG::getReport() {
+    return _report;
+}
+
+// ----------------------------------------------------------------------------
+// Settings
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Brings the module to the desired settings, touching only what is different
+ * @details             Intended for a fast warm boot: MAC settings and credentials are read back from the
+ *                      module and only written (and saved) if they differ, GPS settings without a getter
+ *                      are written once per session, and the module only joins again if the credentials
+ *                      changed or it lost the session. OTAA joins complete in the background (see onJoin).
+ *                      With save set, the hash of the settings is kept in the module storage (sip set_storage,
+ *                      overwriting whatever the application kept there) and on the next boot a matching
+ *                      hash skips reading back the MAC settings and credentials. Settings changed and
+ *                      saved outside configure() are not seen then, call it with save set again after
+ *                      doing so. Calling it again with the same settings in the same session does nothing.
+ * @param[in] settings  Desired settings (start from S7XG_SETTINGS_KEEP)
+ * @return              True if everything OK, false if a field is out of range
+ */
+bool S7XG::configure(const s7xg_settings_t & settings) {
+
+    if ((S7XG_KEEP != settings.gps_mode) && (settings.gps_mode > S7XG_GPS_MODE_AUTO)) return false;
+
+    uint32_t hash = settingsHash(settings);
+    if (hash == _settings_hash) return true;
+
+    // The module flash already has the MAC settings and credentials of the last saved settings
+    char stored[9];
+    snprintf(stored, sizeof(stored), "%08lX", (unsigned long) hash);
+    bool saved = false;
+    if (settings.save) {
+        char * storage = _sendAndReturn(SIP_GET_STORAGE);
+        saved = storage && (0 == strcmp(storage, stored));
+    }
+
+    // MAC settings
+    bool mac = false;
+    if (S7XG_KEEP != settings.datarate) _dr = settings.datarate;
+    if (!saved) {
+        if ((S7XG_KEEP != settings.power) && !_apply(mac, MAC_GET_POWER, MAC_SET_POWER, settings.power)) return false;
+        if ((S7XG_KEEP != settings.datarate) && !_apply(mac, MAC_GET_DR, MAC_SET_DR, settings.datarate)) return false;
+        if ((S7XG_KEEP != settings.adr) && !_apply(mac, MAC_GET_ADR, MAC_SET_ADR, 0 != settings.adr)) return false;
+        if ((S7XG_KEEP != settings.retries) && !_apply(mac, MAC_GET_TXRETRY, MAC_SET_TXRETRY, settings.retries)) return false;
+        if ((S7XG_KEEP != settings.device_class) && !_apply(mac, MAC_GET_CLASS, MAC_SET_CLASS, settings.device_class)) return false;
+        if ((S7XG_KEEP != settings.duty_cycle) && !_apply(mac, MAC_GET_DC_CTL, MAC_SET_DC_CTL, 0 != settings.duty_cycle)) return false;
+    }
+
+    // Credentials
+    bool otaa = (NULL != settings.appkey);
+    bool abp = !otaa && (NULL != settings.devaddr);
+    bool credentials = false;
+    if (otaa && !saved) {
+        const char * deveui = settings.deveui ? settings.deveui : getEUI();
+        if (!_apply(credentials, MAC_GET_DEVEUI, MAC_SET_DEVEUI, deveui)) return false;
+        if (settings.appeui && !_apply(credentials, MAC_GET_APPEUI, MAC_SET_APPEUI, settings.appeui)) return false;
+        if (!_apply(credentials, MAC_GET_APPKEY, MAC_SET_APPKEY, settings.appkey)) return false;
+    }
+    if (abp && !saved) {
+        if (!_apply(credentials, MAC_GET_DEVADDR, MAC_SET_DEVADDR, settings.devaddr)) return false;
+        if (settings.nwkskey && !_apply(credentials, MAC_GET_NWKSKEY, MAC_SET_NWKSKEY, settings.nwkskey)) return false;
+        if (settings.appskey && !_apply(credentials, MAC_GET_APPSKEY, MAC_SET_APPSKEY, settings.appskey)) return false;
+    }
+
+    if (settings.save && (mac || credentials) && !macSave()) return false;
+    if (settings.save && !saved && !_sendAndACK(SIP_SET_STORAGE, stored)) return false;
+
+    // Join only if the session is gone
+    if ((otaa || abp) && (credentials || !_sendAndExpect(S7XG_JOB_SYNC, "joined", NULL, MAC_GET_JOIN_STATUS))) {
+        if (otaa) {
+            if (!_sendAndExpect(S7XG_JOB_LONG | S7XG_JOB_JOIN, "Ok", NULL, MAC_JOIN_OTAA)) return false;
+        } else {
+            if (!_sendAndExpect(S7XG_JOB_LONG | S7XG_JOB_JOIN, "Ok", "accepted", MAC_JOIN_ABP)) return false;
+        }
+    }
+
+    // GPS settings, the mode is the only one that can be read back
+    bool gps = false;
+    if ((S7XG_KEEP != settings.gps_mode) && (S7XG_GPS_MODE_IDLE != settings.gps_mode)) {
+        if (!_sendAndCache(GPS_SET_LEVEL_SHIFT, true)) return false;
+        if (!_sendAndCache(GPS_SET_START, "hot")) return false;
+        if (!_sendAndCache(GPS_SET_SATELLITE_SYSTEM, "gps")) return false;
+        if (!_sendAndCache(GPS_SET_NMEA, "rmc")) return false;
+    }
+    if ((S7XG_KEEP != settings.gps_port) && !gpsPort(settings.gps_port)) return false;
+    if ((S7XG_KEEP != settings.gps_format) && !gpsFormat(settings.gps_format)) return false;
+    if ((0 != settings.gps_cycle) && !gpsCycle(settings.gps_cycle)) return false;
+    if (S7XG_KEEP != settings.gps_mode) {
+        _gps_auto = (S7XG_GPS_MODE_AUTO == settings.gps_mode);
+        _wait_longer = true;
+        if (!_apply(gps, GPS_GET_MODE, GPS_SET_MODE, S7XG_GPS_MODES[settings.gps_mode])) return false;
+    }
+
+    if (!_group) _settings_hash = hash;
+    return true;
+
+}
+
+/**
+ * @brief               Hashes a settings structure
+ * @details             Strings are hashed by content, so two structures with the same values have the same hash.
+ * @param[in] settings  Settings
+ * @return              32 bits hash
+ */
+uint32_t S7XG::settingsHash(const s7xg_settings_t & settings) {
+    uint8_t values[] = {
+        settings.power, settings.datarate, settings.adr, settings.retries, settings.device_class,
+        settings.duty_cycle, settings.gps_mode, settings.gps_port, settings.gps_format, settings.save
+    };
+    uint32_t hash = _hash(values, sizeof(values));
+    hash = _hash(&settings.gps_cycle, sizeof(settings.gps_cycle), hash);
+    const char * strings[] = {
+        settings.devaddr, settings.nwkskey, settings.appskey,
+        settings.deveui, settings.appeui, settings.appkey
+    };
+    for (uint8_t i=0; i<6; i++) hash = _hash(strings[i], hash);
+    return hash;
+}
+
+// ----------------------------------------------------------------------------
+// Statistics
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Returns the counters for a kind of command
+ * @details             Latencies go from the moment the command is sent to the moment the last
+ *                      expected answer arrives (including the "accepted" after an ABP join).
+ *                      Timeouts and setters answered from the cache are not part of the histogram.
+ * @param[in] kind      One of the S7XG_KIND_* values
+ * @return              Reference to the counters (all zeros if the kind is not valid)
+ */
+const s7xg_stats_t & S7XG::getStats(uint8_t kind) {
+    static const s7xg_stats_t empty = {};
+    return (kind < S7XG_KIND_COUNT) ? _stats[kind] : empty;
+}
+
+/**
+ * @brief               Returns the serial link counters
+ * @return              Reference to the counters
+ */
+const s7xg_link_stats_t & S7XG::getLinkStats() {
+    return _link;
+}
+
+/**
+ * @brief               Estimates a latency percentile from the histogram
+ * @details             The answer is the upper bound of the bucket the percentile falls in
+ *                      (or the maximum latency for the last bucket), so it is a power of two.
+ * @param[in] kind      One of the S7XG_KIND_* values
+ * @param[in] percent   Percentile (1-100)
+ * @return              Latency in milliseconds, 0 if there are no samples
+ */
+uint32_t S7XG::getLatencyPercentile(uint8_t kind, uint8_t percent) {
+
+    if (kind >= S7XG_KIND_COUNT) return 0;
+    const s7xg_stats_t & stats = _stats[kind];
+
+    uint32_t total = 0;
+    for (uint8_t i=0; i<S7XG_STATS_BUCKETS; i++) total += stats.buckets[i];
+    if (0 == total) return 0;
+
+    if (percent > 100) percent = 100;
+    uint32_t target = (total * percent + 99) / 100;
+    if (0 == target) target = 1;
+
+    uint32_t sum = 0;
+    for (uint8_t i=0; i<S7XG_STATS_BUCKETS-1; i++) {
+        sum += stats.buckets[i];
+        if (sum >= target) return 1UL << i;
+    }
+    return (stats.max_us + 999) / 1000;
+
+}
+
+/**
+ * @brief               Sets the limits for the learned timeouts
+ * @details             Timeouts are learned for each kind of command from the observed response times
+ *                      (smoothed response time plus four times its deviation, as TCP does) and kept
+ *                      within these limits. Before the first answer short commands wait S7XG_TIMEOUT_INITIAL
+ *                      and long ones (joins, resets, GPS mode changes) wait the ceiling.
+ * @param[in] floor     Shortest timeout in milliseconds (defaults to S7XG_TIMEOUT_FLOOR)
+ * @param[in] ceiling   Longest timeout in milliseconds (defaults to S7XG_TIMEOUT_CEILING)
+ */
+void S7XG::setTimeouts(uint16_t floor, uint16_t ceiling) {
+    _timeout_floor = floor;
+    _timeout_ceiling = (ceiling > floor) ? ceiling : floor;
+}
+
+/**
+ * @brief               Returns the current timeout for a kind of command
+ * @param[in] kind      One of the S7XG_KIND_* values
+ * @param[in] longer    True for commands that take long to answer (joins, resets, GPS mode changes)
+ * @return              Timeout in milliseconds
+ */
+uint16_t S7XG::getTimeout(uint8_t kind, bool longer) {
+    if (kind >= S7XG_KIND_COUNT) return _timeout_ceiling;
+    uint32_t timeout = _rtt[kind][longer] ?
+        _rtt[kind][longer] + 4UL * _rtt_var[kind][longer] :
+        (longer ? _timeout_ceiling : S7XG_TIMEOUT_INITIAL);
+    if (timeout < _timeout_floor) timeout = _timeout_floor;
+    if (timeout > _timeout_ceiling) timeout = _timeout_ceiling;
+    return timeout;
+}
+
+/**
+ * @brief               Sets all counters to zero
+ */
+void S7XG::resetStats() {
+    memset(_stats, 0, sizeof(_stats));
+    memset(&_link, 0, sizeof(_link));
+}
+
+// ----------------------------------------------------------------------------
+// Events
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Sets the function to call when a downlink is received
+ * @details             The data points to the response buffer, copy it before calling any other method.
+ *                      Called from loop() (or from any blocking method).
+ * @param[in] callback  Function to call, receives the port, the data and its length (NULL to disable)
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ */
+void S7XG::onDownlink(s7xg_downlink_callback_t callback, void * arg) {
+    _downlink_callback = callback;
+    _downlink_arg = arg;
+}
+
+/**
+ * @brief               Sets the function to call when the module reports the result of an uplink
+ * @details             Called for uplinks sent with macSend and for those sent by the module itself
+ *                      in TX cycle or GPS auto mode. A downlink also means the uplink went through.
+ * @param[in] callback  Function to call, receives true on tx_ok or downlink and false on err (NULL to disable)
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ */
+void S7XG::onTxDone(s7xg_event_callback_t callback, void * arg) {
+    _tx_callback = callback;
+    _tx_arg = arg;
+}
+
+/**
+ * @brief               Sets the function to call when the module reports the result of a join
+ * @param[in] callback  Function to call, receives true if accepted (NULL to disable)
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ */
+void S7XG::onJoin(s7xg_event_callback_t callback, void * arg) {
+    _join_callback = callback;
+    _join_arg = arg;
+}
+
+/**
+ * @brief               Sets the function to call when the GPS outputs a new position
+ * @details             Called from loop() (or from any blocking method) after each RMC or GGA sentence
+ *                      with a valid checksum. Enable the sentences first with gpsNmea.
+ * @param[in] callback  Function to call, receives the fix (see gpsFix) (NULL to disable)
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ */
+void S7XG::onGpsFix(s7xg_gps_callback_t callback, void * arg) {
+    _gps_callback = callback;
+    _gps_arg = arg;
+}
+
 // ----------------------------------------------------------------------------
 // SIP
 // ----------------------------------------------------------------------------
 
 /**
  * @brief               Gets the S7XG module version
- * @return              Pointer to a C-string containing the version
+ * @return              Pointer to a C-string containing the version (NULL if run asynchronously)
  */
 char * S7XG::getVersion() {
-    return _sendAndReturn(SIP_GET_VER);
+    if (!_group && _version[0]) return _version;
+    char * buffer = _sendAndReturn(SIP_GET_VER);
+    if (buffer && (S7XG_STATUS_OK == _status) && (strlen(buffer) < sizeof(_version))) strcpy(_version, buffer);
+    return buffer;
 }
 
 /**
  * @brief               Resets the S7XG module
  */
 void S7XG::reset() {
-    _send(SIP_RESET);
-    _wait_longer = true;
-    _readLine();
+    _sendAndExpect(S7XG_JOB_LONG | S7XG_JOB_RESET, NULL, NULL, SIP_RESET);
+}
+
+/**
+ * @brief               Restores the S7XG module factory settings
+ */
+void S7XG::factoryReset() {
+    _sendAndExpect(S7XG_JOB_LONG | S7XG_JOB_RESET, NULL, NULL, SIP_FACTORY_RESET);
 }
 
 /**
  * @brief               Gets the S7XG module hardware version
- * @return              Pointer to a C-string containing the hardware version
+ * @return              Pointer to a C-string containing the hardware version (NULL if run asynchronously)
  */
 char * S7XG::getHardware() {
-    return _sendAndReturn(SIP_GET_HW_MODEL);
+    if (!_group && _hardware[0]) return _hardware;
+    char * buffer = _sendAndReturn(SIP_GET_HW_MODEL);
+    if (buffer && (S7XG_STATUS_OK == _status) && (strlen(buffer) < sizeof(_hardware))) strcpy(_hardware, buffer);
+    return buffer;
 }
 
 /**
@@ -80,11 +664,7 @@ char * S7XG::getHardware() {
  * @return              True if everything OK
  */
 bool S7XG::sleep(uint32_t seconds) {
-    char command[32];
-    snprintf_P(command, sizeof(command), SIP_SLEEP, seconds);
-    _send(command);
-    _readLine();
-    return (_buffer == strstr(_buffer, "sleep"));
+    return _sendAndExpect(S7XG_JOB_PREFIX, "sleep", NULL, SIP_SLEEP, seconds, "uart_on");
 }
 
 /**
@@ -103,10 +683,7 @@ char * S7XG::getEUI() {
     
     if (0 == _eui[0]) {
         
-        _send(SIP_GET_UUID);
-        _readLine();
-        
-        if (_buffer == strstr(_buffer, "uuid=")) {
+        if (_sendAndExpect(S7XG_JOB_SYNC | S7XG_JOB_PREFIX, "uuid=", NULL, SIP_GET_UUID)) {
             
             uint8_t uuid[12];
             unhexlify(&_buffer[5], uuid, 12);
@@ -137,15 +714,27 @@ char * S7XG::getEUI() {
 
 /**
  * @brief               Sends a byte array as a LoRaWAN message
+ * @details             The payload is hex-encoded straight into the serial stream when the command is sent,
+ *                      so it is not limited by S7XG_TX_BUFFER_SIZE. When run asynchronously the data
+ *                      must remain valid until the callback is called. The outcome of a confirmed uplink
+ *                      is reported to onDelivery, use macQueue to have it sent again when not acknowledged.
  * @param[in] data      Byte array with the data to send
  * @param[in] len       Length of the byte array
  * @param[in] confirmed True to send a message with ACK request (defaults to false)
  * @param[in] port      LoRaWAN port (defaults to 1)
  * @return              True if everything OK
  */
-bool S7XG::macSend(uint8_t * data, uint8_t len, bool confirmed, uint8_t port) {
-    char hex[len * 2 + 1];
-    return _sendAndACK(MAC_TX, confirmed ? "cnf" : "ucnf", port, hexlify(data, hex, len));
+bool S7XG::macSend(const uint8_t * data, uint8_t len, bool confirmed, uint8_t port) {
+
+    // Confirmed uplinks are tagged with the frame counter, read it if it is not known
+    if (confirmed && !_group && !_upcnt_valid) macUpCounter();
+
+    _payload = data;
+    _payload_len = len;
+    _payload_port = port;
+    _payload_confirmed = confirmed;
+    return _sendAndExpect(S7XG_JOB_TX, "Ok", NULL, MAC_TX, confirmed ? "cnf" : "ucnf", port);
+
 }
 
 /**
@@ -155,8 +744,8 @@ bool S7XG::macSend(uint8_t * data, uint8_t len, bool confirmed, uint8_t port) {
  * @param[in] port      LoRaWAN port (defaults to 1)
  * @return              True if everything OK
  */
-bool S7XG::macSend(char * data, bool confirmed, uint8_t port) {
-    return macSend((uint8_t *) data, strlen(data));
+bool S7XG::macSend(const char * data, bool confirmed, uint8_t port) {
+    return macSend((const uint8_t *) data, strlen(data), confirmed, port);
 }
 
 /**
@@ -167,16 +756,12 @@ bool S7XG::macSend(char * data, bool confirmed, uint8_t port) {
  * @return              True if everything OK
  */
 bool S7XG::macJoinABP(const char * devaddr, const char * nwkskey, const char * appskey) {
-    
-    if (!_sendAndACK(MAC_SET_DEVADDR, devaddr)) return false;
-    if (!_sendAndACK(MAC_SET_NWKSKEY, nwkskey)) return false;
-    if (!_sendAndACK(MAC_SET_APPSKEY, appskey)) return false;
 
-    _wait_longer = true;
-    if (!_sendAndACK(MAC_JOIN_ABP)) return false;
-    _wait_longer = true;
-    _readLine();
-    return (0 == strcmp("accepted", _buffer));
+    uint8_t batch = _openBatch();
+    if (_setKeys(NULL, NULL, NULL, devaddr, nwkskey, appskey)) {
+        _sendAndExpect(S7XG_JOB_LONG | S7XG_JOB_JOIN, "Ok", "accepted", MAC_JOIN_ABP);
+    }
+    return _closeBatch(batch);
 
 }
 
@@ -188,13 +773,12 @@ bool S7XG::macJoinABP(const char * devaddr, const char * nwkskey, const char * a
  * @return              True if everything OK
  */
 bool S7XG::macJoinOTAA(const char * deveui, const char * appeui, const char * appkey) {
-    
-    if (!_sendAndACK(MAC_SET_DEVEUI, deveui)) return false;
-    if (!_sendAndACK(MAC_SET_APPEUI, appeui)) return false;
-    if (!_sendAndACK(MAC_SET_APPKEY, appkey)) return false;
 
-    _wait_longer = true;
-    return _sendAndACK(MAC_JOIN_OTAA);
+    uint8_t batch = _openBatch();
+    if (_setKeys(deveui, appeui, appkey, NULL, NULL, NULL)) {
+        _sendAndExpect(S7XG_JOB_LONG | S7XG_JOB_JOIN, "Ok", NULL, MAC_JOIN_OTAA);
+    }
+    return _closeBatch(batch);
 
 }
 
@@ -208,11 +792,32 @@ bool S7XG::macJoinOTAA(const char * appeui, const char * appkey) {
     return macJoinOTAA((const char *) getEUI(), appeui, appkey);
 }
 
+/**
+ * @brief               Sets the credentials for both activation methods
+ * @details             Takes a single mac set_keys when the firmware supports it, six setters otherwise.
+ *                      Does not join.
+ * @param[in] deveui    Device EUI (hex string representing 8 bytes)
+ * @param[in] appeui    Application EUI (hex string representing 8 bytes)
+ * @param[in] appkey    Application key (hex string representing 16 bytes)
+ * @param[in] devaddr   Device address (hex string representing 4 bytes)
+ * @param[in] nwkskey   Network session key (hex string representing 16 bytes)
+ * @param[in] appskey   Application session key (hex string representing 16 bytes)
+ * @return              True if everything OK
+ */
+bool S7XG::macKeys(const char * deveui, const char * appeui, const char * appkey, const char * devaddr, const char * nwkskey, const char * appskey) {
+
+    uint8_t batch = _openBatch();
+    _setKeys(deveui, appeui, appkey, devaddr, nwkskey, appskey);
+    return _closeBatch(batch);
+
+}
+
 /**
  * @brief               Saves LoRaWAN configuration parameters to flash
  * @return              True if everything OK
  */
 bool S7XG::macSave() {
+    _wait_longer = true;
     return _sendAndACK(MAC_SAVE);
 }
 
@@ -222,7 +827,7 @@ bool S7XG::macSave() {
  */
 bool S7XG::macJoined() {
     char * buffer = _sendAndReturn(MAC_GET_JOIN_STATUS);
-    return (0 == strcmp(buffer, "joined"));
+    return buffer && (0 == strcmp(buffer, "joined"));
 }
 
 /**
@@ -250,7 +855,7 @@ bool S7XG::macWaitJoined(uint32_t timeout) {
  * @return              True if everything OK
  */
 bool S7XG::macPower(uint8_t power) {
-    return _sendAndACK(MAC_SET_POWER, power);
+    return _sendAndCache(MAC_SET_POWER, power);
 }
 
 /**
@@ -259,7 +864,8 @@ bool S7XG::macPower(uint8_t power) {
  * @return              True if everything OK
  */
 bool S7XG::macDatarate(uint8_t dr) {
-    return _sendAndACK(MAC_SET_DR, dr);
+    _dr = dr;
+    return _sendAndCache(MAC_SET_DR, dr);
 }
 
 /**
@@ -268,7 +874,7 @@ bool S7XG::macDatarate(uint8_t dr) {
  * @return              True if everything OK
  */
 bool S7XG::macADR(bool adr) {
-    return _sendAndACK(MAC_SET_ADR, adr ? "on" : "off");
+    return _sendAndCache(MAC_SET_ADR, adr);
 }
 
 /**
@@ -277,7 +883,7 @@ bool S7XG::macADR(bool adr) {
  * @return              True if everything OK
  */
 bool S7XG::macRetries(uint8_t times) {
-    return _sendAndACK(MAC_SET_TXRETRY, times);
+    return _sendAndCache(MAC_SET_TXRETRY, times);
 }
 
 /**
@@ -286,7 +892,7 @@ bool S7XG::macRetries(uint8_t times) {
  * @return              True if everything OK
  */
 bool S7XG::macSync(uint8_t sync) {
-    return _sendAndACK(MAC_SET_SYNC, sync);
+    return _sendAndCache(MAC_SET_SYNC, sync);
 }
 
 /**
@@ -296,7 +902,7 @@ bool S7XG::macSync(uint8_t sync) {
  * @return              True if everything OK
  */
 bool S7XG::macChannelFrequency(uint8_t channel, uint32_t frequency) {
-    return _sendAndACK(MAC_SET_CH_FREQ, channel, frequency);
+    return _sendAndCache(MAC_SET_CH_FREQ, channel, frequency);
 }
 
 /**
@@ -306,7 +912,7 @@ bool S7XG::macChannelFrequency(uint8_t channel, uint32_t frequency) {
  * @return              True if everything OK
  */
 bool S7XG::macChannelStatus(uint8_t channel, bool status) {
-    return _sendAndACK(MAC_SET_CH_STATUS, channel, status ? "on" : "off");
+    return _sendAndCache(MAC_SET_CH_STATUS, channel, status);
 }
 
 /**
@@ -315,7 +921,7 @@ bool S7XG::macChannelStatus(uint8_t channel, bool status) {
  * @return              True if everything OK
  */
 bool S7XG::macDutyCycle(bool dc) {
-    return _sendAndACK(MAC_SET_DC_CTL, dc ? "on" : "off");
+    return _sendAndCache(MAC_SET_DC_CTL, dc);
 }
 
 /**
@@ -324,7 +930,10 @@ bool S7XG::macDutyCycle(bool dc) {
  * @return              True if everything OK
  */
 bool S7XG::macUpCounter(uint32_t counter) {
-    return _sendAndACK(MAC_SET_UPCNT, counter);
+    bool response = _sendAndACK(MAC_SET_UPCNT, counter);
+    _upcnt = counter;
+    _upcnt_valid = response && !_group;
+    return response;
 }
 
 /**
@@ -342,7 +951,7 @@ bool S7XG::macDownCounter(uint32_t counter) {
  * @return              True if everything OK
  */
 bool S7XG::macClass(uint8_t value) {
-    return _sendAndACK(MAC_SET_CLASS, value);
+    return _sendAndCache(MAC_SET_CLASS, value);
 }
 
 /**
@@ -350,15 +959,25 @@ bool S7XG::macClass(uint8_t value) {
  * @return              Current band (470, 868, 915 or 923)
  */
 uint16_t S7XG::macBand() {
-    return atol(_sendAndReturn(MAC_GET_BAND));
+    if (!_group && _band) return _band;
+    char * buffer = _sendAndReturn(MAC_GET_BAND);
+    if (buffer) _band = atol(buffer);
+    return buffer ? _band : 0;
 }
 
 /**
  * @brief               Returns the current uplink counter
+ * @details             Served from memory after the first read while the module does not send uplinks
+ *                      on its own (TX cycle or GPS auto mode).
  * @return              Current uplink cunter
  */
 uint32_t S7XG::macUpCounter() {
-    return atol(_sendAndReturn(MAC_GET_UPCNT));
+    if (!_group && _upcnt_valid && !_tx_cycle && !_gps_auto) return _upcnt;
+    char * buffer = _sendAndReturn(MAC_GET_UPCNT);
+    if (!buffer) return 0;
+    _upcnt = atol(buffer);
+    _upcnt_valid = ('0' <= buffer[0]) && (buffer[0] <= '9');
+    return _upcnt;
 }
 
 /**
@@ -366,7 +985,8 @@ uint32_t S7XG::macUpCounter() {
  * @return              Current downlink cunter
  */
 uint32_t S7XG::macDownCounter() {
-    return atol(_sendAndReturn(MAC_GET_DOWNCNT));
+    char * buffer = _sendAndReturn(MAC_GET_DOWNCNT);
+    return buffer ? atol(buffer) : 0;
 }
 
 /**
@@ -375,123 +995,446 @@ uint32_t S7XG::macDownCounter() {
  * @return              True if everything OK
  */
 bool S7XG::txCycle(uint32_t seconds) {
-    if (!_sendAndACK(MAC_SET_TX_MODE, 0 == seconds ? "no_cycle" : "cycle"));
-    return _sendAndACK(MAC_SET_TX_INTERVAL, seconds * 1000UL);
+    if (!_sendAndCache(MAC_SET_TX_MODE, 0 == seconds ? "no_cycle" : "cycle")) return false;
+    _tx_cycle = (seconds > 0);
+    return _sendAndCache(MAC_SET_TX_INTERVAL, seconds * 1000UL);
 }
 
 // ----------------------------------------------------------------------------
-// GPS
+// Join manager
 // ----------------------------------------------------------------------------
 
 /**
- * @brief               Inits the GPS into manual mode
- * @return              True if everything OK
+ * @brief               Joins in OTAA mode in the background, retrying until accepted
+ * @details             Driven by loop(), never blocks. The join status is read first: if the module kept a
+ *                      session saved with macSave it is used and no join request is sent at all. Otherwise
+ *                      the credentials are set and join requests are sent until one is accepted, the first
+ *                      one after a random delay and the next ones after a randomised exponential backoff
+ *                      (S7XG_JOIN_BACKOFF doubling up to S7XG_JOIN_BACKOFF_MAX). Requests also keep to the
+ *                      LoRaWAN join duty cycle: 36 s of airtime during the first hour, 36 s per 10 hours
+ *                      during the next 10 hours and 8.7 s per day after that. The accepted session is saved
+ *                      so the next boot skips the join. onJoin is called with the outcome of every request
+ *                      (and with true if a saved session is found). The strings must remain valid until joined.
+ * @param[in] deveui    Device EUI (hex string representing 8 bytes)
+ * @param[in] appeui    Application EUI (hex string representing 8 bytes)
+ * @param[in] appkey    Application key (hex string representing 16 bytes)
+ * @param[in] save      Save the session to flash once accepted (defaults to true)
+ * @param[in] attempts  Give up after these many requests (defaults to 0, never)
+ * @return              True if started
  */
-bool S7XG::gpsInit() {
-    if (!_sendAndACK(GPS_SET_LEVEL_SHIFT, "on")) return false;
-    if (!_sendAndACK(GPS_SET_START, "hot")) return false;
-    if (!_sendAndACK(GPS_SET_SATELLITE_SYSTEM, "gps")) return false;
-    if (!_sendAndACK(GPS_SET_NMEA, "rmc")) return false;
-    if (!_sendAndACK(GPS_SET_POSITIONING_CYCLE, 5000)) return false;
-    gpsMode(S7XG_GPS_MODE_MANUAL);
+bool S7XG::macAutoJoin(const char * deveui, const char * appeui, const char * appkey, bool save, uint8_t attempts) {
+
+    if (!deveui || !appeui || !appkey) return false;
+
+    _join_deveui = deveui;
+    _join_appeui = appeui;
+    _join_appkey = appkey;
+    _join_save = save;
+    _join_max = attempts;
+    _join_attempts = 0;
+    _join_keys = false;
+    _join_issued = false;
+    _join_started = millis();
+    _join_window = 0;
+    _join_spent = 0;
+
+    // Devices powered up together must not draw the same delays
+    _join_seed = _hash(deveui, _join_started) | 1;
+
+    _join_state = S7XG_JOIN_CHECKING;
     return true;
+
 }
 
 /**
- * @brief               Sets the auto uplink port
- * @param[in] port      Port to send messages to when in auto mode
- * @return              True if everything OK
+ * @brief               Joins in OTAA mode in the background using the hardware EUI (see above)
+ * @param[in] appeui    Application EUI (hex string representing 8 bytes)
+ * @param[in] appkey    Application key (hex string representing 16 bytes)
+ * @param[in] save      Save the session to flash once accepted (defaults to true)
+ * @param[in] attempts  Give up after these many requests (defaults to 0, never)
+ * @return              True if started
  */
-bool S7XG::gpsPort(uint8_t port) {
-    return _sendAndACK(GPS_SET_PORT_UPLINK, port);
+bool S7XG::macAutoJoin(const char * appeui, const char * appkey, bool save, uint8_t attempts) {
+    return macAutoJoin((const char *) getEUI(), appeui, appkey, save, attempts);
 }
 
 /**
- * @brief               Sets the auto uplink format
- * @param[in] format    One of S7XG_GPS_FORMAT_RAW, S7XG_GPS_FORMAT_IPSO, S7XG_GPS_FORMAT_KIWI or S7XG_GPS_FORMAT_UTC_POS
- * @return              True if everything OK
+ * @brief               State of the join manager
+ * @return              One of the S7XG_JOIN_* values
  */
-bool S7XG::gpsFormat(uint8_t format) {
-    return _sendAndACK(GPS_SET_FORMAT_UPLINK, 
-        format == S7XG_GPS_FORMAT_RAW ? "raw" : 
-        format == S7XG_GPS_FORMAT_IPSO ? "ipso" : 
-        format == S7XG_GPS_FORMAT_KIWI ? "kiwi" : 
-        "utc_pos");
+uint8_t S7XG::macJoinState() {
+    return _join_state;
 }
 
 /**
- * @brief               Sets the GPS positioning cycle
- * @param[in] seconds   Seconds between GPS updates
- * @return              True if everything OK
+ * @brief               Number of join requests sent by the join manager
+ * @return              Request count
  */
-bool S7XG::gpsCycle(uint32_t seconds) {
-    return _sendAndACK(GPS_SET_POSITIONING_CYCLE, seconds * 1000UL);
+uint8_t S7XG::macJoinAttempts() {
+    return _join_attempts;
 }
 
 /**
- * @brief               Gets the GPS mode
- * @param[in] mode      One of S7XG_GPS_MODE_IDLE, S7XG_GPS_MODE_MANUAL or S7XG_GPS_MODE_AUTO
- * @return              True if everything OK
+ * @brief               Time until the join manager sends the next request
+ * @return              Milliseconds, 0 if not waiting
  */
-bool S7XG::gpsMode(uint8_t mode) {
-    
-    _wait_longer = true;
-    return _sendAndACK(GPS_SET_MODE, 
-        mode == S7XG_GPS_MODE_IDLE ? "idle" : 
-        mode == S7XG_GPS_MODE_MANUAL ? "manual" : 
-        "auto");
-    
+uint32_t S7XG::macJoinNext() {
+    if (S7XG_JOIN_WAITING != _join_state) return 0;
+    int32_t left = _join_deadline - millis();
+    return (left > 0) ? left : 0;
 }
 
+// ----------------------------------------------------------------------------
+// Uplink queue
+// ----------------------------------------------------------------------------
+
 /**
- * @brief               Gets the data from the GPS in manual mode
- * @return              gps_message_t object with the data
+ * @brief               Queues an uplink to be sent by loop() when the module is free
+ * @details             Frames go out highest priority first, oldest first within a priority, once the
+ *                      result of the previous uplink has arrived and the uplink interval has passed.
+ *                      Frames the module refuses (busy, no free channel, not joined, timeout) are kept
+ *                      and retried with an exponential backoff, any other error drops the frame and
+ *                      calls onTxDone with false. With S7XG_UPLINK_COALESCE the frame replaces a pending
+ *                      coalescing frame for the same port, keeping its place in the queue. When the queue
+ *                      is full the newest frame with the lowest priority makes room for a higher priority one,
+ *                      it is counted in the link statistics, reported to onTxDone with false and to
+ *                      onDelivery as S7XG_DELIVERY_DROPPED (confirmed or not).
+ * @param[in] data      Payload (copied)
+ * @param[in] len       Payload length, up to S7XG_UPLINK_SIZE
+ * @param[in] port      LoRaWAN port (defaults to 1)
+ * @param[in] priority  One of the S7XG_PRIORITY_* values (defaults to S7XG_PRIORITY_NORMAL)
+ * @param[in] flags     S7XG_UPLINK_CONFIRMED and/or S7XG_UPLINK_COALESCE (defaults to 0)
+ * @return              True if queued
  */
-gps_message_t S7XG::gpsData() {
-    
-    char * buffer = _sendAndReturn(GPS_GET_DATA);
-    gps_message_t message;
-
-    // No data yet:
-    // POSITIONING ( 14.8s )
-    // GPS data OK:
-    // DD UTC( 2019/09/02 12:33:34 ) LAT( 41.601215 N ) LONG( 2.622485 E ) POSITIONING( 3.6s )
+bool S7XG::macQueue(const uint8_t * data, uint8_t len, uint8_t port, uint8_t priority, uint8_t flags) {
+
+    if (len > S7XG_UPLINK_SIZE) return false;
+
+    // Look for a frame to replace or a free slot
+    uint8_t slot = 0xFF;
+    uint8_t victim = 0xFF;
+    for (uint8_t i=0; i<S7XG_UPLINK_QUEUE_SIZE; i++) {
+        s7xg_uplink_t & uplink = _uplinks[i];
+        bool used = _uplink_used & (1 << i);
+        if (!used) {
+            if (0xFF == slot) slot = i;
+            continue;
+        }
+        if ((i == _uplink_sending) || (_uplink_waiting & (1 << i))) continue;
+        if ((flags & S7XG_UPLINK_COALESCE) && (uplink.flags & S7XG_UPLINK_COALESCE) && (uplink.port == port)) {
+            slot = i;
+            break;
+        }
+        if ((uplink.priority < priority) && ((0xFF == victim) ||
+            (uplink.priority < _uplinks[victim].priority) ||
+            ((uplink.priority == _uplinks[victim].priority) && ((int16_t) (uplink.sequence - _uplinks[victim].sequence) > 0)))) {
+            victim = i;
+        }
+    }
 
-    // Tokenize
-    char * tok = strtok(buffer, " ");
-    message.fix = (0 == strcmp(tok, "DD"));
-    tok = strtok(NULL, " "); // UTC( or (
-    if (!tok) return message;
-    
-    if (message.fix) {
-        
-        char * date = strtok(NULL, " "); // date
-        char * time = strtok(NULL, " "); // time
-        sscanf(date, "%d/%d/%d", &message.year, &message.month, &message.day);
-        sscanf(time, "%d:%d:%d", &message.hour, &message.minute, &message.second);
-
-        strtok(NULL, " "); // )
-        strtok(NULL, " "); // LAT(
-        tok = strtok(NULL, " "); // latitude
-        message.latitude = atof(tok);
-        tok = strtok(NULL, " "); // latitude sign
-        if ('S' == tok[0]) message.latitude = -message.latitude;
-        strtok(NULL, " "); // )
-        strtok(NULL, " "); // LONG(
-        tok = strtok(NULL, " "); // longitude
-        message.longitude = atof(tok);
-        tok = strtok(NULL, " "); // longitude sign
-        if ('W' == tok[0]) message.longitude = -message.longitude;
-        strtok(NULL, " "); // )
-        strtok(NULL, " "); // POSITIONING(
-
-    }
-
-    tok = strtok(NULL, " "); // positioning value
-    message.positioning = atof(tok);
+    bool replace = (0xFF != slot) && (_uplink_used & (1 << slot));
+    if (0xFF == slot) {
+        if (0xFF == victim) return false;
+        slot = victim;
+        S7XG_DEBUG(F("-- uplink dropped to make room\n"));
+        _link.dropped++;
+        if (_tx_callback) _tx_callback(false, _tx_arg);
+        s7xg_uplink_t & dropped = _uplinks[victim];
+        s7xg_delivery_t delivery = { 0, dropped.port, S7XG_DELIVERY_DROPPED, dropped.attempts, 0, dropped.data, dropped.len };
+        if (_delivery_callback) _delivery_callback(delivery, _delivery_arg);
+    }
 
-    
-    return message;
+    s7xg_uplink_t & uplink = _uplinks[slot];
+    memcpy(uplink.data, data, len);
+    uplink.len = len;
+    uplink.port = port;
+    uplink.priority = replace && (uplink.priority > priority) ? uplink.priority : priority;
+    uplink.flags = flags;
+    if (!replace) uplink.sequence = _uplink_sequence++;
+    uplink.attempts = 0;
+    _uplink_used |= (1 << slot);
+    return true;
+
+}
+
+/**
+ * @brief               Number of uplinks waiting in the queue (including the one being sent)
+ * @return              Frame count
+ */
+uint8_t S7XG::macQueued() {
+    uint8_t count = 0;
+    for (uint8_t i=0; i<S7XG_UPLINK_QUEUE_SIZE; i++) {
+        if (_uplink_used & (1 << i)) count++;
+    }
+    return count;
+}
+
+/**
+ * @brief               Drops every queued uplink but the one being sent and the ones waiting for an ACK
+ */
+void S7XG::macClearQueue() {
+    _uplink_used &= _uplink_waiting | ((0xFF == _uplink_sending) ? 0 : (1 << _uplink_sending));
+}
+
+/**
+ * @brief               Sets the minimum time between two queued uplinks
+ * @param[in] ms        Milliseconds from an accepted uplink to the next one (defaults to 0)
+ */
+void S7XG::setUplinkInterval(uint32_t ms) {
+    _uplink_interval = ms;
+}
+
+// ----------------------------------------------------------------------------
+// Confirmed uplinks
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Sets the function to call with the outcome of every confirmed uplink
+ * @details             Each confirmed uplink the module accepts is tagged with its frame counter and matched
+ *                      with the tx_ok, downlink or err that follows (results come in order), or times out.
+ *                      Queued uplinks (macQueue with S7XG_UPLINK_CONFIRMED) that are not acknowledged are
+ *                      sent again as per setConfirmPolicy and only reported once acknowledged or given up.
+ * @param[in] callback  Function to call, receives the delivery report (NULL to disable)
+ * @param[in] arg       Argument passed to the callback (defaults to NULL)
+ */
+void S7XG::onDelivery(s7xg_delivery_callback_t callback, void * arg) {
+    _delivery_callback = callback;
+    _delivery_arg = arg;
+}
+
+/**
+ * @brief               Sets what to do with queued confirmed uplinks that are not acknowledged
+ * @param[in] retries   Times a queued uplink is sent again before giving up (S7XG_CONFIRM_RETRIES by default)
+ * @param[in] timeout   Milliseconds to wait for the result of an uplink (defaults to S7XG_CONFIRM_TIMEOUT),
+ *                      leave room for the retransmissions the module does itself (see macRetries)
+ */
+void S7XG::setConfirmPolicy(uint8_t retries, uint32_t timeout) {
+    _confirm_retries = retries;
+    _confirm_timeout = timeout;
+}
+
+/**
+ * @brief               Number of uplinks accepted by the module and waiting for their result
+ * @return              Uplink count
+ */
+uint8_t S7XG::macInFlight() {
+    return _inflight_count;
+}
+
+// ----------------------------------------------------------------------------
+// Airtime
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Airtime the duty cycle still allows
+ * @details             The budget is the band duty cycle over one hour (36 seconds for 1%), refilled
+ *                      continuously and spent by every uplink the module accepts, at the last data rate
+ *                      set (the slowest one until set, the module might change it if ADR is on).
+ *                      The band comes from macBand(), call it once: until then 1% is assumed.
+ * @return              Microseconds (0xFFFFFFFF if the band has no duty cycle limit)
+ */
+uint32_t S7XG::airtimeBudget() {
+    _refill();
+    return _budget;
+}
+
+/**
+ * @brief               Predicts when an uplink will fit in the duty cycle budget
+ * @param[in] len       Application payload length
+ * @return              Milliseconds from now, 0 if it can go now
+ */
+uint32_t S7XG::nextUplinkIn(uint8_t len) {
+    _refill();
+    uint32_t airtime = _airtime(len);
+    if (airtime <= _budget) return 0;
+    uint16_t duty = dutyCycle(_band ? _band : 868);
+    return (airtime - _budget + duty - 1) / duty;
+}
+
+/**
+ * @brief               Largest number of uplinks of the given length the budget allows right now
+ * @param[in] len       Application payload length
+ * @return              Number of uplinks (up to 255)
+ */
+uint8_t S7XG::uplinksInBudget(uint8_t len) {
+    _refill();
+    uint32_t count = _budget / _airtime(len);
+    return (count > 0xFF) ? 0xFF : count;
+}
+
+// ----------------------------------------------------------------------------
+// GPS
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Inits the GPS into manual mode
+ * @return              True if everything OK
+ */
+bool S7XG::gpsInit() {
+    uint8_t batch = _openBatch();
+    _sendAndCache(GPS_SET_LEVEL_SHIFT, true);
+    _sendAndCache(GPS_SET_START, "hot");
+    _sendAndCache(GPS_SET_SATELLITE_SYSTEM, "gps");
+    _sendAndCache(GPS_SET_NMEA, "rmc");
+    _sendAndCache(GPS_SET_POSITIONING_CYCLE, 5000);
+    gpsMode(S7XG_GPS_MODE_MANUAL);
+    return _closeBatch(batch);
+}
+
+/**
+ * @brief               Sets the auto uplink port
+ * @param[in] port      Port to send messages to when in auto mode
+ * @return              True if everything OK
+ */
+bool S7XG::gpsPort(uint8_t port) {
+    return _sendAndCache(GPS_SET_PORT_UPLINK, port);
+}
+
+/**
+ * @brief               Sets the auto uplink format
+ * @param[in] format    One of S7XG_GPS_FORMAT_RAW, S7XG_GPS_FORMAT_IPSO, S7XG_GPS_FORMAT_KIWI or S7XG_GPS_FORMAT_UTC_POS
+ * @return              True if everything OK
+ */
+bool S7XG::gpsFormat(uint8_t format) {
+    return _sendAndCache(GPS_SET_FORMAT_UPLINK, 
+        format == S7XG_GPS_FORMAT_RAW ? "raw" : 
+        format == S7XG_GPS_FORMAT_IPSO ? "ipso" : 
+        format == S7XG_GPS_FORMAT_KIWI ? "kiwi" : 
+        "utc_pos");
+}
+
+/**
+ * @brief               Sets the GPS positioning cycle
+ * @param[in] seconds   Seconds between GPS updates
+ * @return              True if everything OK
+ */
+bool S7XG::gpsCycle(uint32_t seconds) {
+    return _sendAndCache(GPS_SET_POSITIONING_CYCLE, seconds * 1000UL);
+}
+
+/**
+ * @brief               Gets the GPS mode
+ * @param[in] mode      One of S7XG_GPS_MODE_IDLE, S7XG_GPS_MODE_MANUAL or S7XG_GPS_MODE_AUTO
+ * @return              True if everything OK
+ */
+bool S7XG::gpsMode(uint8_t mode) {
+    
+    if (mode > S7XG_GPS_MODE_AUTO) mode = S7XG_GPS_MODE_AUTO;
+    _gps_auto = (S7XG_GPS_MODE_AUTO == mode);
+    _wait_longer = true;
+    return _sendAndCache(GPS_SET_MODE, S7XG_GPS_MODES[mode]);
+    
+}
+
+/**
+ * @brief               Sets the NMEA sentences the GPS outputs on the serial line
+ * @details             The sentences arrive between command answers and are decoded as they are read,
+ *                      without sending any command (see gpsFix and onGpsFix). RMC, GGA, GSA and GSV are decoded.
+ * @param[in] sentences Sentences to output, like "rmc" (see the module manual)
+ * @return              True if everything OK
+ */
+bool S7XG::gpsNmea(const char * sentences) {
+    return _sendAndCache(GPS_SET_NMEA, sentences);
+}
+
+/**
+ * @brief               Last fix decoded from the NMEA output
+ * @details             Built from every valid RMC, GGA, GSA and GSV sentence received so far,
+ *                      check the valid field (S7XG_NMEA_VALID_*) before using the values.
+ * @return              Fix data
+ */
+const gps_fix_t & S7XG::gpsFix() {
+    return _nmea.fix();
+}
+
+/**
+ * @brief               Gets the data from the GPS in manual mode
+ * @return              gps_message_t object with the data (see gpsParse)
+ */
+gps_message_t S7XG::gpsData() {
+    gps_message_t message;
+    gpsParse(_sendAndReturn(GPS_GET_DATA), message);
+    return message;
+}
+
+/**
+ * @brief               Parses a "gps get_data dd" response
+ * @details             Single pass, does not modify the line and does not use floating point parsing,
+ *                      so it can be called from an async callback. Possible responses are:
+ *                      "DD UTC( 2019/09/02 12:33:34 ) LAT( 41.601215 N ) LONG( 2.622485 E ) POSITIONING( 3.6s )",
+ *                      "POSITIONING( 14.8s )", "gps_not_init" and "gps_in_idle".
+ * @param[in] line      Response from the module (can be NULL)
+ * @param[out] message  Parsed data, all fields are reset first
+ * @return              One of the S7XG_GPS_STATUS_* values (also stored in message.status)
+ */
+uint8_t S7XG::gpsParse(const char * line, gps_message_t & message) {
+
+    memset(&message, 0, sizeof(message));
+    message.status = S7XG_GPS_STATUS_MALFORMED;
+
+    if (!line || !line[0]) return message.status = S7XG_GPS_STATUS_NO_RESPONSE;
+    if (0 == strcmp(line, "gps_not_init")) return message.status = S7XG_GPS_STATUS_NOT_INIT;
+    if (0 == strcmp(line, "gps_in_idle")) return message.status = S7XG_GPS_STATUS_IDLE;
+
+    const char * p = line;
+    uint32_t value;
+
+    if (_parseToken(p, "DD")) {
+
+        // Date and time
+        uint32_t date[6];
+        if (!_parseToken(p, "UTC(")) return message.status;
+        for (uint8_t i=0; i<6; i++) {
+            if (!_parseUnsigned(p, date[i])) return message.status;
+            if ((i < 5) && (*p != (i < 2 ? '/' : (i == 2 ? ' ' : ':')))) return message.status;
+            if (i < 5) p++;
+        }
+        if (!_parseToken(p, ")")) return message.status;
+        message.year = date[0];
+        message.month = date[1];
+        message.day = date[2];
+        message.hour = date[3];
+        message.minute = date[4];
+        message.second = date[5];
+        message.valid |= S7XG_GPS_VALID_TIME;
+
+        // Latitude
+        if (!_parseToken(p, "LAT(") || !_parseFixed(p, 6, value)) return message.status;
+        if (_parseToken(p, "S")) {
+            message.latitude_e6 = -(int32_t) value;
+        } else if (_parseToken(p, "N")) {
+            message.latitude_e6 = value;
+        } else {
+            return message.status;
+        }
+        if (!_parseToken(p, ")")) return message.status;
+
+        // Longitude
+        if (!_parseToken(p, "LONG(") || !_parseFixed(p, 6, value)) return message.status;
+        if (_parseToken(p, "W")) {
+            message.longitude_e6 = -(int32_t) value;
+        } else if (_parseToken(p, "E")) {
+            message.longitude_e6 = value;
+        } else {
+            return message.status;
+        }
+        if (!_parseToken(p, ")")) return message.status;
+        message.valid |= S7XG_GPS_VALID_POSITION;
+
+        message.latitude = message.latitude_e6 / 1e6f;
+        message.longitude = message.longitude_e6 / 1e6f;
+
+    }
+
+    // Positioning time
+    if (!_parseToken(p, "POSITIONING(") || !_parseFixed(p, 3, value)) return message.status;
+    if (!_parseToken(p, "s") || !_parseToken(p, ")")) return message.status;
+    message.positioning_ms = value;
+    message.positioning = value / 1000.0f;
+    message.valid |= S7XG_GPS_VALID_POSITIONING;
+
+    message.fix = (message.valid & S7XG_GPS_VALID_POSITION);
+    return message.status = S7XG_GPS_STATUS_OK;
 
 }
 
@@ -526,7 +1469,7 @@ bool S7XG::gpsReset() {
  * @return              True if everything OK
  */
 bool S7XG::gpsSystem(uint8_t system) {
-    return _sendAndACK(GPS_SET_SATELLITE_SYSTEM, system == S7XG_GPS_SYSTEM_GPS ? "gps" : "hybrid");
+    return _sendAndCache(GPS_SET_SATELLITE_SYSTEM, system == S7XG_GPS_SYSTEM_GPS ? "gps" : "hybrid");
 }
 
 /**
@@ -535,7 +1478,7 @@ bool S7XG::gpsSystem(uint8_t system) {
  * @return              True if everything OK
  */
 bool S7XG::gpsStart(uint8_t mode) {
-    return _sendAndACK(GPS_SET_START, 
+    return _sendAndCache(GPS_SET_START, 
         mode == S7XG_GPS_START_HOT ? "hot" : 
         mode == S7XG_GPS_START_WARM ? "warm" : 
         "cold");
@@ -562,69 +1505,255 @@ uint8_t * S7XG::unhexlify(char * source, uint8_t * destination, uint8_t len) {
 /**
  * @brief                   Turns a byte array into and hexa-string
  * @param[in] source        Byte array to store the values to, { 0x01, 0x3D, 0x45 } for the example above
- * @param[out] destination  Hexa-string like "013D45" (must have len*2 positions)
+ * @param[out] destination  Hexa-string like "013D45" (must have len*2+1 positions)
  * @param[in] len           Size of the byte array
  * @return                  Pointer to the destination
  */
-char * S7XG::hexlify(uint8_t * source, char * destination, uint8_t len) {
+char * S7XG::hexlify(const uint8_t * source, char * destination, uint8_t len) {
     for (uint8_t i=0; i<len; i++) {
-        snprintf(&destination[i*2], 3, "%02X", source[i]);
+        destination[i*2] = S7XG_HEX_DIGITS[source[i] >> 4];
+        destination[i*2+1] = S7XG_HEX_DIGITS[source[i] & 0x0F];
     }
+    destination[len*2] = 0;
     return destination;
 }
 
+// ----------------------------------------------------------------------------
+// Command builder
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Starts a command in the given buffer
+ * @param[out] buffer   Buffer to write the command to
+ * @param[in] size      Size of the buffer, including the terminating null
+ * @param[in] name      PROGMEM command name
+ */
+S7XGBuilder::S7XGBuilder(char * buffer, size_t size, PGM_P name) : _buffer(buffer), _size(size) {
+    size_t len = strlen_P(name);
+    if (_room(len)) {
+        memcpy_P(_buffer, name, len);
+        _length = len;
+    }
+    _buffer[_length] = 0;
+}
+
+/**
+ * @brief               Appends an unsigned integer in decimal
+ * @param[in] value     Value
+ * @return              The builder
+ */
+S7XGBuilder & S7XGBuilder::operator<<(uint32_t value) {
+    char digits[10];
+    uint8_t count = 0;
+    do {
+        digits[sizeof(digits) - ++count] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    _write(&digits[sizeof(digits) - count], count);
+    return *this;
+}
+
+/**
+ * @brief               Appends an unsigned byte in decimal
+ * @param[in] value     Value
+ * @return              The builder
+ */
+S7XGBuilder & S7XGBuilder::operator<<(uint8_t value) {
+    return *this << (uint32_t) value;
+}
+
+/**
+ * @brief               Appends an unsigned 16 bits integer in decimal
+ * @param[in] value     Value
+ * @return              The builder
+ */
+S7XGBuilder & S7XGBuilder::operator<<(uint16_t value) {
+    return *this << (uint32_t) value;
+}
+
+/**
+ * @brief               Appends a single character
+ * @param[in] value     Character
+ * @return              The builder
+ */
+S7XGBuilder & S7XGBuilder::operator<<(char value) {
+    _write(&value, 1);
+    return *this;
+}
+
+/**
+ * @brief               Appends a c-string
+ * @param[in] value     C-string (NULL is written as an empty argument)
+ * @return              The builder
+ */
+S7XGBuilder & S7XGBuilder::operator<<(const char * value) {
+    _write(value, value ? strlen(value) : 0);
+    return *this;
+}
+
+/**
+ * @brief               Appends "on" or "off"
+ * @param[in] value     Flag
+ * @return              The builder
+ */
+S7XGBuilder & S7XGBuilder::operator<<(S7XGOnOff value) {
+    _write(value.value ? "on" : "off", value.value ? 2 : 3);
+    return *this;
+}
+
+/**
+ * @brief               Appends a byte as two uppercase hex digits
+ * @param[in] value     Byte
+ * @return              The builder
+ */
+S7XGBuilder & S7XGBuilder::operator<<(S7XGHex8 value) {
+    char digits[2] = { S7XG_HEX_DIGITS[value.value >> 4], S7XG_HEX_DIGITS[value.value & 0x0F] };
+    _write(digits, 2);
+    return *this;
+}
+
+/**
+ * @brief               Checks if any part of the command did not fit in the buffer
+ * @return              True if the command is incomplete
+ */
+bool S7XGBuilder::overflow() {
+    return _overflow;
+}
+
+/**
+ * @brief               Checks there is room for more characters, flags the overflow if not
+ * @param[in] len       Number of characters
+ * @return              True if they fit
+ */
+bool S7XGBuilder::_room(size_t len) {
+    if (_length + len < _size) return true;
+    _overflow = true;
+    return false;
+}
+
+/**
+ * @brief               Appends an argument separated by a space
+ * @param[in] data      Characters to append
+ * @param[in] len       Number of characters
+ */
+void S7XGBuilder::_write(const char * data, size_t len) {
+    if (!_room(len + 1)) return;
+    _buffer[_length++] = ' ';
+    memcpy(&_buffer[_length], data, len);
+    _length += len;
+    _buffer[_length] = 0;
+}
+
 // ----------------------------------------------------------------------------
 // Private
 // ----------------------------------------------------------------------------
 
 /**
- * @brief               Flushes the serial line
+ * @brief               Reads whatever is available from the stream in one go
+ * @details             Only reads when the previous chunk has been consumed, never blocks.
+ * @return              True if there are unprocessed bytes
  */
-void S7XG::_flush() {
-    while (_stream->available()) _stream->read();
+bool S7XG::_fill() {
+    if (_rx_position < _rx_length) return true;
+    _rx_position = _rx_length = 0;
+    int count = _stream->available();
+    if (count <= 0) return false;
+    if (count > S7XG_RX_CHUNK_SIZE) count = S7XG_RX_CHUNK_SIZE;
+    _rx_length = _stream->readBytes(_rx, count);
+    _link.bytes_received += _rx_length;
+    return _rx_length > 0;
 }
 
 /**
- * @brief               Reads a line from the module
+ * @brief               Reads available characters from the module without blocking
  * @details             Stores in the internal buffer from the first ">> " to the next 0x0A.
- * @return              Number of characters in the buffer
+ *                      Trailing carriage returns are discarded. Lines longer than the buffer
+ *                      are cut and flagged as overflown, the rest of the line is discarded.
+ *                      Lines starting with '$' are NMEA sentences, they are fed to the NMEA
+ *                      parser straight from the receive chunk and never reach the buffer.
+ * @return              True if a full line is available in the buffer
  */
-uint8_t S7XG::_readLine() {
-
-    _buffer[0] = 0;
-    uint8_t pointer = 0;
-    uint8_t flag = 0;
-    uint32_t start = millis();
-    uint32_t timeout = _wait_longer ? S7XG_LONG_TIMEOUT : S7XG_SHORT_TIMEOUT;
-    _wait_longer = false;
+bool S7XG::_readLine() {
+
+    while (_fill()) {
+
+        char * start = &_rx[_rx_position];
+        uint8_t size = _rx_length - _rx_position;
+
+        // Looking for the ">> " prompt or the start of an NMEA sentence
+        if (0 == _rx_flag) {
+            char * prompt = (char *) memchr(start, '>', size);
+            char * nmea = (char *) memchr(start, '$', prompt ? prompt - start : size);
+            if (nmea) {
+                _rx_position = nmea - _rx;
+                _link.bytes_discarded += nmea - start;
+                _rx_flag = 4;
+                continue;
+            }
+            _rx_position = prompt ? prompt - _rx + 1 : _rx_length;
+            _link.bytes_discarded += prompt ? prompt - start : size;
+            if (prompt) _rx_flag = 1;
+            continue;
+        }
 
-    while (millis() - start < timeout) {
-        if (_stream->available()) {
-            uint8_t ch = _stream->read();
-
-            #if defined(S7XG_DEBUG_SERIAL)
-                if ((31 < ch) && (ch < 127)) {
-                    char ch_buff[6];
-                    snprintf(ch_buff, sizeof(ch_buff), "%c", ch);
-                    S7XG_DEBUG(ch_buff);
+        // Decoding an NMEA sentence up to the line feed
+        if (4 == _rx_flag) {
+            char * end = (char *) memchr(start, 0x0A, size);
+            uint8_t len = end ? end - start + 1 : size;
+            for (uint8_t i=0; i<len; i++) {
+                uint8_t type = _nmea.feed(start[i]);
+                if (S7XG_NMEA_NONE == type) continue;
+                if (S7XG_NMEA_ERROR == type) {
+                    _link.nmea_errors++;
+                    continue;
                 }
-            #endif
-            
-            if (flag > 2) {
-                if (0x0A == ch) break;
-                _buffer[pointer++] = ch;
-                _buffer[pointer] = 0;
-                if (S7XG_RX_BUFFER_SIZE == pointer - 1) break;
-            } else if (flag == 2) {
-                flag = (' ' == ch) ? flag + 1 : 0;
+                _link.nmea_sentences++;
+                if ((S7XG_NMEA_RMC == type) || (S7XG_NMEA_GGA == type)) _gps_fresh = true;
+            }
+            _rx_position += len;
+            if (end) _rx_flag = 0;
+            continue;
+        }
+        if (_rx_flag < 3) {
+            char ch = _rx[_rx_position++];
+            uint8_t flag = _rx_flag;
+            if (1 == _rx_flag) {
+                _rx_flag = ('>' == ch) ? 2 : 0;
             } else {
-                flag = ('>' == ch) ? flag + 1 : 0;
+                _rx_flag = (' ' == ch) ? 3 : ('>' == ch) ? 2 : 0;
+            }
+            if (0 == _rx_flag) _link.bytes_discarded += flag + 1;
+            if (3 == _rx_flag) {
+                _rx_pointer = 0;
+                _rx_overflow = false;
+                _buffer[0] = 0;
             }
+            continue;
         }
+
+        // Copying the line up to the line feed
+        char * end = (char *) memchr(start, 0x0A, size);
+        uint8_t len = end ? end - start : size;
+        uint16_t room = S7XG_RX_BUFFER_SIZE - 1 - _rx_pointer;
+        if (len > room) _rx_overflow = true;
+        uint16_t copy = (len < room) ? len : room;
+        _link.bytes_discarded += len - copy;
+        memcpy(&_buffer[_rx_pointer], start, copy);
+        _rx_pointer += copy;
+        _rx_position += end ? len + 1 : len;
+
+        if (end) {
+            while ((_rx_pointer > 0) && (0x0D == _buffer[_rx_pointer - 1])) _rx_pointer--;
+            _buffer[_rx_pointer] = 0;
+            _rx_flag = 0;
+            if (_rx_overflow) _link.overflows++;
+            S7XG_DEBUG(F(">> ")); S7XG_DEBUG(_buffer); S7XG_DEBUG(F("\n"));
+            return true;
+        }
+
     }
-    S7XG_DEBUG(F("\n"));
 
-    return pointer;
+    return false;
 
 }
 
@@ -634,65 +1763,1196 @@ uint8_t S7XG::_readLine() {
  */
 template<typename T> void S7XG::_send(T * s) {
     S7XG_DEBUG(F("<< ")); S7XG_DEBUG(s); S7XG_DEBUG(F("\n"));
-    _stream->print(s);
+    _link.bytes_sent += _stream->print(s);
 }
 
 /**
- * @brief               Sends a C-string to the module and returns a pointer to the answer
- * @param[in] s         Command to send
- * @return              Pointer to the internal buffer with the answer
+ * @brief               Hex-encodes a byte array straight into the stream
+ * @details             Uses a small stack buffer so the payload size does not depend on S7XG_TX_BUFFER_SIZE.
+ * @param[in] data      Byte array
+ * @param[in] len       Length of the byte array
+ */
+void S7XG::_sendHex(const uint8_t * data, uint8_t len) {
+    char chunk[S7XG_HEX_CHUNK_SIZE * 2 + 1];
+    while (len) {
+        uint8_t size = (len < S7XG_HEX_CHUNK_SIZE) ? len : S7XG_HEX_CHUNK_SIZE;
+        hexlify(data, chunk, size);
+        S7XG_DEBUG(chunk);
+        _link.bytes_sent += _stream->write((const uint8_t *) chunk, size * 2);
+        data += size;
+        len -= size;
+    }
+    S7XG_DEBUG(F("\n"));
+}
+
+/**
+ * @brief               Builds and sends a command to the module and returns a pointer to the answer
+ * @param[in] command   Command
+ * @param[in] args      Command arguments
+ * @return              Pointer to the internal buffer with the answer (NULL if queued or error)
  */
-template<typename T> char * S7XG::_sendAndReturn(T * s) {
-    _flush();
-    _send(s);
-    _readLine();
+template<typename... A> char * S7XG::_sendAndReturn(const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args) {
+    uint16_t id = _submit(0, NULL, NULL, command, args...);
+    if (!id || _group) return NULL;
+    _wait(id);
     return _buffer;
 }
 
 /**
  * @brief               Builds and sends a command to the module
- * @param[in] format_P  PROGMEM format string
- * @param[in] ...       Any values to set the placeholders to
- * @return              True if the module answered "Ok"
+ * @param[in] command   Command
+ * @param[in] args      Command arguments
+ * @return              True if the module answered "Ok" (or if the command has been queued)
+ */
+template<typename... A> bool S7XG::_sendAndACK(const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args) {
+    uint8_t flags = _wait_longer ? S7XG_JOB_LONG : 0;
+    _wait_longer = false;
+    return _sendAndExpect(flags, "Ok", NULL, command, args...);
+}
+
+/**
+ * @brief               Builds and sends a setter command to the module unless it already has that value
+ * @details             The value is remembered once the module answers "Ok" and forgotten if it fails.
+ *                      Setters are keyed by their command name, so for per-channel setters only the last
+ *                      channel set is remembered.
+ * @param[in] command   Setter command
+ * @param[in] args      Command arguments
+ * @return              True if the module answered "Ok", already had the value (or if the command has been queued)
+ */
+template<typename... A> bool S7XG::_sendAndCache(const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args) {
+    uint8_t flags = S7XG_JOB_CACHE | (_wait_longer ? S7XG_JOB_LONG : 0);
+    _wait_longer = false;
+    return _sendAndExpect(flags, "Ok", NULL, command, args...);
+}
+
+/**
+ * @brief               Builds and sends a command to the module and checks the answer
+ * @param[in] flags     Any combination of S7XG_JOB_* flags
+ * @param[in] expect    Expected answer (NULL to accept any answer)
+ * @param[in] then      Expected second answer (NULL if the command only has one)
+ * @param[in] command   Command
+ * @param[in] args      Command arguments
+ * @return              True if the module answered as expected (or if the command has been queued)
+ */
+template<typename... A> bool S7XG::_sendAndExpect(uint8_t flags, const char * expect, const char * then, const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args) {
+    uint16_t id = _submit(flags, expect, then, command, args...);
+    if (!id) return false;
+    if (_group && !(flags & S7XG_JOB_SYNC)) return true;
+    return _wait(id);
+}
+
+/**
+ * @brief               Reads a setting from the module and only writes it if it has a different value
+ * @details             A value already in the cache is not read again, a matching value is added to it.
+ *                      Honours _wait_longer for the write.
+ * @param[out] changed  Set to true if the setting had to be written
+ * @param[in] get       Getter command
+ * @param[in] set       Setter command, the value must be its last argument
+ * @param[in] args      Setter arguments
+ * @return              True if the module has the value
  */
-bool S7XG::_sendAndACK(PGM_P format_P, ...) {
+template<typename... A> bool S7XG::_apply(bool & changed, const S7XGCommand<> & get, const S7XGCommand<A...> & set, typename S7XGArg<A>::type... args) {
 
-    char format[strlen_P(format_P) + 1];
-    memcpy_P(format, format_P, sizeof(format));
+    bool longer = _wait_longer;
+    _wait_longer = false;
 
-    va_list args;
-    va_start(args, format_P);
     char command[S7XG_TX_BUFFER_SIZE];
-    int len = vsnprintf(command, sizeof(command), format, args);
-    va_end(args);
+    if (!_build(command, sizeof(command), set, args...)) return false;
+    const char * value = strrchr(command, ' ');
+    value = value ? value + 1 : command;
+
+    if (_cached(set.name, command)) return true;
+    if (_sendAndExpect(S7XG_JOB_SYNC, NULL, NULL, get) && (0 == strcasecmp(_buffer, value))) {
+        _cache(set.name, command, true);
+        return true;
+    }
+
+    changed = true;
+    _wait_longer = longer;
+    return _sendAndCache(set, args...);
+
+}
+
+/**
+ * @brief               Writes a command and its arguments to a buffer
+ * @param[out] buffer   Buffer
+ * @param[in] size      Size of the buffer
+ * @param[in] command   Command
+ * @param[in] args      Command arguments
+ * @return              True if the command fits in the buffer
+ */
+template<typename... A> bool S7XG::_build(char * buffer, size_t size, const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args) {
+    S7XGBuilder builder(buffer, size, command.name);
+    int unpack[] = { 0, ((builder << args), 0)... };
+    (void) unpack;
+    return !builder.overflow();
+}
 
-    if (len < S7XG_TX_BUFFER_SIZE) {
-        _flush();
-        _send(command);
-        _readLine();
-        return 0 == strcmp(_buffer, "Ok");
+/**
+ * @brief               Builds a command and adds it to the queue
+ * @details             Blocks until there is room in the queue unless inside an async call.
+ *                      The command is written straight into the queue slot.
+ * @param[in] flags     Job flags
+ * @param[in] expect    Expected answer (NULL to accept any answer)
+ * @param[in] then      Expected second answer (NULL if the command only has one)
+ * @param[in] command   Command
+ * @param[in] args      Command arguments
+ * @return              Job ID or 0 if error
+ */
+template<typename... A> uint16_t S7XG::_submit(uint8_t flags, const char * expect, const char * then, const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args) {
+    s7xg_job_t * job = _reserve(flags);
+    if (!job) return 0;
+    bool built = _build(job->command, sizeof(job->command), command, args...);
+    return _commit(job, flags, expect, then, command.name, built);
+}
+
+/**
+ * @brief               Gets the next free slot in the queue
+ * @details             Blocks until there is room in the queue unless inside an async call.
+ *                      Takes the payload set with _payload.
+ * @param[in] flags     Job flags
+ * @return              Pointer to the slot or NULL if the queue is full
+ */
+s7xg_job_t * S7XG::_reserve(uint8_t flags) {
+
+    bool async = _group && !(flags & S7XG_JOB_SYNC);
+    const uint8_t * payload = _payload;
+    uint8_t payload_len = _payload_len;
+    bool confirmed = _payload_confirmed;
+    uint8_t slot = _payload_slot;
+    _payload = NULL;
+    _payload_confirmed = false;
+    _payload_slot = 0xFF;
+
+    if (S7XG_QUEUE_SIZE == _job_count) {
+        if (async && !_group_blocking) {
+            _group_failed = true;
+            return NULL;
+        }
+        while (S7XG_QUEUE_SIZE == _job_count) {
+            loop();
+            _idle();
+        }
     }
-    return false;
+
+    s7xg_job_t * job = &_jobs[(_job_head + _job_count) % S7XG_QUEUE_SIZE];
+    job->payload = payload;
+    job->payload_len = payload_len;
+    job->port = _payload_port;
+    job->confirmed = confirmed;
+    job->slot = slot;
+    return job;
 
 }
 
 /**
- * @brief               Returns the decimal value for an alphanumeric value
- * @param[in] ch        Alfanumeric value [0-9a-fA-F]
- * @return              Decimal value or 0 if error
+ * @brief               Adds the job in the reserved slot to the queue
+ * @param[in] job       Slot returned by _reserve with the command already written
+ * @param[in] flags     Job flags
+ * @param[in] expect    Expected answer (NULL to accept any answer)
+ * @param[in] then      Expected second answer (NULL if the command only has one)
+ * @param[in] name      PROGMEM command name
+ * @param[in] built     False if the command did not fit in the slot
+ * @return              Job ID or 0 if error
  */
-uint8_t S7XG::_nibble(char ch) {
-    if ('0' <= ch && ch <= '9') return ch - '0';
-    if ('a' <= ch && ch <= 'f') return ch - 'a' + 10;
-    if ('A' <= ch && ch <= 'F') return ch - 'A' + 10;
-    return 0;
+uint16_t S7XG::_commit(s7xg_job_t * job, uint8_t flags, const char * expect, const char * then, PGM_P name, bool built) {
+
+    bool async = _group && !(flags & S7XG_JOB_SYNC);
+    if (!built) {
+        if (async) _group_failed = true;
+        return 0;
+    }
+
+    if (0 == ++_job_id) _job_id = 1;
+    job->id = _job_id;
+    job->group = async ? _group : 0;
+    job->flags = flags;
+    job->expect = expect;
+    job->then = then;
+    job->callback = async ? _group_callback : NULL;
+    job->arg = async ? _group_arg : NULL;
+    job->name = name;
+    job->kind = _kind(job->command);
+    _job_count++;
+
+    return job->id;
+
 }
 
 /**
- * @brief                   Non-blocking delay
- * @param[in] ms            Milliseconds to delay
+ * @brief               Sends the job at the head of the queue, unless it sets a value the module already has
  */
-void S7XG::_nice_delay(uint32_t ms) {
-    uint32_t start = millis();
-    while (millis() - start < ms) delay(1);
+void S7XG::_start() {
+
+    s7xg_job_t * job = &_jobs[_job_head];
+    if ((job->flags & S7XG_JOB_CACHE) && _cached(job->name, job->command)) {
+        strcpy(_buffer, "Ok");
+        _done(S7XG_STATUS_OK);
+        return;
+    }
+
+    _send(job->command);
+    if (job->payload) {
+        _link.bytes_sent += _stream->write(' ');
+        _sendHex(job->payload, job->payload_len);
+    }
+    _job_step = S7XG_STEP_REPLY;
+    _job_start = millis();
+    _job_sent = micros();
+
+}
+
+/**
+ * @brief               Sends the next queued uplink when the module can take it
+ * @details             Waits for the result of the previous uplink (for S7XG_TIMEOUT_CEILING at most,
+ *                      in case it got lost), the uplink interval or backoff and room in the command queue.
+ */
+void S7XG::_schedule() {
+
+    if (0xFF != _uplink_sending) return;
+    if (_group || (S7XG_QUEUE_SIZE == _job_count)) return;
+    if (_tx_pending && (millis() - _tx_sent < _timeout_ceiling)) return;
+    if ((int32_t) (millis() - _uplink_ready) < 0) return;
+
+    uint8_t next = 0xFF;
+    for (uint8_t i=0; i<S7XG_UPLINK_QUEUE_SIZE; i++) {
+        if (!(_uplink_used & ~_uplink_waiting & (1 << i))) continue;
+        if ((0xFF == next) || (_uplinks[i].priority > _uplinks[next].priority) ||
+            ((_uplinks[i].priority == _uplinks[next].priority) && ((int16_t) (_uplinks[i].sequence - _uplinks[next].sequence) < 0))) {
+            next = i;
+        }
+    }
+    if (0xFF == next) return;
+    if (0 != nextUplinkIn(_uplinks[next].len)) return;
+
+    _uplink_sending = next;
+    s7xg_uplink_t & uplink = _uplinks[next];
+
+    // Confirmed uplinks are tagged with the frame counter, read it first if it is not known
+    if ((uplink.flags & S7XG_UPLINK_CONFIRMED) && !_upcnt_valid) {
+        async(_counterRead, this)->_sendAndExpect(0, NULL, NULL, MAC_GET_UPCNT);
+        return;
+    }
+
+    _payload_slot = next;
+    async(_uplinkDone, this)->macSend(uplink.data, uplink.len, uplink.flags & S7XG_UPLINK_CONFIRMED, uplink.port);
+
+}
+
+/**
+ * @brief               Time on air of an uplink with the current band and data rate
+ * @param[in] len       Application payload length
+ * @return              Microseconds
+ */
+uint32_t S7XG::_airtime(uint8_t len) {
+    return uplinkAirtime(_band ? _band : 868, (0xFF == _dr) ? 0 : _dr, len);
+}
+
+/**
+ * @brief               Adds the airtime earned since the last call to the duty cycle budget
+ */
+void S7XG::_refill() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - _budget_updated;
+    _budget_updated = now;
+    uint16_t duty = dutyCycle(_band ? _band : 868);
+    if (duty >= 1000) {
+        _budget = 0xFFFFFFFF;
+        return;
+    }
+    uint32_t capacity = S7XG_DUTY_CYCLE_WINDOW * duty;
+    if (elapsed > S7XG_DUTY_CYCLE_WINDOW) elapsed = S7XG_DUTY_CYCLE_WINDOW;
+    uint32_t earned = elapsed * duty;
+    _budget = (_budget > capacity - earned) ? capacity : _budget + earned;
+}
+
+/**
+ * @brief               Called when the module answers a queued uplink
+ * @param[in] status    Command status
+ * @param[in] response  Module response
+ * @param[in] arg       Module object
+ */
+void S7XG::_uplinkDone(uint8_t status, char * response, void * arg) {
+
+    S7XG * module = (S7XG *) arg;
+    uint8_t slot = module->_uplink_sending;
+    module->_uplink_sending = 0xFF;
+    if (0xFF == slot) return;
+
+    // Refused for now, try again later
+    bool retry = (S7XG_STATUS_TIMEOUT == status) || (0 == strcmp(response, "busy")) ||
+        (0 == strcmp(response, "no_free_ch")) || (0 == strcmp(response, "not_joined"));
+    if ((S7XG_STATUS_OK != status) && retry) {
+        module->_uplink_ready = millis() + module->_uplink_backoff;
+        module->_uplink_backoff = (module->_uplink_backoff < S7XG_UPLINK_BACKOFF_MAX / 2) ?
+            module->_uplink_backoff * 2 : S7XG_UPLINK_BACKOFF_MAX;
+        return;
+    }
+
+    module->_uplink_backoff = S7XG_UPLINK_BACKOFF;
+    module->_uplink_ready = millis() + module->_uplink_interval;
+
+    // Confirmed uplinks stay in the queue until acknowledged (see _resolve)
+    if ((S7XG_STATUS_OK == status) && (module->_uplink_waiting & (1 << slot))) return;
+
+    module->_uplink_used &= ~(1 << slot);
+    if ((S7XG_STATUS_OK != status) && module->_tx_callback) module->_tx_callback(false, module->_tx_arg);
+
+}
+
+/**
+ * @brief               Called with the frame counter read before sending a queued confirmed uplink
+ * @param[in] status    Command status
+ * @param[in] response  Frame counter
+ * @param[in] arg       Module object
+ */
+void S7XG::_counterRead(uint8_t status, char * response, void * arg) {
+
+    S7XG * module = (S7XG *) arg;
+    module->_uplink_sending = 0xFF;
+
+    if ((S7XG_STATUS_OK == status) && ('0' <= response[0]) && (response[0] <= '9')) {
+        module->_upcnt = atol(response);
+        module->_upcnt_valid = true;
+    } else {
+        module->_uplink_ready = millis() + module->_uplink_backoff;
+    }
+
+}
+
+/**
+ * @brief               Remembers an uplink the module has just accepted, until its result arrives
+ * @details             Called before the frame counter is incremented, so it is the one of this uplink.
+ * @param[in] job       Uplink job
+ */
+void S7XG::_track(s7xg_job_t * job) {
+
+    // Never happens with the uplink queue, it waits for each result
+    if (S7XG_INFLIGHT_SIZE == _inflight_count) _resolve(S7XG_DELIVERY_TIMEOUT);
+
+    s7xg_inflight_t & entry = _inflight[(_inflight_head + _inflight_count) % S7XG_INFLIGHT_SIZE];
+    entry.counter = _upcnt;
+    entry.sent = millis();
+    entry.port = job->port;
+    entry.slot = job->slot;
+    entry.confirmed = job->confirmed;
+    _inflight_count++;
+
+    if (!job->confirmed) return;
+    _link.confirmed++;
+    if (0xFF != job->slot) _uplink_waiting |= (1 << job->slot);
+
+}
+
+/**
+ * @brief               Applies the result of the oldest uplink in flight
+ * @details             A queued confirmed uplink that was not acknowledged goes back to the queue
+ *                      until it runs out of retries.
+ * @param[in] status    One of the S7XG_DELIVERY_* values
+ */
+void S7XG::_resolve(uint8_t status) {
+
+    s7xg_inflight_t entry = _inflight[_inflight_head];
+    _inflight_head = (_inflight_head + 1) % S7XG_INFLIGHT_SIZE;
+    _inflight_count--;
+    if (!entry.confirmed) return;
+
+    bool acked = (S7XG_DELIVERY_ACKED == status);
+    if (acked) {
+        _link.acked++;
+    } else {
+        _link.unacked++;
+    }
+
+    s7xg_delivery_t delivery = { entry.counter, entry.port, status, 1, millis() - entry.sent, NULL, 0 };
+
+    if (0xFF != entry.slot) {
+        uint8_t mask = 1 << entry.slot;
+        s7xg_uplink_t & uplink = _uplinks[entry.slot];
+        _uplink_waiting &= ~mask;
+        uplink.attempts++;
+        if (!acked && (uplink.attempts <= _confirm_retries)) {
+            S7XG_DEBUG(F("-- uplink not acknowledged, sending it again\n"));
+            return;
+        }
+        if (!acked) _link.abandoned++;
+        delivery.attempts = uplink.attempts;
+        delivery.data = uplink.data;
+        delivery.len = uplink.len;
+        if (_delivery_callback) _delivery_callback(delivery, _delivery_arg);
+        _uplink_used &= ~mask;
+        return;
+    }
+
+    if (_delivery_callback) _delivery_callback(delivery, _delivery_arg);
+
+}
+
+/**
+ * @brief               Times out the oldest uplink in flight if its result is overdue
+ */
+void S7XG::_expire() {
+    if (millis() - _inflight[_inflight_head].sent < _confirm_timeout) return;
+    S7XG_DEBUG(F("-- uplink result timeout\n"));
+    if (_tx_pending) _tx_pending--;
+    _resolve(S7XG_DELIVERY_TIMEOUT);
+}
+
+/**
+ * @brief               Issues the next join manager command when the queue has room
+ */
+void S7XG::_joinStep() {
+
+    // No answer to an accepted join request
+    if (_join_issued) {
+        if ((S7XG_JOIN_JOINING == _join_state) && _join_sent && (millis() - _join_sent >= S7XG_JOIN_TIMEOUT)) {
+            S7XG_DEBUG(F("-- join timeout\n"));
+            _joinResult(false);
+        }
+        return;
+    }
+
+    // Leave room for a join with the credentials (up to four commands)
+    if (_group || (_job_count + 4 > S7XG_QUEUE_SIZE)) return;
+
+    if (S7XG_JOIN_CHECKING == _join_state) {
+        _join_issued = async(_joinChecked, this)->_sendAndExpect(0, NULL, NULL, MAC_GET_JOIN_STATUS);
+    } else if (S7XG_JOIN_WAITING == _join_state) {
+        if ((int32_t) (millis() - _join_deadline) < 0) return;
+        if (_joinAttempt()) _join_state = S7XG_JOIN_JOINING;
+    } else if (S7XG_JOIN_SAVING == _join_state) {
+        _join_issued = async(_joinSaved, this)->macSave();
+    }
+
+}
+
+/**
+ * @brief               Sends a join request if the join duty cycle allows it
+ * @details             Otherwise moves the deadline to the end of the current window.
+ * @return              True if sent
+ */
+bool S7XG::_joinAttempt() {
+
+    // Join duty cycle window (LoRaWAN 1.0.x, retransmissions back-off)
+    const uint32_t hour = 3600000UL;
+    uint32_t elapsed = millis() - _join_started;
+    uint32_t start = 0;
+    uint32_t length = hour;
+    uint32_t budget = 36000;
+    if (elapsed >= 11 * hour) {
+        start = 11 * hour + ((elapsed - 11 * hour) / (24 * hour)) * (24 * hour);
+        length = 24 * hour;
+        budget = 8700;
+    } else if (elapsed >= hour) {
+        start = hour;
+        length = 10 * hour;
+    }
+    if (start != _join_window) {
+        _join_window = start;
+        _join_spent = 0;
+    }
+
+    // A join request is 23 bytes long
+    uint16_t band = _band ? _band : 868;
+    uint8_t dr = (0xFF == _dr) ? 0 : _dr;
+    uint32_t airtime = (timeOnAir(spreadingFactor(band, dr), bandwidth(band, dr), 23) + 999) / 1000;
+    if (_join_spent + airtime > budget) {
+        _join_deadline = _join_started + start + length;
+        return false;
+    }
+
+    if (_join_keys) {
+        _join_issued = async(_joinSent, this)->_sendAndExpect(S7XG_JOB_LONG | S7XG_JOB_JOIN, "Ok", NULL, MAC_JOIN_OTAA);
+    } else {
+        _join_issued = async(_joinSent, this)->macJoinOTAA(_join_deveui, _join_appeui, _join_appkey);
+    }
+    if (!_join_issued) return false;
+
+    _join_sent = 0;
+    _join_spent += airtime;
+    _join_attempts++;
+    return true;
+
+}
+
+/**
+ * @brief               Handles the outcome of a join request
+ * @param[in] accepted  True if the network accepted it
+ */
+void S7XG::_joinResult(bool accepted) {
+
+    _join_issued = false;
+    _join_sent = 0;
+
+    if (accepted) {
+        _join_state = _join_save ? S7XG_JOIN_SAVING : S7XG_JOIN_JOINED;
+        return;
+    }
+
+    if (_join_max && (_join_attempts >= _join_max)) {
+        _join_state = S7XG_JOIN_FAILED;
+        return;
+    }
+
+    // Randomised exponential backoff, between half and all of the current step
+    uint32_t step = S7XG_JOIN_BACKOFF;
+    for (uint8_t i=1; (i<_join_attempts) && (step < S7XG_JOIN_BACKOFF_MAX); i++) step *= 2;
+    if (step > S7XG_JOIN_BACKOFF_MAX) step = S7XG_JOIN_BACKOFF_MAX;
+    _join_deadline = millis() + step / 2 + _joinRandom(step / 2 + 1);
+    _join_state = S7XG_JOIN_WAITING;
+
+}
+
+/**
+ * @brief               Xorshift pseudo-random generator seeded with the device EUI
+ * @param[in] max       Upper limit (excluded)
+ * @return              Random value in [0, max)
+ */
+uint32_t S7XG::_joinRandom(uint32_t max) {
+    _join_seed ^= _join_seed << 13;
+    _join_seed ^= _join_seed >> 17;
+    _join_seed ^= _join_seed << 5;
+    return max ? _join_seed % max : 0;
+}
+
+/**
+ * @brief               Join status read, joins unless the module kept a session
+ * @param[in] status    Command status
+ * @param[in] response  "joined" or "unjoined"
+ * @param[in] arg       Module
+ */
+void S7XG::_joinChecked(uint8_t status, char * response, void * arg) {
+
+    S7XG * module = (S7XG *) arg;
+    module->_join_issued = false;
+    if (S7XG_JOIN_CHECKING != module->_join_state) return;
+
+    if ((S7XG_STATUS_OK == status) && (0 == strcmp(response, "joined"))) {
+        module->_join_state = S7XG_JOIN_JOINED;
+        if (module->_join_callback) module->_join_callback(true, module->_join_arg);
+        return;
+    }
+
+    // First request after a random delay, so a fleet powered up at once does not join at once
+    module->_join_deadline = millis() + module->_joinRandom(S7XG_JOIN_BACKOFF);
+    module->_join_state = S7XG_JOIN_WAITING;
+
+}
+
+/**
+ * @brief               Join request answered, the result comes later as an event
+ * @param[in] status    Command status
+ * @param[in] response  "Ok" or the error
+ * @param[in] arg       Module
+ */
+void S7XG::_joinSent(uint8_t status, char * response, void * arg) {
+    (void) response;
+    S7XG * module = (S7XG *) arg;
+    if (S7XG_JOIN_JOINING != module->_join_state) return;
+    if (S7XG_STATUS_OK != status) {
+        module->_joinResult(false);
+        return;
+    }
+    module->_join_keys = true;
+    module->_join_sent = millis();
+}
+
+/**
+ * @brief               Session saved (or not), joined anyway
+ * @param[in] status    Command status
+ * @param[in] response  Answer
+ * @param[in] arg       Module
+ */
+void S7XG::_joinSaved(uint8_t status, char * response, void * arg) {
+    (void) response;
+    S7XG * module = (S7XG *) arg;
+    module->_join_issued = false;
+    if (S7XG_STATUS_OK != status) {
+        S7XG_DEBUG(F("-- session not saved\n"));
+    }
+    module->_join_state = S7XG_JOIN_JOINED;
+}
+
+/**
+ * @brief               Groups the commands of a method so they are queued at once and sent back to back
+ * @details             Does nothing inside an async call or a batch, the commands already belong to one.
+ * @return              Group to pass to _closeBatch, 0 if none was opened
+ */
+uint8_t S7XG::_openBatch() {
+    if (_group) return 0;
+    _group = _nextGroup();
+    _group_failed = false;
+    _group_callback = NULL;
+    _group_arg = NULL;
+    _group_blocking = true;
+    return _group;
+}
+
+/**
+ * @brief               Closes a group opened by _openBatch and waits for its commands
+ * @param[in] group     Group returned by _openBatch
+ * @return              True if every command succeeded (or if queued, when no group was opened)
+ */
+bool S7XG::_closeBatch(uint8_t group) {
+
+    if (0 == group) return !_group_failed;
+
+    uint16_t id = 0;
+    for (uint8_t i=_job_count; i>0; i--) {
+        s7xg_job_t * job = &_jobs[(_job_head + i - 1) % S7XG_QUEUE_SIZE];
+        if (job->group == group) {
+            id = job->id;
+            break;
+        }
+    }
+    bool failed = _group_failed;
+    _closeGroup();
+    _group_blocking = false;
+
+    if (failed) return false;
+    return id ? _wait(id) : (S7XG_STATUS_OK == _status);
+
+}
+
+/**
+ * @brief               Sets the given credentials, with a single mac set_keys when the firmware supports it
+ * @details             set_keys writes all six values, so it is only used when all of them are given and
+ *                      well formed, otherwise the credentials that are not given would be wiped. Support is
+ *                      checked the first time (that call always blocks): only the answer to an unknown
+ *                      command marks it as not supported, any other failure is checked again next time.
+ *                      Async calls never block, they use the setters until a blocking call has checked.
+ * @param[in] deveui    Device EUI or NULL to leave it untouched (same for the other values)
+ * @return              True if queued or set
+ */
+bool S7XG::_setKeys(const char * deveui, const char * appeui, const char * appkey, const char * devaddr, const char * nwkskey, const char * appskey) {
+
+    // Forget the cached setters, set_keys changes the keys behind their back and
+    // configure() must not skip them afterwards. Also check all six are well formed
+    const S7XGCommand<const char *> * setters[] = {
+        &MAC_SET_DEVEUI, &MAC_SET_APPEUI, &MAC_SET_APPKEY,
+        &MAC_SET_DEVADDR, &MAC_SET_NWKSKEY, &MAC_SET_APPSKEY
+    };
+    const char * values[] = { deveui, appeui, appkey, devaddr, nwkskey, appskey };
+    const uint8_t lengths[] = { 16, 16, 32, 8, 32, 32 };
+    bool complete = true;
+    for (uint8_t i=0; i<6; i++) {
+        _cache(setters[i]->name, NULL, false);
+        if (!_isHex(values[i], lengths[i])) complete = false;
+    }
+
+    if (complete) {
+        bool async = _group && !_group_blocking;
+        if (!_keys_checked && !async) {
+            bool ok = _sendAndExpect(S7XG_JOB_SYNC, "Ok", NULL, MAC_SET_KEYS, deveui, appeui, appkey, devaddr, nwkskey, appskey);
+            if (ok || (0 == strcmp(_buffer, "Invalid"))) {
+                _keys_checked = true;
+                _keys_supported = ok;
+            }
+            if (ok) return true;
+        } else if (_keys_supported) {
+            return _sendAndACK(MAC_SET_KEYS, deveui, appeui, appkey, devaddr, nwkskey, appskey);
+        }
+    }
+
+    for (uint8_t i=0; i<6; i++) {
+        if (values[i] && !_sendAndACK(*setters[i], values[i])) return false;
+    }
+    return true;
+
+}
+
+/**
+ * @brief               Checks a hex string
+ * @param[in] value     String to check (can be NULL)
+ * @param[in] length    Expected number of characters
+ * @return              True if it has exactly that many hex characters
+ */
+bool S7XG::_isHex(const char * value, uint8_t length) {
+    if (!value || (strlen(value) != length)) return false;
+    for (uint8_t i=0; i<length; i++) {
+        if (!strchr("0123456789abcdefABCDEF", value[i])) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief               Blocks until the given job is done
+ * @details             The status is the one of that job, not of whatever loop() ran after it,
+ *                      and its answer is left in the buffer. Waits can nest from callbacks.
+ * @param[in] id        Job ID
+ * @return              True if the job finished successfully
+ */
+bool S7XG::_wait(uint16_t id) {
+
+    uint16_t outer_id = _wait_id;
+    uint8_t outer_status = _wait_status;
+    _wait_id = id;
+    _wait_status = S7XG_STATUS_PENDING;
+
+    while (_find(id)) {
+        loop();
+        _idle();
+    }
+
+    // Dropped without an answer of its own
+    uint8_t status = (S7XG_STATUS_PENDING == _wait_status) ? (uint8_t) S7XG_STATUS_ERROR : _wait_status;
+    _wait_id = outer_id;
+    _wait_status = outer_status;
+    _status = status;
+    return S7XG_STATUS_OK == status;
+
+}
+
+/**
+ * @brief               Checks the response buffer against the expected answer
+ * @param[in] expect    Expected answer (NULL to accept any answer)
+ * @param[in] flags     If S7XG_JOB_PREFIX is set the buffer only has to start with the expected answer
+ * @return              True if it matches
+ */
+bool S7XG::_match(const char * expect, uint8_t flags) {
+    if (!expect) return true;
+    if (flags & S7XG_JOB_PREFIX) return 0 == strncmp(_buffer, expect, strlen(expect));
+    return 0 == strcmp(_buffer, expect);
+}
+
+/**
+ * @brief               Removes the current job from the queue and notifies the result
+ * @param[in] status    Job status
+ */
+void S7XG::_done(uint8_t status) {
+
+    s7xg_job_t * job = &_jobs[_job_head];
+    uint16_t id = job->id;
+    uint8_t group = job->group;
+    bool last = job->flags & S7XG_JOB_LAST;
+    s7xg_callback_t callback = job->callback;
+    void * arg = job->arg;
+
+    _account(job, status);
+    if (job->flags & S7XG_JOB_CACHE) _cache(job->name, job->command, S7XG_STATUS_OK == status);
+    if (job->flags & S7XG_JOB_JOIN) _upcnt_valid = false;
+    if (job->flags & S7XG_JOB_RESET) invalidate();
+
+    if ((0 == group) || (group != _report_group)) _report.step = 0;
+    _report_group = group;
+    _report.step++;
+    _report.status = status;
+    _report.command = job->name;
+
+    _job_head = (_job_head + 1) % S7XG_QUEUE_SIZE;
+    _job_count--;
+    _job_step = S7XG_STEP_IDLE;
+    _status = status;
+    if (id == _wait_id) _wait_status = status;
+
+    if (0 == group) return;
+    if (S7XG_STATUS_OK == status) {
+        if (!last) return;
+    } else {
+        _drop(group, false);
+        if (_wait_id && (S7XG_STATUS_PENDING == _wait_status) && !_find(_wait_id)) _wait_status = status;
+    }
+    if (callback) callback(status, _buffer, arg);
+
+}
+
+/**
+ * @brief               Updates the statistics for the job being completed
+ * @details             Jobs completed before being sent were answered from the cache.
+ * @param[in] job       Job
+ * @param[in] status    Job status
+ */
+void S7XG::_account(s7xg_job_t * job, uint8_t status) {
+
+    s7xg_stats_t & stats = _stats[job->kind];
+    stats.count++;
+
+    if (S7XG_STEP_IDLE == _job_step) {
+        stats.cached++;
+        return;
+    }
+    if (S7XG_STATUS_TIMEOUT == status) {
+        stats.timeouts++;
+        return;
+    }
+    if (S7XG_STATUS_ERROR == status) stats.errors++;
+
+    uint32_t us = micros() - _job_sent;
+    if ((0 == stats.min_us) || (us < stats.min_us)) stats.min_us = us;
+    if (us > stats.max_us) stats.max_us = us;
+
+    uint8_t bucket = 0;
+    for (uint32_t ms = us / 1000; ms && (bucket < S7XG_STATS_BUCKETS - 1); ms >>= 1) bucket++;
+    if (stats.buckets[bucket] < 0xFFFF) stats.buckets[bucket]++;
+
+}
+
+/**
+ * @brief               Updates the response time estimation for a kind of command
+ * @details             A timeout doubles the estimation, so a module that got slower is learned again.
+ * @param[in] kind      One of the S7XG_KIND_* values
+ * @param[in] longer    True for the long commands
+ * @param[in] ms        Response time in milliseconds, 0 if the command timed out
+ */
+void S7XG::_learn(uint8_t kind, bool longer, uint32_t ms) {
+
+    uint16_t & rtt = _rtt[kind][longer];
+    uint16_t & var = _rtt_var[kind][longer];
+
+    if (0 == ms) {
+        uint32_t backoff = 2UL * getTimeout(kind, longer);
+        rtt = (backoff < _timeout_ceiling) ? backoff : _timeout_ceiling;
+        return;
+    }
+
+    if (ms > _timeout_ceiling) ms = _timeout_ceiling;
+    if (0 == rtt) {
+        rtt = ms;
+        var = ms / 2;
+        return;
+    }
+    int32_t error = (int32_t) ms - rtt;
+    rtt += error / 8;
+    var += ((error < 0 ? -error : error) - (int32_t) var) / 4;
+    if (0 == rtt) rtt = 1;
+
+}
+
+/**
+ * @brief               Looks for the module at every supported baudrate
+ * @return              Baudrate the module answers at, 0 if not found
+ */
+uint32_t S7XG::_locate() {
+    for (uint8_t i=0; i<sizeof(S7XG_BAUDRATES) / sizeof(S7XG_BAUDRATES[0]); i++) {
+        if (_switchBaudrate(S7XG_BAUDRATES[i]) && _probe()) return _baudrate;
+    }
+    _baudrate = 0;
+    return 0;
+}
+
+/**
+ * @brief               Checks the link with a sip get_ver round-trip
+ * @details             A wrong baudrate says nothing about the module response time,
+ *                      so a failed probe does not change the learned timeouts.
+ * @return              True if the module answered
+ */
+bool S7XG::_probe() {
+    uint16_t rtt = _rtt[S7XG_KIND_SIP][0];
+    uint16_t var = _rtt_var[S7XG_KIND_SIP][0];
+    if (_sendAndExpect(S7XG_JOB_SYNC, NULL, NULL, SIP_GET_VER)) return true;
+    _rtt[S7XG_KIND_SIP][0] = rtt;
+    _rtt_var[S7XG_KIND_SIP][0] = var;
+    return false;
+}
+
+/**
+ * @brief               Changes the host baudrate and drops whatever was half received
+ * @details             A late answer sent at the old speed will not be understood, it is not waited for.
+ * @param[in] baudrate  New baudrate
+ * @return              False if the host does not support it
+ */
+bool S7XG::_switchBaudrate(uint32_t baudrate) {
+    if (!_baudrate_callback || !_baudrate_callback(baudrate, _baudrate_arg)) return false;
+    _baudrate = baudrate;
+    _rx_flag = 0;
+    _rx_position = _rx_length = 0;
+    _job_late = 0;
+    return true;
+}
+
+/**
+ * @brief               Tells the kind of a command from its text
+ * @param[in] command   Command
+ * @return              One of the S7XG_KIND_* values
+ */
+uint8_t S7XG::_kind(const char * command) {
+    if (0 == strncmp(command, "gps ", 4)) return S7XG_KIND_GPS;
+    if (0 != strncmp(command, "mac ", 4)) return S7XG_KIND_SIP;
+    command += 4;
+    if (0 == strncmp(command, "get_", 4)) return S7XG_KIND_MAC_GET;
+    if (0 == strncmp(command, "join ", 5)) return S7XG_KIND_MAC_JOIN;
+    if (0 == strncmp(command, "tx ", 3)) return S7XG_KIND_MAC_TX;
+    return S7XG_KIND_MAC_SET;
+}
+
+/**
+ * @brief               Removes the pending jobs belonging to an async call
+ * @param[in] group     Async call identifier
+ * @param[in] started   True to also detach the job being processed
+ */
+void S7XG::_drop(uint8_t group, bool started) {
+    uint8_t count = 0;
+    for (uint8_t i=0; i<_job_count; i++) {
+        s7xg_job_t * job = &_jobs[(_job_head + i) % S7XG_QUEUE_SIZE];
+        bool running = (0 == i) && (S7XG_STEP_IDLE != _job_step);
+        if (job->group == group) {
+            if (running) {
+                if (started) job->group = 0;
+            } else {
+                continue;
+            }
+        }
+        if (count != i) _jobs[(_job_head + count) % S7XG_QUEUE_SIZE] = *job;
+        count++;
+    }
+    _job_count = count;
+}
+
+/**
+ * @brief               Looks for a job in the queue
+ * @param[in] id        Job ID
+ * @return              Pointer to the job or NULL if not found
+ */
+s7xg_job_t * S7XG::_find(uint16_t id) {
+    for (uint8_t i=0; i<_job_count; i++) {
+        s7xg_job_t * job = &_jobs[(_job_head + i) % S7XG_QUEUE_SIZE];
+        if (job->id == id) return job;
+    }
+    return NULL;
+}
+
+/**
+ * @brief               Picks the ID of a new group, skipping the ones of the calls still queued
+ * @details             Cancelling a call drops the jobs of its group, the ID must not be shared.
+ * @return              Group ID
+ */
+uint8_t S7XG::_nextGroup() {
+    bool used = true;
+    while (used) {
+        if (0 == ++_group_count) _group_count = 1;
+        used = false;
+        for (uint8_t i=0; i<_job_count; i++) {
+            if (_jobs[(_job_head + i) % S7XG_QUEUE_SIZE].group == _group_count) used = true;
+        }
+    }
+    return _group_count;
+}
+
+/**
+ * @brief               Closes the current async call flagging its last job
+ * @details             If any of the commands could not be queued, the whole call is cancelled.
+ */
+void S7XG::_closeGroup() {
+
+    if (0 == _group) return;
+
+    if (_group_failed) {
+        _drop(_group, true);
+    } else {
+        for (uint8_t i=_job_count; i>0; i--) {
+            s7xg_job_t * job = &_jobs[(_job_head + i - 1) % S7XG_QUEUE_SIZE];
+            if (job->group == _group) {
+                job->flags |= S7XG_JOB_LAST;
+                break;
+            }
+        }
+    }
+
+    _group = 0;
+
+}
+
+/**
+ * @brief               Checks if the module already has the value a setter command would set
+ * @param[in] name      PROGMEM name of the setter
+ * @param[in] command   Command
+ * @return              True if the last acknowledged command for the same setter was identical
+ */
+bool S7XG::_cached(PGM_P name, const char * command) {
+    for (uint8_t i=0; i<_shadow_count; i++) {
+        if (_shadow[i].name == name) return _shadow[i].hash == _hash(command);
+    }
+    return false;
+}
+
+/**
+ * @brief               Remembers or forgets the value set by a setter command
+ * @param[in] name      PROGMEM name of the setter
+ * @param[in] command   Command
+ * @param[in] valid     True if the module has the value
+ */
+void S7XG::_cache(PGM_P name, const char * command, bool valid) {
+    uint8_t i = 0;
+    while ((i < _shadow_count) && (_shadow[i].name != name)) i++;
+    if (!valid) {
+        if (i < _shadow_count) _shadow[i] = _shadow[--_shadow_count];
+        return;
+    }
+    if (i == _shadow_count) {
+        if (S7XG_SHADOW_SIZE == _shadow_count) return;
+        _shadow[_shadow_count++].name = name;
+    }
+    _shadow[i].hash = _hash(command);
+}
+
+/**
+ * @brief               FNV-1a hash of a block of memory
+ * @param[in] data      Data to hash
+ * @param[in] len       Length of the data
+ * @param[in] hash      Hash to continue from (defaults to the FNV offset basis)
+ * @return              32 bits hash
+ */
+uint32_t S7XG::_hash(const void * data, size_t len, uint32_t hash) {
+    const uint8_t * p = (const uint8_t *) data;
+    while (len--) {
+        hash ^= *p++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * @brief               FNV-1a hash of a c-string, including its terminator
+ * @param[in] s         C-string (NULL is hashed as an empty string)
+ * @param[in] hash      Hash to continue from (defaults to the FNV offset basis)
+ * @return              32 bits hash
+ */
+uint32_t S7XG::_hash(const char * s, uint32_t hash) {
+    if (!s) s = "";
+    return _hash(s, strlen(s) + 1, hash);
+}
+
+/**
+ * @brief               Tells unsolicited result codes apart from command answers
+ * @details             "err" is only an event while an uplink result is expected and no command is waiting
+ *                      for its answer, otherwise it is that answer.
+ * @return              One of the S7XG_EVENT_* values, S7XG_EVENT_NONE if the line is not an event
+ */
+uint8_t S7XG::_classify() {
+    if (0 == strncmp(_buffer, "mac rx ", 7)) return S7XG_EVENT_DOWNLINK;
+    if (0 == strcmp(_buffer, "tx_ok")) return S7XG_EVENT_TX_OK;
+    if (0 == strcmp(_buffer, "accepted")) return S7XG_EVENT_JOIN_OK;
+    if (0 == strcmp(_buffer, "unsuccess")) return S7XG_EVENT_JOIN_ERROR;
+    if (S7XG_STEP_REPLY == _job_step) return S7XG_EVENT_NONE;
+    if ((_tx_pending || _tx_cycle || _gps_auto) && (0 == strcmp(_buffer, "err"))) return S7XG_EVENT_TX_ERROR;
+    return S7XG_EVENT_NONE;
+}
+
+/**
+ * @brief               Calls the callbacks for an unsolicited result code
+ * @details             Downlinks ("mac rx <port> <hex>") are decoded in place in the response buffer.
+ * @param[in] event     One of the S7XG_EVENT_* values
+ */
+void S7XG::_notify(uint8_t event) {
+
+    if (S7XG_EVENT_NONE == event) return;
+    _link.events++;
+
+    bool tx = (S7XG_EVENT_DOWNLINK == event) || (S7XG_EVENT_TX_OK == event) || (S7XG_EVENT_TX_ERROR == event);
+    bool expected = _tx_pending > 0;
+    if (tx && expected) _tx_pending--;
+
+    // Results come in the order the uplinks were sent, the module sent this one on its own otherwise
+    if (tx && expected && _inflight_count) _resolve((S7XG_EVENT_TX_ERROR == event) ? S7XG_DELIVERY_NACKED : S7XG_DELIVERY_ACKED);
+    if (tx && !expected) _upcnt_valid = false;
+
+    if (S7XG_EVENT_DOWNLINK == event) {
+        const char * p = &_buffer[7];
+        uint32_t port = 0;
+        if (!_parseUnsigned(p, port)) return;
+        while (' ' == *p) p++;
+        uint8_t * data = (uint8_t *) _buffer;
+        uint8_t len = strlen(p) / 2;
+        unhexlify((char *) p, data, len);
+        if (_downlink_callback) _downlink_callback(port, data, len, _downlink_arg);
+        if (expected && _tx_callback) _tx_callback(true, _tx_arg);
+        return;
+    }
+
+    if (tx) {
+        if (_tx_callback) _tx_callback(S7XG_EVENT_TX_OK == event, _tx_arg);
+    } else {
+        if ((S7XG_JOIN_JOINING == _join_state) && _join_sent) _joinResult(S7XG_EVENT_JOIN_OK == event);
+        if (_join_callback) _join_callback(S7XG_EVENT_JOIN_OK == event, _join_arg);
+    }
+
+}
+
+/**
+ * @brief               Returns the decimal value for an alphanumeric value
+ * @param[in] ch        Alfanumeric value [0-9a-fA-F]
+ * @return              Decimal value or 0 if error
+ */
+uint8_t S7XG::_nibble(char ch) {
+    if ('0' <= ch && ch <= '9') return ch - '0';
+    if ('a' <= ch && ch <= 'f') return ch - 'a' + 10;
+    if ('A' <= ch && ch <= 'F') return ch - 'A' + 10;
+    return 0;
+}
+
+/**
+ * @brief                   Skips spaces and consumes a token if present
+ * @param[in,out] p         Parsing position, moved past the token if found
+ * @param[in] token         Token to match
+ * @return                  True if the token was found
+ */
+bool S7XG::_parseToken(const char * & p, const char * token) {
+    const char * q = p;
+    while (' ' == *q) q++;
+    while (*token) {
+        if (*q++ != *token++) return false;
+    }
+    p = q;
+    return true;
+}
+
+/**
+ * @brief                   Skips spaces and parses a decimal unsigned integer
+ * @param[in,out] p         Parsing position, moved past the number
+ * @param[out] value        Parsed value
+ * @return                  True if at least one digit was found
+ */
+bool S7XG::_parseUnsigned(const char * & p, uint32_t & value) {
+    while (' ' == *p) p++;
+    if ((*p < '0') || ('9' < *p)) return false;
+    value = 0;
+    while (('0' <= *p) && (*p <= '9')) value = value * 10 + (*p++ - '0');
+    return true;
+}
+
+/**
+ * @brief                   Skips spaces and parses a decimal number as a fixed point integer
+ * @details                 "41.601215" with 6 decimals yields 41601215, "3.6" with 3 decimals yields 3600.
+ *                          Extra decimals are truncated.
+ * @param[in,out] p         Parsing position, moved past the number
+ * @param[in] decimals      Number of decimals to keep
+ * @param[out] value        Parsed value, scaled by 10^decimals
+ * @return                  True if a number was found
+ */
+bool S7XG::_parseFixed(const char * & p, uint8_t decimals, uint32_t & value) {
+    if (!_parseUnsigned(p, value)) return false;
+    uint8_t count = 0;
+    if ('.' == *p) {
+        p++;
+        while (('0' <= *p) && (*p <= '9')) {
+            if (count < decimals) {
+                value = value * 10 + (*p - '0');
+                count++;
+            }
+            p++;
+        }
+    }
+    for (; count < decimals; count++) value *= 10;
+    return true;
+}
+
+/**
+ * @brief                   Non-blocking delay, keeps the command queue running
+ * @param[in] ms            Milliseconds to delay
+ */
+void S7XG::_nice_delay(uint32_t ms) {
+    uint32_t start = millis();
+    while (millis() - start < ms) {
+        loop();
+        if (_multi) _multi->_service(this);
+        delay(1);
+    }
+}
+
+/**
+ * @brief               Lets the other modules of the manager (see S7XGMulti) run while this one blocks
+ */
+void S7XG::_idle() {
+    if (_multi) _multi->_service(this);
+    yield();
 }
\ No newline at end of file
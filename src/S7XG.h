@@ -22,15 +22,76 @@ along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <Arduino.h>
+#include "S7XGNmea.h"
 
 // ----------------------------------------------------------------------------
 // Configuration
 // ----------------------------------------------------------------------------
 
-#define S7XG_SHORT_TIMEOUT                    300
-#define S7XG_LONG_TIMEOUT                     5000
-#define S7XG_RX_BUFFER_SIZE                   128
-#define S7XG_TX_BUFFER_SIZE                   128
+// Defaults, override them with build flags (for example -DS7XG_QUEUE_SIZE=16)
+#ifndef S7XG_TIMEOUT_FLOOR
+#define S7XG_TIMEOUT_FLOOR                    100
+#endif
+#ifndef S7XG_TIMEOUT_CEILING
+#define S7XG_TIMEOUT_CEILING                  10000
+#endif
+#ifndef S7XG_TIMEOUT_INITIAL
+#define S7XG_TIMEOUT_INITIAL                  500
+#endif
+#ifndef S7XG_RX_BUFFER_SIZE
+#define S7XG_RX_BUFFER_SIZE                   512
+#endif
+#ifndef S7XG_RX_CHUNK_SIZE
+#define S7XG_RX_CHUNK_SIZE                    64
+#endif
+#ifndef S7XG_TX_BUFFER_SIZE
+#define S7XG_TX_BUFFER_SIZE                   160
+#endif
+#ifndef S7XG_QUEUE_SIZE
+#define S7XG_QUEUE_SIZE                       8
+#endif
+#ifndef S7XG_HEX_CHUNK_SIZE
+#define S7XG_HEX_CHUNK_SIZE                   16
+#endif
+#ifndef S7XG_SHADOW_SIZE
+#define S7XG_SHADOW_SIZE                      20
+#endif
+#ifndef S7XG_STATS_BUCKETS
+#define S7XG_STATS_BUCKETS                    12
+#endif
+#ifndef S7XG_UPLINK_QUEUE_SIZE
+#define S7XG_UPLINK_QUEUE_SIZE                4
+#endif
+#ifndef S7XG_UPLINK_SIZE
+#define S7XG_UPLINK_SIZE                      51
+#endif
+#ifndef S7XG_UPLINK_BACKOFF
+#define S7XG_UPLINK_BACKOFF                   1000
+#endif
+#ifndef S7XG_UPLINK_BACKOFF_MAX
+#define S7XG_UPLINK_BACKOFF_MAX               60000
+#endif
+#ifndef S7XG_DUTY_CYCLE_WINDOW
+#define S7XG_DUTY_CYCLE_WINDOW                3600000UL
+#endif
+#ifndef S7XG_JOIN_BACKOFF
+#define S7XG_JOIN_BACKOFF                     5000
+#endif
+#ifndef S7XG_JOIN_BACKOFF_MAX
+#define S7XG_JOIN_BACKOFF_MAX                 600000UL
+#endif
+#ifndef S7XG_JOIN_TIMEOUT
+#define S7XG_JOIN_TIMEOUT                     15000
+#endif
+#ifndef S7XG_INFLIGHT_SIZE
+#define S7XG_INFLIGHT_SIZE                    4
+#endif
+#ifndef S7XG_CONFIRM_RETRIES
+#define S7XG_CONFIRM_RETRIES                  2
+#endif
+#ifndef S7XG_CONFIRM_TIMEOUT
+#define S7XG_CONFIRM_TIMEOUT                  60000UL
+#endif
 
 // ----------------------------------------------------------------------------
 // Debug
@@ -82,6 +143,11 @@ enum {
 
 typedef struct {
   bool fix;
+  uint8_t status;           // One of S7XG_GPS_STATUS_*
+  uint8_t valid;            // Any combination of S7XG_GPS_VALID_*
+  int32_t latitude_e6;      // Millionths of a degree, negative south
+  int32_t longitude_e6;     // Millionths of a degree, negative west
+  uint32_t positioning_ms;  // Time spent positioning
   float latitude;
   float longitude;
   float positioning;
@@ -93,6 +159,20 @@ typedef struct {
   int second;
 } gps_message_t;
 
+enum {
+  S7XG_GPS_STATUS_OK = 0,
+  S7XG_GPS_STATUS_NO_RESPONSE,
+  S7XG_GPS_STATUS_NOT_INIT,
+  S7XG_GPS_STATUS_IDLE,
+  S7XG_GPS_STATUS_MALFORMED,
+};
+
+enum {
+  S7XG_GPS_VALID_TIME = 0x01,
+  S7XG_GPS_VALID_POSITION = 0x02,
+  S7XG_GPS_VALID_POSITIONING = 0x04,
+};
+
 enum {
   S7XG_GPS_MODE_IDLE = 0,
   S7XG_GPS_MODE_MANUAL,
@@ -117,131 +197,471 @@ enum {
   S7XG_GPS_SYSTEM_HYBRID,
 };
 
+// ----------------------------------------------------------------------------
+// Settings
+// ----------------------------------------------------------------------------
+
+#define S7XG_KEEP                             0xFF
+
+// Numeric fields set to S7XG_KEEP and NULL strings are left as they are. Start from S7XG_SETTINGS_KEEP
+// and set the fields you need: a zero-initialised structure asks for power 0, data rate 0, ADR off,...
+typedef struct {
+  uint8_t power;            // Transmission power
+  uint8_t datarate;         // One of S7XG_DR_*
+  uint8_t adr;              // 0 (off) or 1 (on)
+  uint8_t retries;          // Number of TX retries
+  uint8_t device_class;     // S7XG_MAC_CLASS_A or S7XG_MAC_CLASS_C
+  uint8_t duty_cycle;       // 0 (off) or 1 (on)
+  const char * devaddr;     // ABP session (NULL when using OTAA)
+  const char * nwkskey;
+  const char * appskey;
+  const char * deveui;      // OTAA credentials (NULL deveui to use the hardware EUI)
+  const char * appeui;
+  const char * appkey;      // NULL when using ABP
+  uint8_t gps_mode;         // One of S7XG_GPS_MODE_*
+  uint8_t gps_port;         // Auto mode uplink port
+  uint8_t gps_format;       // One of S7XG_GPS_FORMAT_*
+  uint32_t gps_cycle;       // Seconds between GPS updates (0 to keep the current one)
+  bool save;                // Save the MAC settings to flash when something changed
+} s7xg_settings_t;
+
+// Leaves everything as it is
+#define S7XG_SETTINGS_KEEP { \
+  S7XG_KEEP, S7XG_KEEP, S7XG_KEEP, S7XG_KEEP, S7XG_KEEP, S7XG_KEEP, \
+  NULL, NULL, NULL, NULL, NULL, NULL, \
+  S7XG_KEEP, S7XG_KEEP, S7XG_KEEP, 0, false \
+}
+
+// ----------------------------------------------------------------------------
+// Async
+// ----------------------------------------------------------------------------
+
+enum {
+  S7XG_STATUS_PENDING = 0,
+  S7XG_STATUS_OK,
+  S7XG_STATUS_ERROR,
+  S7XG_STATUS_TIMEOUT,
+};
+
+enum {
+  S7XG_JOB_LONG = 0x01,     // Use the long timeout
+  S7XG_JOB_PREFIX = 0x02,   // Response must start with the expected string
+  S7XG_JOB_SYNC = 0x04,     // Always block, even inside an async call
+  S7XG_JOB_LAST = 0x08,     // Last job of an async call
+  S7XG_JOB_TX = 0x10,       // Uplink, tx_ok, err or a downlink follows
+  S7XG_JOB_JOIN = 0x20,     // Join, accepted or unsuccess follows
+  S7XG_JOB_CACHE = 0x40,    // Setter, skipped if the module already has the value
+  S7XG_JOB_RESET = 0x80,    // Module reset, cached values are forgotten
+};
+
+enum {
+  S7XG_STEP_IDLE = 0,
+  S7XG_STEP_REPLY,
+  S7XG_STEP_THEN,
+};
+
+typedef void (*s7xg_callback_t)(uint8_t status, char * response, void * arg);
+typedef bool (*s7xg_baudrate_callback_t)(uint32_t baudrate, void * arg);
+
+typedef struct {
+  uint8_t status;           // S7XG_STATUS_* of the last call
+  uint8_t step;             // Commands run, when status is not OK the last one is the one that failed
+  PGM_P command;            // PROGMEM name of the last command run
+} s7xg_report_t;
+
+typedef struct {
+  uint16_t id;
+  uint8_t group;
+  uint8_t flags;
+  const char * expect;
+  const char * then;
+  s7xg_callback_t callback;
+  void * arg;
+  PGM_P name;
+  uint8_t kind;
+  const uint8_t * payload;
+  uint8_t payload_len;
+  uint8_t port;             // Uplinks only
+  bool confirmed;
+  uint8_t slot;             // Uplink queue slot, 0xFF if sent with macSend
+  char command[S7XG_TX_BUFFER_SIZE];
+} s7xg_job_t;
+
+typedef struct {
+  PGM_P name;
+  uint32_t hash;
+} s7xg_shadow_t;
+
+// ----------------------------------------------------------------------------
+// Join manager
+// ----------------------------------------------------------------------------
+
+enum {
+  S7XG_JOIN_IDLE = 0,       // Not managed (see macAutoJoin)
+  S7XG_JOIN_CHECKING,       // Reading the join status, the module might have kept a saved session
+  S7XG_JOIN_WAITING,        // Waiting for the backoff or the join duty cycle to allow a request
+  S7XG_JOIN_JOINING,        // Join request sent, waiting for the answer
+  S7XG_JOIN_SAVING,         // Accepted, saving the session to flash
+  S7XG_JOIN_JOINED,
+  S7XG_JOIN_FAILED          // Gave up after the maximum number of attempts
+};
+
+// ----------------------------------------------------------------------------
+// Uplink queue
+// ----------------------------------------------------------------------------
+
+enum {
+  S7XG_PRIORITY_LOW = 0,
+  S7XG_PRIORITY_NORMAL,
+  S7XG_PRIORITY_HIGH
+};
+
+enum {
+  S7XG_UPLINK_CONFIRMED = 0x01,   // Confirmed uplink
+  S7XG_UPLINK_COALESCE = 0x02     // Replaces a pending coalescing frame for the same port
+};
+
+typedef struct {
+  uint8_t data[S7XG_UPLINK_SIZE];
+  uint8_t len;
+  uint8_t port;
+  uint8_t priority;
+  uint8_t flags;
+  uint16_t sequence;
+  uint8_t attempts;         // Confirmed uplinks sent without an ACK so far
+} s7xg_uplink_t;
+
+// ----------------------------------------------------------------------------
+// Confirmed uplinks
+// ----------------------------------------------------------------------------
+
+enum {
+  S7XG_DELIVERY_ACKED = 0,  // tx_ok or a downlink
+  S7XG_DELIVERY_NACKED,     // err, the module ran out of retransmissions without an ACK
+  S7XG_DELIVERY_TIMEOUT,    // No result within the confirm timeout
+  S7XG_DELIVERY_DROPPED     // Never sent, dropped from a full uplink queue for a higher priority frame
+};
+
+typedef struct {
+  uint32_t counter;         // Uplink frame counter (FCntUp) of the last transmission, 0 for dropped frames
+  uint8_t port;
+  uint8_t status;           // One of S7XG_DELIVERY_*
+  uint8_t attempts;         // Transmissions, more than one if the uplink queue sent it again
+  uint32_t latency_ms;      // From the module accepting the last transmission to its result
+  const uint8_t * data;     // Payload of queued uplinks (valid during the callback), NULL for macSend
+  uint8_t len;
+} s7xg_delivery_t;
+
+typedef struct {
+  uint32_t counter;
+  uint32_t sent;
+  uint8_t port;
+  uint8_t slot;
+  bool confirmed;
+} s7xg_inflight_t;
+
+// ----------------------------------------------------------------------------
+// Events
+// ----------------------------------------------------------------------------
+
+enum {
+  S7XG_EVENT_NONE = 0,
+  S7XG_EVENT_DOWNLINK,
+  S7XG_EVENT_TX_OK,
+  S7XG_EVENT_TX_ERROR,
+  S7XG_EVENT_JOIN_OK,
+  S7XG_EVENT_JOIN_ERROR,
+};
+
+typedef void (*s7xg_downlink_callback_t)(uint8_t port, uint8_t * data, uint8_t len, void * arg);
+typedef void (*s7xg_event_callback_t)(bool success, void * arg);
+typedef void (*s7xg_gps_callback_t)(const gps_fix_t & fix, void * arg);
+typedef void (*s7xg_delivery_callback_t)(const s7xg_delivery_t & delivery, void * arg);
+
+// ----------------------------------------------------------------------------
+// Statistics
+// ----------------------------------------------------------------------------
+
+enum {
+  S7XG_KIND_SIP = 0,
+  S7XG_KIND_MAC_SET,
+  S7XG_KIND_MAC_GET,
+  S7XG_KIND_MAC_TX,
+  S7XG_KIND_MAC_JOIN,
+  S7XG_KIND_GPS,
+  S7XG_KIND_COUNT
+};
+
+typedef struct {
+  uint32_t count;           // Commands completed (including cached ones)
+  uint32_t cached;          // Setters skipped because the module already had the value
+  uint32_t errors;          // Unexpected answers (anything but "Ok" for setters)
+  uint32_t timeouts;
+  uint32_t min_us;          // Fastest round-trip, from sending the command to the last answer
+  uint32_t max_us;          // Slowest round-trip
+  uint16_t buckets[S7XG_STATS_BUCKETS];  // Round-trips under 1, 2, 4,... 1024 ms and above
+} s7xg_stats_t;
+
+typedef struct {
+  uint32_t bytes_sent;
+  uint32_t bytes_received;
+  uint32_t bytes_discarded; // Received outside a ">> " line
+  uint32_t lines_discarded; // Lines that were neither an answer nor an event
+  uint32_t overflows;       // Lines longer than S7XG_RX_BUFFER_SIZE
+  uint32_t events;          // Unsolicited result codes dispatched
+  uint32_t nmea_sentences;  // NMEA sentences with a valid checksum
+  uint32_t nmea_errors;     // NMEA sentences dropped (bad checksum or cut)
+  uint32_t confirmed;       // Confirmed uplinks accepted by the module, including the ones sent again
+  uint32_t acked;           // Confirmed uplinks acknowledged by the network
+  uint32_t unacked;         // Confirmed uplinks that ended in err or without a result
+  uint32_t abandoned;       // Queued confirmed uplinks given up after S7XG_CONFIRM_RETRIES
+  uint32_t dropped;         // Queued uplinks dropped to make room for a higher priority one
+} s7xg_link_stats_t;
+
 // ----------------------------------------------------------------------------
 // Commands
 // ----------------------------------------------------------------------------
 
-const char SIP_FACTORY_RESET[] PROGMEM =          "sip factory_reset";              // 3.1.1
-const char SIP_GET_VER[] PROGMEM =                "sip get_ver";                    // 3.1.2
-const char SIP_RESET[] PROGMEM =                  "sip reset";                      // 3.1.3
-const char SIP_GET_HW_MODEL[] PROGMEM =           "sip get_hw_model";               // 3.1.4
-const char SIP_SET_ECHO[] PROGMEM =               "sip set_echo %s";                // 3.1.5
-const char SIP_SET_LOG[] PROGMEM =                "sip set_log %s";                 // 3.1.6
-const char SIP_SLEEP[] PROGMEM =                  "sip sleep %d uart_on";           // 3.1.7
-const char SIP_SET_BAUDRATE[] PROGMEM =           "sip set_baudrate %d %s";         // 3.1.8
-const char SIP_GET_HW_MODEL_VER[] PROGMEM =       "sip get_hw_model_ver";           // 3.1.9
-const char SIP_SET_GPIO_MODE[] PROGMEM =          "sip set_gpio_mode %c %d %d";     // 3.1.10
-const char SIP_SET_GPIO[] PROGMEM =               "sip set_gpio %c %d %d";          // 3.1.11
-const char SIP_GET_GPIO[] PROGMEM =               "sip get_gpio %c %d";             // 3.1.12
-const char SIP_GET_UUID[] PROGMEM =               "sip get_uuid";                   // 3.1.13
-const char SIP_SET_STORAGE[] PROGMEM =            "sip set_storage %s";             // 3.1.14
-const char SIP_GET_STORAGE[] PROGMEM =            "sip get_storage";                // 3.1.15
-const char SIP_SET_BATT_RESISTOR[] PROGMEM =      "sip set_batt_resistor %lu %lu";  // 3.1.16
-const char SIP_GET_BATT_RESISTOR[] PROGMEM =      "sip get_batt_resistor";          // 3.1.17
-const char SIP_GET_BATT_VOLT[] PROGMEM =          "sip get_batt_volt";              // 3.1.18
-
-const char MAC_TX[] PROGMEM =                     "mac tx %s %d %s";                // 3.2.1
-const char MAC_JOIN_ABP[] PROGMEM =               "mac join abp";                   // 3.2.2
-const char MAC_JOIN_OTAA[] PROGMEM =              "mac join otaa";                  // 3.2.2
-const char MAC_SAVE[] PROGMEM =                   "mac save";                       // 3.2.3
-const char MAC_GET_JOIN_STATUS[] PROGMEM =        "mac get_join_status";            // 3.2.4
-const char MAC_SET_LINKCHK[] PROGMEM =            "mac set_linkchk";                // 3.2.5
-const char MAC_SET_DEVEUI[] PROGMEM =             "mac set_deveui %s";              // 3.2.6
-const char MAC_SET_APPEUI[] PROGMEM =             "mac set_appeui %s";              // 3.2.7
-const char MAC_SET_APPKEY[] PROGMEM =             "mac set_appkey %s";              // 3.2.8
-const char MAC_SET_DEVADDR[] PROGMEM =            "mac set_devaddr %s";             // 3.2.9
-const char MAC_SET_NWKSKEY[] PROGMEM =            "mac set_nwkskey %s";             // 3.2.10
-const char MAC_SET_APPSKEY[] PROGMEM =            "mac set_appskey %s";             // 3.2.11
-const char MAC_SET_POWER[] PROGMEM =              "mac set_power %d";               // 3.2.12
-const char MAC_SET_DR[] PROGMEM =                 "mac set_dr %d";                  // 3.2.13
-const char MAC_SET_ADR[] PROGMEM =                "mac set_adr %s";                 // 3.2.14
-const char MAC_SET_TXRETRY[] PROGMEM =            "mac set_txretry %d";             // 3.2.15
-const char MAC_SET_RXDELAY1[] PROGMEM =           "mac set_rxdelay1 %d";            // 3.2.16
-const char MAC_SET_RX2[] PROGMEM =                "mac set_rx2 %d %d";              // 3.2.17
-const char MAC_SET_SYNC[] PROGMEM =               "mac set_sync %02X";              // 3.2.18
-const char MAC_SET_CH_FREQ[] PROGMEM =            "mac set_ch_freq %d %d";          // 3.2.19
-const char MAC_SET_CH_DR_RANGE[] PROGMEM =        "mac set_ch_dr_range %d %d %d";   // 3.2.20
-const char MAC_SET_CH_STATUS[] PROGMEM =          "mac set_ch_status %d %s";        // 3.2.21
-const char MAC_SET_DC_CTL[] PROGMEM =             "mac set_dc_ctl %s";              // 3.2.22
-const char MAC_SET_DC_BAND[] PROGMEM =            "mac set_dc_band %d %d";          // 3.2.23
-const char MAC_SET_JOIN_CH[] PROGMEM =            "mac set_join_ch %d %s";          // 3.2.24
-const char MAC_SET_UPCNT[] PROGMEM =              "mac set_upcnt %lu";              // 3.2.25
-const char MAC_SET_DOWNCNT[] PROGMEM =            "mac set_downcnt %lu";            // 3.2.26
-const char MAC_SET_CLASS[] PROGMEM =              "mac set_class %c";               // 3.2.27
-const char MAC_GET_DEVADDR[] PROGMEM =            "mac get_devaddr";                // 3.2.28
-const char MAC_GET_DEVEUI[] PROGMEM =             "mac get_deveui";                 // 3.2.29
-const char MAC_GET_APPEUI[] PROGMEM =             "mac get_appeui";                 // 3.2.30
-const char MAC_GET_NWKSKEY[] PROGMEM =            "mac get_nwkskey";                // 3.2.31
-const char MAC_GET_APPSKEY[] PROGMEM =            "mac get_appskey";                // 3.2.32
-const char MAC_GET_APPKEY[] PROGMEM =             "mac get_appkey";                 // 3.2.33
-const char MAC_GET_DR[] PROGMEM =                 "mac get_dr";                     // 3.2.34
-const char MAC_GET_BAND[] PROGMEM =               "mac get_band";                   // 3.2.35
-const char MAC_GET_POWER[] PROGMEM =              "mac get_power";                  // 3.2.36
-const char MAC_GET_ADR[] PROGMEM =                "mac get_adr";                    // 3.2.37
-const char MAC_GET_TXRETRY[] PROGMEM =            "mac get_txretry";                // 3.2.38
-const char MAC_GET_RXDELAY[] PROGMEM =            "mac get_rxdelay";                // 3.2.39
-const char MAC_GET_RX2[] PROGMEM =                "mac get_rx2";                    // 3.2.40
-const char MAC_GET_SYNC[] PROGMEM =               "mac get_sync";                   // 3.2.41
-const char MAC_GET_CH_PARA[] PROGMEM =            "mac get_ch_para %d";             // 3.2.42
-const char MAC_GET_CH_STATUS[] PROGMEM =          "mac get_ch_status %d";           // 3.2.43
-const char MAC_GET_DC_CTL[] PROGMEM =             "mac get_dc_ctl";                 // 3.2.44
-const char MAC_GET_DC_BAND[] PROGMEM =            "mac get_dc_band %d";             // 3.2.45
-const char MAC_GET_JOIN_CH[] PROGMEM =            "mac get_join_ch";                // 3.2.46
-const char MAC_GET_UPCNT[] PROGMEM =              "mac get_upcnt";                  // 3.2.47
-const char MAC_GET_DOWNCNT[] PROGMEM =            "mac get_downcnt";                // 3.2.48
-const char MAC_GET_CLASS[] PROGMEM =              "mac get_class";                  // 3.2.49
-const char MAC_SET_TX_MODE[] PROGMEM =            "mac set_tx_mode %s";             // 3.2.50
-const char MAC_GET_TX_MODE[] PROGMEM =            "mac get_tx_mode";                // 3.2.51
-const char MAC_SET_BATT[] PROGMEM =               "mac set_batt %d";                // 3.2.52
-const char MAC_GET_BATT[] PROGMEM =               "mac get_batt";                   // 3.2.53
-const char MAC_SET_TX_CONFIRM[] PROGMEM =         "mac set_tx_confirm %s";          // 3.2.54
-const char MAC_GET_TX_CONFIRM[] PROGMEM =         "mac get_tx_confirm";             // 3.2.55
-const char MAC_SET_LBT[] PROGMEM =                "mac set_lbt %s";                 // 3.2.56
-const char MAC_GET_LBT[] PROGMEM =                "mac get_lbt";                    // 3.2.57
-const char MAC_SET_UPLINK_DWELL[] PROGMEM =       "mac set_uplink_dwell %s";        // 3.2.58
-const char MAC_GET_UPLINK_DWELL[] PROGMEM =       "mac get_uplink_dwell";           // 3.2.59
-const char MAC_SET_DOWNLINK_DWELL[] PROGMEM =     "mac set_downlink_dwell %s";      // 3.2.60
-const char MAC_GET_DOWNLINK_DWELL[] PROGMEM =     "mac get_downlink_dwell";         // 3.2.61
-const char MAC_SET_MAX_EIRP[] PROGMEM =           "mac set_max_eirp %d";            // 3.2.62
-const char MAC_GET_MAX_EIRP[] PROGMEM =           "mac get_max_eirp";               // 3.2.63
-const char MAC_SET_CH_COUNT[] PROGMEM =           "mac set_ch_count %d %d";         // 3.2.64
-const char MAC_GET_CH_COUNT[] PROGMEM =           "mac get_ch_count";               // 3.2.65
-const char MAC_SET_KEYS[] PROGMEM =               "mac set_keys %s %s %s %s %s %s"; // 3.2.66
-const char MAC_SET_TX_INTERVAL[] PROGMEM =        "mac set_tx_interval %lu";        // 3.2.67
-const char MAC_GET_TX_INTERVAL[] PROGMEM =        "mac get_tx_interval";            // 3.2.68
-const char MAC_SET_RX1_FREQ[] PROGMEM =           "mac set_rx1_freq %lu %lu %d";    // 3.2.69
-const char MAC_GET_RX1_FREQ[] PROGMEM =           "mac get_rx1_freq";               // 3.2.70
-const char MAC_SET_AUTO_JOIN[] PROGMEM =          "mac set_auto_join %s %s %d";     // 3.2.71
-const char MAC_GET_AUTO_JOIN[] PROGMEM =          "mac get_auto_join";              // 3.2.72
-const char MAC_SET_POWER_INDEX[] PROGMEM =        "mac set_power_index %d";         // 3.2.73
-const char MAC_GET_POWER_INDEX[] PROGMEM =        "mac get_power_index";            // 3.2.74
-
-const char GPS_SET_LEVEL_SHIFT[] PROGMEM =        "gps set_level_shift %s";         // 3.3.1
-const char GPS_SET_NMEA[] PROGMEM =               "gps set_nmea %s";                // 3.3.2
-const char GPS_SET_PORT_UPLINK[] PROGMEM =        "gps set_port_uplink %d";         // 3.3.3
-const char GPS_SET_FORMAT_UPLINK[] PROGMEM =      "gps set_format_uplink %s";       // 3.3.4
-const char GPS_SET_POSITIONING_CYCLE[] PROGMEM =  "gps set_positioning_cycle %lu";  // 3.3.5
-const char GPS_SET_MODE[] PROGMEM =               "gps set_mode %s";                // 3.3.6
-const char GPS_GET_MODE[] PROGMEM =               "gps get_mode";                   // 3.3.7
-const char GPS_GET_DATA[] PROGMEM =               "gps get_data dd";                // 3.3.8
-const char GPS_SLEEP_ON[] PROGMEM =               "gps sleep on %d";                // 3.3.9
-const char GPS_SLEEP_OFF[] PROGMEM =              "gps sleep off";                  // 3.3.9
-const char GPS_GET_TTFF[] PROGMEM =               "gps get_ttff";                   // 3.3.10
-const char GPS_RESET[] PROGMEM =                  "gps reset";                      // 3.3.11
-const char GPS_SET_SATELLITE_SYSTEM[] PROGMEM =   "gps set_satellite_system %s";    // 3.3.12
-const char GPS_SET_START[] PROGMEM =              "gps set_start %s";               // 3.3.13
+// Argument types on top of uint8_t, uint16_t, uint32_t, char and const char *
+struct S7XGOnOff {
+  S7XGOnOff(bool value) : value(value) {}
+  template<typename T> S7XGOnOff(T *) = delete;
+  bool value;
+};
+
+struct S7XGHex8 {
+  S7XGHex8(uint8_t value) : value(value) {}
+  uint8_t value;
+};
+
+// Command name and the types of its arguments, calls with the wrong arguments do not compile
+template<typename... A> struct S7XGCommand {
+  PGM_P name;
+};
+
+template<typename T> struct S7XGArg {
+  typedef T type;
+};
+
+// The names are only defined in S7XG.cpp, which sets S7XG_COMMAND_NAMES before including this file
+#ifdef S7XG_COMMAND_NAMES
+#define S7XG_COMMAND_NAME(command, text) \
+  extern const char command##_NAME[] PROGMEM; \
+  const char command##_NAME[] PROGMEM = text
+#else
+#define S7XG_COMMAND_NAME(command, text) \
+  extern const char command##_NAME[] PROGMEM
+#endif
+
+#define S7XG_COMMAND(command, text, ...) \
+  S7XG_COMMAND_NAME(command, text); \
+  constexpr S7XGCommand<__VA_ARGS__> command = { command##_NAME }
+
+S7XG_COMMAND(SIP_FACTORY_RESET,          "sip factory_reset");                                                  // 3.1.1
+S7XG_COMMAND(SIP_GET_VER,                "sip get_ver");                                                        // 3.1.2
+S7XG_COMMAND(SIP_RESET,                  "sip reset");                                                          // 3.1.3
+S7XG_COMMAND(SIP_GET_HW_MODEL,           "sip get_hw_model");                                                   // 3.1.4
+S7XG_COMMAND(SIP_SET_ECHO,               "sip set_echo", S7XGOnOff);                                            // 3.1.5
+S7XG_COMMAND(SIP_SET_LOG,                "sip set_log", const char *);                                          // 3.1.6
+S7XG_COMMAND(SIP_SLEEP,                  "sip sleep", uint32_t, const char *);                                  // 3.1.7 (mode: "uart_on" or "uart_off")
+S7XG_COMMAND(SIP_SET_BAUDRATE,           "sip set_baudrate", uint32_t, const char *);                           // 3.1.8
+S7XG_COMMAND(SIP_GET_HW_MODEL_VER,       "sip get_hw_model_ver");                                               // 3.1.9
+S7XG_COMMAND(SIP_SET_GPIO_MODE,          "sip set_gpio_mode", char, uint8_t, uint8_t);                          // 3.1.10
+S7XG_COMMAND(SIP_SET_GPIO,               "sip set_gpio", char, uint8_t, uint8_t);                               // 3.1.11
+S7XG_COMMAND(SIP_GET_GPIO,               "sip get_gpio", char, uint8_t);                                        // 3.1.12
+S7XG_COMMAND(SIP_GET_UUID,               "sip get_uuid");                                                       // 3.1.13
+S7XG_COMMAND(SIP_SET_STORAGE,            "sip set_storage", const char *);                                      // 3.1.14
+S7XG_COMMAND(SIP_GET_STORAGE,            "sip get_storage");                                                    // 3.1.15
+S7XG_COMMAND(SIP_SET_BATT_RESISTOR,      "sip set_batt_resistor", uint32_t, uint32_t);                          // 3.1.16
+S7XG_COMMAND(SIP_GET_BATT_RESISTOR,      "sip get_batt_resistor");                                              // 3.1.17
+S7XG_COMMAND(SIP_GET_BATT_VOLT,          "sip get_batt_volt");                                                  // 3.1.18
+
+S7XG_COMMAND(MAC_TX,                     "mac tx", const char *, uint8_t);                                      // 3.2.1 (payload is streamed)
+S7XG_COMMAND(MAC_JOIN_ABP,               "mac join abp");                                                       // 3.2.2
+S7XG_COMMAND(MAC_JOIN_OTAA,              "mac join otaa");                                                      // 3.2.2
+S7XG_COMMAND(MAC_SAVE,                   "mac save");                                                           // 3.2.3
+S7XG_COMMAND(MAC_GET_JOIN_STATUS,        "mac get_join_status");                                                // 3.2.4
+S7XG_COMMAND(MAC_SET_LINKCHK,            "mac set_linkchk");                                                    // 3.2.5
+S7XG_COMMAND(MAC_SET_DEVEUI,             "mac set_deveui", const char *);                                       // 3.2.6
+S7XG_COMMAND(MAC_SET_APPEUI,             "mac set_appeui", const char *);                                       // 3.2.7
+S7XG_COMMAND(MAC_SET_APPKEY,             "mac set_appkey", const char *);                                       // 3.2.8
+S7XG_COMMAND(MAC_SET_DEVADDR,            "mac set_devaddr", const char *);                                      // 3.2.9
+S7XG_COMMAND(MAC_SET_NWKSKEY,            "mac set_nwkskey", const char *);                                      // 3.2.10
+S7XG_COMMAND(MAC_SET_APPSKEY,            "mac set_appskey", const char *);                                      // 3.2.11
+S7XG_COMMAND(MAC_SET_POWER,              "mac set_power", uint8_t);                                             // 3.2.12
+S7XG_COMMAND(MAC_SET_DR,                 "mac set_dr", uint8_t);                                                // 3.2.13
+S7XG_COMMAND(MAC_SET_ADR,                "mac set_adr", S7XGOnOff);                                             // 3.2.14
+S7XG_COMMAND(MAC_SET_TXRETRY,            "mac set_txretry", uint8_t);                                           // 3.2.15
+S7XG_COMMAND(MAC_SET_RXDELAY1,           "mac set_rxdelay1", uint16_t);                                         // 3.2.16
+S7XG_COMMAND(MAC_SET_RX2,                "mac set_rx2", uint8_t, uint32_t);                                     // 3.2.17
+S7XG_COMMAND(MAC_SET_SYNC,               "mac set_sync", S7XGHex8);                                             // 3.2.18
+S7XG_COMMAND(MAC_SET_CH_FREQ,            "mac set_ch_freq", uint8_t, uint32_t);                                 // 3.2.19
+S7XG_COMMAND(MAC_SET_CH_DR_RANGE,        "mac set_ch_dr_range", uint8_t, uint8_t, uint8_t);                     // 3.2.20
+S7XG_COMMAND(MAC_SET_CH_STATUS,          "mac set_ch_status", uint8_t, S7XGOnOff);                              // 3.2.21
+S7XG_COMMAND(MAC_SET_DC_CTL,             "mac set_dc_ctl", S7XGOnOff);                                          // 3.2.22
+S7XG_COMMAND(MAC_SET_DC_BAND,            "mac set_dc_band", uint8_t, uint16_t);                                 // 3.2.23
+S7XG_COMMAND(MAC_SET_JOIN_CH,            "mac set_join_ch", uint8_t, S7XGOnOff);                                // 3.2.24
+S7XG_COMMAND(MAC_SET_UPCNT,              "mac set_upcnt", uint32_t);                                            // 3.2.25
+S7XG_COMMAND(MAC_SET_DOWNCNT,            "mac set_downcnt", uint32_t);                                          // 3.2.26
+S7XG_COMMAND(MAC_SET_CLASS,              "mac set_class", char);                                                // 3.2.27
+S7XG_COMMAND(MAC_GET_DEVADDR,            "mac get_devaddr");                                                    // 3.2.28
+S7XG_COMMAND(MAC_GET_DEVEUI,             "mac get_deveui");                                                     // 3.2.29
+S7XG_COMMAND(MAC_GET_APPEUI,             "mac get_appeui");                                                     // 3.2.30
+S7XG_COMMAND(MAC_GET_NWKSKEY,            "mac get_nwkskey");                                                    // 3.2.31
+S7XG_COMMAND(MAC_GET_APPSKEY,            "mac get_appskey");                                                    // 3.2.32
+S7XG_COMMAND(MAC_GET_APPKEY,             "mac get_appkey");                                                     // 3.2.33
+S7XG_COMMAND(MAC_GET_DR,                 "mac get_dr");                                                         // 3.2.34
+S7XG_COMMAND(MAC_GET_BAND,               "mac get_band");                                                       // 3.2.35
+S7XG_COMMAND(MAC_GET_POWER,              "mac get_power");                                                      // 3.2.36
+S7XG_COMMAND(MAC_GET_ADR,                "mac get_adr");                                                        // 3.2.37
+S7XG_COMMAND(MAC_GET_TXRETRY,            "mac get_txretry");                                                    // 3.2.38
+S7XG_COMMAND(MAC_GET_RXDELAY,            "mac get_rxdelay");                                                    // 3.2.39
+S7XG_COMMAND(MAC_GET_RX2,                "mac get_rx2");                                                        // 3.2.40
+S7XG_COMMAND(MAC_GET_SYNC,               "mac get_sync");                                                       // 3.2.41
+S7XG_COMMAND(MAC_GET_CH_PARA,            "mac get_ch_para", uint8_t);                                           // 3.2.42
+S7XG_COMMAND(MAC_GET_CH_STATUS,          "mac get_ch_status", uint8_t);                                         // 3.2.43
+S7XG_COMMAND(MAC_GET_DC_CTL,             "mac get_dc_ctl");                                                     // 3.2.44
+S7XG_COMMAND(MAC_GET_DC_BAND,            "mac get_dc_band", uint8_t);                                           // 3.2.45
+S7XG_COMMAND(MAC_GET_JOIN_CH,            "mac get_join_ch");                                                    // 3.2.46
+S7XG_COMMAND(MAC_GET_UPCNT,              "mac get_upcnt");                                                      // 3.2.47
+S7XG_COMMAND(MAC_GET_DOWNCNT,            "mac get_downcnt");                                                    // 3.2.48
+S7XG_COMMAND(MAC_GET_CLASS,              "mac get_class");                                                      // 3.2.49
+S7XG_COMMAND(MAC_SET_TX_MODE,            "mac set_tx_mode", const char *);                                      // 3.2.50
+S7XG_COMMAND(MAC_GET_TX_MODE,            "mac get_tx_mode");                                                    // 3.2.51
+S7XG_COMMAND(MAC_SET_BATT,               "mac set_batt", uint8_t);                                              // 3.2.52
+S7XG_COMMAND(MAC_GET_BATT,               "mac get_batt");                                                       // 3.2.53
+S7XG_COMMAND(MAC_SET_TX_CONFIRM,         "mac set_tx_confirm", S7XGOnOff);                                      // 3.2.54
+S7XG_COMMAND(MAC_GET_TX_CONFIRM,         "mac get_tx_confirm");                                                 // 3.2.55
+S7XG_COMMAND(MAC_SET_LBT,                "mac set_lbt", S7XGOnOff);                                             // 3.2.56
+S7XG_COMMAND(MAC_GET_LBT,                "mac get_lbt");                                                        // 3.2.57
+S7XG_COMMAND(MAC_SET_UPLINK_DWELL,       "mac set_uplink_dwell", S7XGOnOff);                                    // 3.2.58
+S7XG_COMMAND(MAC_GET_UPLINK_DWELL,       "mac get_uplink_dwell");                                               // 3.2.59
+S7XG_COMMAND(MAC_SET_DOWNLINK_DWELL,     "mac set_downlink_dwell", S7XGOnOff);                                  // 3.2.60
+S7XG_COMMAND(MAC_GET_DOWNLINK_DWELL,     "mac get_downlink_dwell");                                             // 3.2.61
+S7XG_COMMAND(MAC_SET_MAX_EIRP,           "mac set_max_eirp", uint8_t);                                          // 3.2.62
+S7XG_COMMAND(MAC_GET_MAX_EIRP,           "mac get_max_eirp");                                                   // 3.2.63
+S7XG_COMMAND(MAC_SET_CH_COUNT,           "mac set_ch_count", uint8_t, uint8_t);                                 // 3.2.64
+S7XG_COMMAND(MAC_GET_CH_COUNT,           "mac get_ch_count");                                                   // 3.2.65
+S7XG_COMMAND(MAC_SET_KEYS,               "mac set_keys", const char *, const char *, const char *, const char *, const char *, const char *); // 3.2.66
+S7XG_COMMAND(MAC_SET_TX_INTERVAL,        "mac set_tx_interval", uint32_t);                                      // 3.2.67
+S7XG_COMMAND(MAC_GET_TX_INTERVAL,        "mac get_tx_interval");                                                // 3.2.68
+S7XG_COMMAND(MAC_SET_RX1_FREQ,           "mac set_rx1_freq", uint32_t, uint32_t, uint8_t);                      // 3.2.69
+S7XG_COMMAND(MAC_GET_RX1_FREQ,           "mac get_rx1_freq");                                                   // 3.2.70
+S7XG_COMMAND(MAC_SET_AUTO_JOIN,          "mac set_auto_join", S7XGOnOff, const char *, uint8_t);                // 3.2.71
+S7XG_COMMAND(MAC_GET_AUTO_JOIN,          "mac get_auto_join");                                                  // 3.2.72
+S7XG_COMMAND(MAC_SET_POWER_INDEX,        "mac set_power_index", uint8_t);                                       // 3.2.73
+S7XG_COMMAND(MAC_GET_POWER_INDEX,        "mac get_power_index");                                                // 3.2.74
+
+S7XG_COMMAND(GPS_SET_LEVEL_SHIFT,        "gps set_level_shift", S7XGOnOff);                                     // 3.3.1
+S7XG_COMMAND(GPS_SET_NMEA,               "gps set_nmea", const char *);                                         // 3.3.2
+S7XG_COMMAND(GPS_SET_PORT_UPLINK,        "gps set_port_uplink", uint8_t);                                       // 3.3.3
+S7XG_COMMAND(GPS_SET_FORMAT_UPLINK,      "gps set_format_uplink", const char *);                                // 3.3.4
+S7XG_COMMAND(GPS_SET_POSITIONING_CYCLE,  "gps set_positioning_cycle", uint32_t);                                // 3.3.5
+S7XG_COMMAND(GPS_SET_MODE,               "gps set_mode", const char *);                                         // 3.3.6
+S7XG_COMMAND(GPS_GET_MODE,               "gps get_mode");                                                       // 3.3.7
+S7XG_COMMAND(GPS_GET_DATA,               "gps get_data dd");                                                    // 3.3.8
+S7XG_COMMAND(GPS_SLEEP_ON,               "gps sleep on", uint8_t);                                              // 3.3.9
+S7XG_COMMAND(GPS_SLEEP_OFF,              "gps sleep off");                                                      // 3.3.9
+S7XG_COMMAND(GPS_GET_TTFF,               "gps get_ttff");                                                       // 3.3.10
+S7XG_COMMAND(GPS_RESET,                  "gps reset");                                                          // 3.3.11
+S7XG_COMMAND(GPS_SET_SATELLITE_SYSTEM,   "gps set_satellite_system", const char *);                             // 3.3.12
+S7XG_COMMAND(GPS_SET_START,              "gps set_start", const char *);                                        // 3.3.13
 
 // ----------------------------------------------------------------------------
 // Class definition
 // ----------------------------------------------------------------------------
 
+class S7XGBuilder {
+
+  public:
+
+    S7XGBuilder(char * buffer, size_t size, PGM_P name);
+    S7XGBuilder & operator<<(uint8_t value);
+    S7XGBuilder & operator<<(uint16_t value);
+    S7XGBuilder & operator<<(uint32_t value);
+    S7XGBuilder & operator<<(char value);
+    S7XGBuilder & operator<<(const char * value);
+    S7XGBuilder & operator<<(S7XGOnOff value);
+    S7XGBuilder & operator<<(S7XGHex8 value);
+    bool overflow();
+
+  protected:
+
+    bool _room(size_t len);
+    void _write(const char * data, size_t len);
+
+    char * _buffer;
+    size_t _size;
+    size_t _length = 0;
+    bool _overflow = false;
+
+};
+
+class S7XG;
+
+class S7XGAsync {
+
+  public:
+
+    S7XGAsync(S7XG * module) : _module(module) {}
+    S7XGAsync(S7XGAsync && other) : _module(other._module) { other._module = NULL; }
+    S7XGAsync(const S7XGAsync &) = delete;
+    ~S7XGAsync();
+    S7XG * operator->() { return _module; }
+    bool failed();
+
+  protected:
+
+    S7XG * _module;
+
+};
+
+class S7XGMulti;
+
 class S7XG {
 
+  friend class S7XGAsync;
+  friend class S7XGMulti;
+
   public:
 
+    ~S7XG();
     void begin(Stream &);
+    bool begin(Stream &, s7xg_baudrate_callback_t callback, const char * password, uint32_t max = 115200, void * arg = NULL);
+    uint32_t negotiateBaudrate(s7xg_baudrate_callback_t callback, const char * password, uint32_t max = 115200, void * arg = NULL);
+    uint32_t getBaudrate();
+
+    // Async
+    S7XGAsync async(s7xg_callback_t callback, void * arg = NULL);
+    void loop();
+    bool busy();
+    uint8_t getStatus();
+    void beginBatch();
+    bool endBatch();
+    const s7xg_report_t & getReport();
+
+    // Settings
+    bool configure(const s7xg_settings_t & settings);
+    static uint32_t settingsHash(const s7xg_settings_t & settings);
+
+    // Statistics
+    const s7xg_stats_t & getStats(uint8_t kind);
+    const s7xg_link_stats_t & getLinkStats();
+    uint32_t getLatencyPercentile(uint8_t kind, uint8_t percent);
+    void resetStats();
+    void setTimeouts(uint16_t floor, uint16_t ceiling);
+    uint16_t getTimeout(uint8_t kind, bool longer = false);
+
+    // Events
+    void onDownlink(s7xg_downlink_callback_t callback, void * arg = NULL);
+    void onTxDone(s7xg_event_callback_t callback, void * arg = NULL);
+    void onJoin(s7xg_event_callback_t callback, void * arg = NULL);
+    void onGpsFix(s7xg_gps_callback_t callback, void * arg = NULL);
+
+    void invalidate();
 
     void reset();
+    void factoryReset();
     bool sleep(uint32_t seconds);
     bool wake();
     char * getResponse();
@@ -250,14 +670,20 @@ class S7XG {
     char * getEUI();
 
     // LoRaWAN
-    bool macSend(char * data, bool confirmed = false, uint8_t port = 1);
-    bool macSend(uint8_t * data, uint8_t len, bool confirmed = false, uint8_t port = 1);
+    bool macSend(const char * data, bool confirmed = false, uint8_t port = 1);
+    bool macSend(const uint8_t * data, uint8_t len, bool confirmed = false, uint8_t port = 1);
     bool macJoinABP(const char * devaddr, const char * nwkskey, const char * appskey);
     bool macJoinOTAA(const char * deveui, const char * appeui, const char * appkey);
     bool macJoinOTAA(const char * appeui, const char * appkey);
+    bool macKeys(const char * deveui, const char * appeui, const char * appkey, const char * devaddr, const char * nwkskey, const char * appskey);
     bool macSave();
     bool macJoined();
     bool macWaitJoined(uint32_t timeout = 10000);
+    bool macAutoJoin(const char * deveui, const char * appeui, const char * appkey, bool save = true, uint8_t attempts = 0);
+    bool macAutoJoin(const char * appeui, const char * appkey, bool save = true, uint8_t attempts = 0);
+    uint8_t macJoinState();
+    uint8_t macJoinAttempts();
+    uint32_t macJoinNext();
     bool macPower(uint8_t power);
     bool macDatarate(uint8_t dr);
     bool macADR(bool adr);
@@ -274,6 +700,28 @@ class S7XG {
     uint32_t macDownCounter();
     bool txCycle(uint32_t seconds);
 
+    // Uplink queue
+    bool macQueue(const uint8_t * data, uint8_t len, uint8_t port = 1, uint8_t priority = S7XG_PRIORITY_NORMAL, uint8_t flags = 0);
+    uint8_t macQueued();
+    void macClearQueue();
+    void setUplinkInterval(uint32_t ms);
+
+    // Confirmed uplinks
+    void onDelivery(s7xg_delivery_callback_t callback, void * arg = NULL);
+    void setConfirmPolicy(uint8_t retries, uint32_t timeout = S7XG_CONFIRM_TIMEOUT);
+    uint8_t macInFlight();
+
+    // Airtime
+    static constexpr uint32_t symbolTime(uint8_t sf, uint16_t bw);
+    static constexpr uint32_t timeOnAir(uint8_t sf, uint16_t bw, uint8_t len, uint8_t cr = 1, bool header = true, bool crc = true, uint8_t preamble = 8);
+    static constexpr uint8_t spreadingFactor(uint16_t band, uint8_t dr);
+    static constexpr uint16_t bandwidth(uint16_t band, uint8_t dr);
+    static constexpr uint32_t uplinkAirtime(uint16_t band, uint8_t dr, uint8_t len);
+    static constexpr uint16_t dutyCycle(uint16_t band);
+    uint32_t airtimeBudget();
+    uint32_t nextUplinkIn(uint8_t len);
+    uint8_t uplinksInBudget(uint8_t len);
+
     // GPS
     bool gpsInit();
     bool gpsPort(uint8_t port);
@@ -281,7 +729,10 @@ class S7XG {
     bool gpsCycle(uint32_t seconds);
     bool gpsMode(uint8_t mode);
     uint8_t gpsMode();
+    bool gpsNmea(const char * sentences);
+    const gps_fix_t & gpsFix();
     gps_message_t gpsData();
+    static uint8_t gpsParse(const char * line, gps_message_t & message);
     bool gpsSleep(bool deep);
     bool gpsWake();
     bool gpsReset();
@@ -289,23 +740,270 @@ class S7XG {
     bool gpsStart(uint8_t mode);
 
     // Utils
-    char * hexlify(uint8_t * source, char * destination, uint8_t len);
+    char * hexlify(const uint8_t * source, char * destination, uint8_t len);
     uint8_t * unhexlify(char * source, uint8_t * destination, uint8_t len);
 
   protected:
 
-    void _flush();
     template<typename T> void _send(T * s);
-    template<typename T> char * _sendAndReturn(T * s);
-    bool _sendAndACK(PGM_P format_P, ...);
-
-    uint8_t _readLine();
+    void _sendHex(const uint8_t * data, uint8_t len);
+    template<typename... A> char * _sendAndReturn(const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args);
+    template<typename... A> bool _sendAndACK(const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args);
+    template<typename... A> bool _sendAndCache(const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args);
+    template<typename... A> bool _sendAndExpect(uint8_t flags, const char * expect, const char * then, const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args);
+    template<typename... A> bool _apply(bool & changed, const S7XGCommand<> & get, const S7XGCommand<A...> & set, typename S7XGArg<A>::type... args);
+    template<typename... A> static bool _build(char * buffer, size_t size, const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args);
+
+    template<typename... A> uint16_t _submit(uint8_t flags, const char * expect, const char * then, const S7XGCommand<A...> & command, typename S7XGArg<A>::type... args);
+    s7xg_job_t * _reserve(uint8_t flags);
+    uint16_t _commit(s7xg_job_t * job, uint8_t flags, const char * expect, const char * then, PGM_P name, bool built);
+    bool _wait(uint16_t id);
+    bool _match(const char * expect, uint8_t flags);
+    void _done(uint8_t status);
+    void _drop(uint8_t group, bool started);
+    s7xg_job_t * _find(uint16_t id);
+    uint8_t _nextGroup();
+    void _closeGroup();
+    bool _cached(PGM_P name, const char * command);
+    void _cache(PGM_P name, const char * command, bool valid);
+    static uint32_t _hash(const void * data, size_t len, uint32_t hash = 2166136261UL);
+    static uint32_t _hash(const char * s, uint32_t hash = 2166136261UL);
+    void _account(s7xg_job_t * job, uint8_t status);
+    static uint8_t _kind(const char * command);
+    void _learn(uint8_t kind, bool longer, uint32_t ms);
+    void _start();
+    void _schedule();
+    uint32_t _airtime(uint8_t len);
+    void _refill();
+    static constexpr int32_t _payloadBits(uint8_t sf, uint8_t len, bool header, bool crc);
+    static constexpr uint32_t _payloadSymbols(int32_t bits, uint8_t sf, bool ldro, uint8_t cr);
+    static void _uplinkDone(uint8_t status, char * response, void * arg);
+    static void _counterRead(uint8_t status, char * response, void * arg);
+    void _track(s7xg_job_t * job);
+    void _resolve(uint8_t status);
+    void _expire();
+    void _joinStep();
+    bool _joinAttempt();
+    void _joinResult(bool accepted);
+    uint32_t _joinRandom(uint32_t max);
+    static void _joinChecked(uint8_t status, char * response, void * arg);
+    static void _joinSent(uint8_t status, char * response, void * arg);
+    static void _joinSaved(uint8_t status, char * response, void * arg);
+    uint8_t _openBatch();
+    bool _closeBatch(uint8_t group);
+    bool _setKeys(const char * deveui, const char * appeui, const char * appkey, const char * devaddr, const char * nwkskey, const char * appskey);
+    bool _isHex(const char * value, uint8_t length);
+    uint32_t _locate();
+    bool _probe();
+    bool _switchBaudrate(uint32_t baudrate);
+    uint8_t _classify();
+    void _notify(uint8_t event);
+
+    bool _fill();
+    bool _readLine();
     uint8_t _nibble(char ch);
+    static bool _parseToken(const char * & p, const char * token);
+    static bool _parseUnsigned(const char * & p, uint32_t & value);
+    static bool _parseFixed(const char * & p, uint8_t decimals, uint32_t & value);
     void _nice_delay(uint32_t ms);
+    void _idle();
 
     Stream *_stream;
+    S7XGMulti * _multi = NULL;
     bool _wait_longer = false;
+    const uint8_t * _payload = NULL;
+    uint8_t _payload_len = 0;
+    uint8_t _payload_port = 0;
+    bool _payload_confirmed = false;
+    uint8_t _payload_slot = 0xFF;
     char _buffer[S7XG_RX_BUFFER_SIZE];
     char _eui[17] = {0};
+    char _version[32] = {0};
+    char _hardware[16] = {0};
+    uint16_t _band = 0;
+    uint32_t _upcnt = 0;
+    bool _upcnt_valid = false;
+
+    s7xg_shadow_t _shadow[S7XG_SHADOW_SIZE];
+    uint8_t _shadow_count = 0;
+    uint32_t _settings_hash = 0;
+
+    s7xg_stats_t _stats[S7XG_KIND_COUNT];
+    s7xg_link_stats_t _link;
+
+    uint16_t _rtt[S7XG_KIND_COUNT][2];
+    uint16_t _rtt_var[S7XG_KIND_COUNT][2];
+    uint16_t _timeout_floor = S7XG_TIMEOUT_FLOOR;
+    uint16_t _timeout_ceiling = S7XG_TIMEOUT_CEILING;
+
+    s7xg_baudrate_callback_t _baudrate_callback = NULL;
+    void * _baudrate_arg = NULL;
+    uint32_t _baudrate = 0;
+
+    s7xg_job_t _jobs[S7XG_QUEUE_SIZE];
+    uint8_t _job_head = 0;
+    uint8_t _job_count = 0;
+    uint8_t _job_step = S7XG_STEP_IDLE;
+    uint16_t _job_id = 0;
+    uint32_t _job_start = 0;
+    uint32_t _job_late = 0;
+    uint32_t _job_sent = 0;
+    uint8_t _status = S7XG_STATUS_PENDING;
+    uint16_t _wait_id = 0;
+    uint8_t _wait_status = S7XG_STATUS_PENDING;
+
+    char _rx[S7XG_RX_CHUNK_SIZE];
+    uint8_t _rx_position = 0;
+    uint8_t _rx_length = 0;
+    uint16_t _rx_pointer = 0;
+    uint8_t _rx_flag = 0;
+    bool _rx_overflow = false;
+
+    uint8_t _group = 0;
+    uint8_t _group_count = 0;
+    bool _group_failed = false;
+    s7xg_callback_t _group_callback = NULL;
+    void * _group_arg = NULL;
+    bool _group_blocking = false;
+    uint8_t _batch = 0;
+    uint8_t _report_group = 0;
+    s7xg_report_t _report = { S7XG_STATUS_PENDING, 0, NULL };
+    bool _keys_checked = false;
+    bool _keys_supported = false;
+
+    s7xg_downlink_callback_t _downlink_callback = NULL;
+    void * _downlink_arg = NULL;
+    s7xg_event_callback_t _tx_callback = NULL;
+    void * _tx_arg = NULL;
+    s7xg_event_callback_t _join_callback = NULL;
+    void * _join_arg = NULL;
+    uint8_t _tx_pending = 0;
+    uint32_t _tx_sent = 0;
+    bool _tx_cycle = false;
+    bool _gps_auto = false;
+
+    S7XGNmea _nmea;
+    s7xg_gps_callback_t _gps_callback = NULL;
+    void * _gps_arg = NULL;
+    bool _gps_fresh = false;
+
+    s7xg_uplink_t _uplinks[S7XG_UPLINK_QUEUE_SIZE];
+    uint8_t _uplink_used = 0;
+    uint8_t _uplink_sending = 0xFF;
+    uint16_t _uplink_sequence = 0;
+    uint32_t _uplink_ready = 0;
+    uint32_t _uplink_interval = 0;
+    uint32_t _uplink_backoff = S7XG_UPLINK_BACKOFF;
+    uint8_t _uplink_waiting = 0;
+
+    s7xg_inflight_t _inflight[S7XG_INFLIGHT_SIZE];
+    uint8_t _inflight_head = 0;
+    uint8_t _inflight_count = 0;
+    uint8_t _confirm_retries = S7XG_CONFIRM_RETRIES;
+    uint32_t _confirm_timeout = S7XG_CONFIRM_TIMEOUT;
+    s7xg_delivery_callback_t _delivery_callback = NULL;
+    void * _delivery_arg = NULL;
+
+    uint8_t _join_state = S7XG_JOIN_IDLE;
+    bool _join_save = true;
+    bool _join_issued = false;
+    bool _join_keys = false;
+    uint8_t _join_max = 0;
+    uint8_t _join_attempts = 0;
+    const char * _join_deveui = NULL;
+    const char * _join_appeui = NULL;
+    const char * _join_appkey = NULL;
+    uint32_t _join_started = 0;
+    uint32_t _join_deadline = 0;
+    uint32_t _join_sent = 0;
+    uint32_t _join_window = 0;
+    uint32_t _join_spent = 0;
+    uint32_t _join_seed = 0;
+
+    uint8_t _dr = 0xFF;
+    uint32_t _budget = 0xFFFFFFFF;
+    uint32_t _budget_updated = 0;
 
 };
+
+// ----------------------------------------------------------------------------
+// Airtime (constexpr, usable at compile time)
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Duration of a LoRa symbol
+ * @param[in] sf        Spreading factor (7-12)
+ * @param[in] bw        Bandwidth in kHz (125, 250 or 500)
+ * @return              Microseconds
+ */
+constexpr uint32_t S7XG::symbolTime(uint8_t sf, uint16_t bw) {
+  return (1UL << sf) * 1000UL / bw;
+}
+
+constexpr int32_t S7XG::_payloadBits(uint8_t sf, uint8_t len, bool header, bool crc) {
+  return 8L * len - 4L * sf + 28 + (crc ? 16 : 0) - (header ? 0 : 20);
+}
+
+constexpr uint32_t S7XG::_payloadSymbols(int32_t bits, uint8_t sf, bool ldro, uint8_t cr) {
+  return 8 + ((bits > 0) ? ((bits + 4 * (sf - (ldro ? 2 : 0)) - 1) / (4 * (sf - (ldro ? 2 : 0)))) * (cr + 4) : 0);
+}
+
+/**
+ * @brief               LoRa time on air, as per Semtech AN1200.13
+ * @details             Low data rate optimisation is on for symbols of 16 ms or longer.
+ * @param[in] sf        Spreading factor (7-12)
+ * @param[in] bw        Bandwidth in kHz (125, 250 or 500)
+ * @param[in] len       PHY payload length in bytes (application payload + 13 for a LoRaWAN uplink)
+ * @param[in] cr        Coding rate, 1 to 4 for 4/5 to 4/8 (defaults to 1)
+ * @param[in] header    Explicit header (defaults to true)
+ * @param[in] crc       Payload CRC (defaults to true)
+ * @param[in] preamble  Preamble symbols (defaults to 8)
+ * @return              Microseconds
+ */
+constexpr uint32_t S7XG::timeOnAir(uint8_t sf, uint16_t bw, uint8_t len, uint8_t cr, bool header, bool crc, uint8_t preamble) {
+  return (4UL * preamble + 17) * symbolTime(sf, bw) / 4 +
+    _payloadSymbols(_payloadBits(sf, len, header, crc), sf, symbolTime(sf, bw) >= 16000, cr) * symbolTime(sf, bw);
+}
+
+/**
+ * @brief               Spreading factor of an uplink data rate
+ * @param[in] band      Band as returned by macBand (915 for US, 470 for CN, EU otherwise)
+ * @param[in] dr        Data rate (see S7XG_DR_*)
+ * @return              Spreading factor
+ */
+constexpr uint8_t S7XG::spreadingFactor(uint16_t band, uint8_t dr) {
+  return (915 == band) ? ((dr < 4) ? 10 - dr : 8) : ((dr < 6) ? 12 - dr : 7);
+}
+
+/**
+ * @brief               Bandwidth of an uplink data rate
+ * @param[in] band      Band as returned by macBand (915 for US, 470 for CN, EU otherwise)
+ * @param[in] dr        Data rate (see S7XG_DR_*)
+ * @return              Bandwidth in kHz
+ */
+constexpr uint16_t S7XG::bandwidth(uint16_t band, uint8_t dr) {
+  return (915 == band) ? ((4 == dr) ? 500 : 125) : ((470 != band) && (6 == dr)) ? 250 : 125;
+}
+
+/**
+ * @brief               Time on air of a LoRaWAN uplink (4/5 coding rate, 13 bytes of MAC overhead)
+ * @param[in] band      Band as returned by macBand
+ * @param[in] dr        Data rate (see S7XG_DR_*)
+ * @param[in] len       Application payload length
+ * @return              Microseconds
+ */
+constexpr uint32_t S7XG::uplinkAirtime(uint16_t band, uint8_t dr, uint8_t len) {
+  return timeOnAir(spreadingFactor(band, dr), bandwidth(band, dr), len + 13);
+}
+
+/**
+ * @brief               Duty cycle limit of a band
+ * @details             1% for the European bands (the sub-band of the default channels), none elsewhere
+ *                      (US915 has a dwell time limit instead).
+ * @param[in] band      Band as returned by macBand
+ * @return              Per mille of the time the device can transmit (1000 if not limited)
+ */
+constexpr uint16_t S7XG::dutyCycle(uint16_t band) {
+  return ((868 == band) || (433 == band)) ? 10 : 1000;
+}
+
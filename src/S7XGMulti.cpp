@@ -0,0 +1,172 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+Drives several modules, each on its own serial port, from a single loop.
+Every pass calls loop() once on each module, so their commands are in
+flight at the same time and a slow module does not hold the others back.
+The module served first rotates on every pass and each module completes
+at most one command per turn, so a module with a long queue cannot starve
+the rest. While a module blocks in a synchronous call it keeps serving the
+other modules of the manager, so blocking and async code can be mixed.
+
+*/
+
+#include "S7XGMulti.h"
+
+// ----------------------------------------------------------------------------
+// Modules
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Releases the modules
+ */
+S7XGMulti::~S7XGMulti() {
+    while (_count) remove(*_modules[0]);
+}
+
+/**
+ * @brief               Adds a module, already bound to its stream with begin()
+ * @details             A module can only belong to one manager.
+ * @param[in] module    Module
+ * @return              False if the manager is full or the module already belongs to a manager
+ */
+bool S7XGMulti::add(S7XG & module) {
+    if ((S7XG_MULTI_SIZE == _count) || module._multi) return false;
+    module._multi = this;
+    _turns[_count] = 0;
+    _modules[_count++] = &module;
+    return true;
+}
+
+/**
+ * @brief               Removes a module, it keeps its queue
+ * @param[in] module    Module
+ * @return              False if the module does not belong to this manager
+ */
+bool S7XGMulti::remove(S7XG & module) {
+    for (uint8_t i=0; i<_count; i++) {
+        if (_modules[i] != &module) continue;
+        module._multi = NULL;
+        _count--;
+        for (uint8_t j=i; j<_count; j++) {
+            _modules[j] = _modules[j + 1];
+            _turns[j] = _turns[j + 1];
+        }
+        if (_next >= _count) _next = 0;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief               Number of modules
+ * @return              Module count
+ */
+uint8_t S7XGMulti::count() {
+    return _count;
+}
+
+/**
+ * @brief               Module at a given position, in the order they were added
+ * @param[in] index     Position
+ * @return              Pointer to the module, NULL if there is no such module
+ */
+S7XG * S7XGMulti::get(uint8_t index) {
+    return (index < _count) ? _modules[index] : NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Scheduling
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Gives every module a turn, call it from your main loop instead of each module loop()
+ */
+void S7XGMulti::loop() {
+    _service(NULL);
+}
+
+/**
+ * @brief               Checks if any module has pending commands
+ * @return              True if there are pending commands
+ */
+bool S7XGMulti::busy() {
+    for (uint8_t i=0; i<_count; i++) {
+        if (_modules[i]->busy()) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief               Runs the modules until none has pending commands
+ * @param[in] timeout   Milliseconds to wait at most (defaults to 0, no limit)
+ * @return              False if the timeout expired first
+ */
+bool S7XGMulti::wait(uint32_t timeout) {
+    uint32_t start = millis();
+    while (busy()) {
+        if (timeout && (millis() - start >= timeout)) return false;
+        loop();
+        yield();
+    }
+    return true;
+}
+
+/**
+ * @brief               Number of turns a module has been given (loop() calls from the manager)
+ * @param[in] index     Position
+ * @return              Turn count
+ */
+uint32_t S7XGMulti::turns(uint8_t index) {
+    return (index < _count) ? _turns[index] : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Private
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Calls loop() once on every module but the caller, starting with a different one each time
+ * @details             Called by the modules while they block. Not reentrant: a module that blocks inside
+ *                      a callback run from here waits on its own.
+ * @param[in] caller    Module that is blocking and runs its own loop (NULL from loop())
+ */
+void S7XGMulti::_service(S7XG * caller) {
+
+    if (_serving || (0 == _count)) return;
+    _serving = true;
+
+    uint8_t first = _next;
+    _next = (_next + 1) % _count;
+    for (uint8_t i=0; i<_count; i++) {
+        uint8_t index = (first + i) % _count;
+        S7XG * module = _modules[index];
+        if (module == caller) continue;
+        _turns[index]++;
+        module->loop();
+
+        // A callback might have removed modules
+        if (index >= _count) break;
+    }
+
+    _serving = false;
+
+}
@@ -0,0 +1,68 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "S7XG.h"
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+// Defaults, override them with build flags (for example -DS7XG_MULTI_SIZE=4)
+#ifndef S7XG_MULTI_SIZE
+#define S7XG_MULTI_SIZE                       8
+#endif
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+class S7XGMulti {
+
+  friend class S7XG;
+
+  public:
+
+    ~S7XGMulti();
+
+    bool add(S7XG & module);
+    bool remove(S7XG & module);
+    uint8_t count();
+    S7XG * get(uint8_t index);
+
+    void loop();
+    bool busy();
+    bool wait(uint32_t timeout = 0);
+    uint32_t turns(uint8_t index);
+
+  protected:
+
+    void _service(S7XG * caller);
+
+    S7XG * _modules[S7XG_MULTI_SIZE];
+    uint32_t _turns[S7XG_MULTI_SIZE];
+    uint8_t _count = 0;
+    uint8_t _next = 0;
+    bool _serving = false;
+
+};
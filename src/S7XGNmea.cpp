@@ -0,0 +1,344 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+Incremental NMEA 0183 parser for the sentences the GPS outputs after
+"gps set_nmea". It is fed one character at a time and never stores the
+sentence: numeric fields are accumulated as they arrive, the checksum is
+computed on the fly and the decoded values are only published once the
+checksum matches. RMC, GGA, GSA and GSV are decoded, from any talker.
+
+*/
+
+#include "S7XGNmea.h"
+
+// States
+enum {
+    S7XG_NMEA_STATE_IDLE = 0,
+    S7XG_NMEA_STATE_BODY,
+    S7XG_NMEA_STATE_CHECKSUM_HIGH,
+    S7XG_NMEA_STATE_CHECKSUM_LOW,
+};
+
+// Keeps numeric fields within 32 bits, extra digits are ignored
+#define S7XG_NMEA_VALUE_LIMIT                 400000000UL
+
+// ----------------------------------------------------------------------------
+// Public
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Creates a parser with no fix
+ */
+S7XGNmea::S7XGNmea() {
+    reset();
+}
+
+/**
+ * @brief               Forgets the current fix, the counters and any half received sentence
+ */
+void S7XGNmea::reset() {
+    memset(&_fix, 0, sizeof(_fix));
+    _state = S7XG_NMEA_STATE_IDLE;
+    _sentences = 0;
+    _errors = 0;
+}
+
+/**
+ * @brief               Processes one character
+ * @details             Characters outside a sentence are ignored. A '$' always starts a new sentence,
+ *                      a sentence cut by another one or by a line end counts as an error.
+ * @param[in] ch        Character
+ * @return              S7XG_NMEA_NONE while the sentence is incomplete, then the sentence type
+ *                      (S7XG_NMEA_RMC... or S7XG_NMEA_OTHER) if the checksum matched or S7XG_NMEA_ERROR
+ */
+uint8_t S7XGNmea::feed(char ch) {
+
+    if ('$' == ch) {
+        bool cut = (S7XG_NMEA_STATE_IDLE != _state);
+        if (cut) _errors++;
+        _start();
+        return cut ? S7XG_NMEA_ERROR : S7XG_NMEA_NONE;
+    }
+
+    switch (_state) {
+
+        case S7XG_NMEA_STATE_BODY:
+            if ('*' == ch) {
+                _field();
+                _state = S7XG_NMEA_STATE_CHECKSUM_HIGH;
+                return S7XG_NMEA_NONE;
+            }
+            if ((ch < ' ') || (ch > '~')) break;
+            _checksum ^= ch;
+            if (',' == ch) {
+                _field();
+                _index++;
+                _value = 0;
+                _decimals = 0;
+                _dot = false;
+                _negative = false;
+                _first = 0;
+            } else if (0 == _index) {
+                _tag[0] = _tag[1];
+                _tag[1] = _tag[2];
+                _tag[2] = ch;
+            } else {
+                if (0 == _first) _first = ch;
+                if (('0' <= ch) && (ch <= '9')) {
+                    if (_value < S7XG_NMEA_VALUE_LIMIT) {
+                        _value = _value * 10 + (ch - '0');
+                        if (_dot) _decimals++;
+                    }
+                } else if ('.' == ch) {
+                    _dot = true;
+                } else if ('-' == ch) {
+                    _negative = true;
+                }
+            }
+            return S7XG_NMEA_NONE;
+
+        case S7XG_NMEA_STATE_CHECKSUM_HIGH:
+            if (_nibble(ch) > 15) break;
+            _expected = _nibble(ch) << 4;
+            _state = S7XG_NMEA_STATE_CHECKSUM_LOW;
+            return S7XG_NMEA_NONE;
+
+        case S7XG_NMEA_STATE_CHECKSUM_LOW:
+            if (_nibble(ch) > 15) break;
+            _state = S7XG_NMEA_STATE_IDLE;
+            if ((_expected | _nibble(ch)) != _checksum) {
+                _errors++;
+                return S7XG_NMEA_ERROR;
+            }
+            _sentences++;
+            if (S7XG_NMEA_OTHER == _type) return _type;
+            _fix = _scratch;
+            return _type;
+
+        default:
+            return S7XG_NMEA_NONE;
+
+    }
+
+    // Unexpected character, drop the sentence
+    _state = S7XG_NMEA_STATE_IDLE;
+    _errors++;
+    return S7XG_NMEA_ERROR;
+
+}
+
+/**
+ * @brief               Last fix, built from all the valid sentences received so far
+ * @return              Fix data, check the valid field before using the values
+ */
+const gps_fix_t & S7XGNmea::fix() {
+    return _fix;
+}
+
+/**
+ * @brief               Number of sentences received with a valid checksum
+ * @return              Sentence count
+ */
+uint32_t S7XGNmea::sentences() {
+    return _sentences;
+}
+
+/**
+ * @brief               Number of sentences dropped (bad checksum, cut or malformed)
+ * @return              Sentence count
+ */
+uint32_t S7XGNmea::errors() {
+    return _errors;
+}
+
+// ----------------------------------------------------------------------------
+// Private
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Starts a new sentence on top of the current fix
+ */
+void S7XGNmea::_start() {
+    _scratch = _fix;
+    _state = S7XG_NMEA_STATE_BODY;
+    _type = S7XG_NMEA_NONE;
+    _index = 0;
+    _checksum = 0;
+    _tag[0] = _tag[1] = _tag[2] = 0;
+    _value = 0;
+    _decimals = 0;
+    _dot = false;
+    _negative = false;
+    _first = 0;
+}
+
+/**
+ * @brief               Stores the field that has just ended in the scratch fix
+ */
+void S7XGNmea::_field() {
+
+    // Address field, the talker (GP, GN, GL...) is not relevant
+    if (0 == _index) {
+        _type =
+            (0 == strncmp(_tag, "RMC", 3)) ? S7XG_NMEA_RMC :
+            (0 == strncmp(_tag, "GGA", 3)) ? S7XG_NMEA_GGA :
+            (0 == strncmp(_tag, "GSA", 3)) ? S7XG_NMEA_GSA :
+            (0 == strncmp(_tag, "GSV", 3)) ? S7XG_NMEA_GSV :
+            S7XG_NMEA_OTHER;
+        return;
+    }
+
+    bool empty = (0 == _first);
+
+    // Time and position are in the same order in RMC and GGA, RMC has the status in between
+    uint8_t index = _index;
+    if ((S7XG_NMEA_RMC == _type) && (index > 2)) index--;
+    if ((S7XG_NMEA_RMC == _type) || (S7XG_NMEA_GGA == _type)) {
+        switch (index) {
+            case 1:
+                if (empty) {
+                    _scratch.valid &= ~S7XG_NMEA_VALID_TIME;
+                } else {
+                    uint32_t time = _scaled(0);
+                    _scratch.hour = time / 10000;
+                    _scratch.minute = (time / 100) % 100;
+                    _scratch.second = time % 100;
+                    _scratch.valid |= S7XG_NMEA_VALID_TIME;
+                }
+                return;
+            case 2:
+                if ((S7XG_NMEA_RMC == _type) && (2 == _index)) {
+                    if ('A' == _first) {
+                        _scratch.valid |= S7XG_NMEA_VALID_POSITION;
+                    } else {
+                        _scratch.valid &= ~S7XG_NMEA_VALID_POSITION;
+                    }
+                    return;
+                }
+                if (!empty) _scratch.latitude_e6 = _coordinate();
+                return;
+            case 3:
+                if ('S' == _first) _scratch.latitude_e6 = -_scratch.latitude_e6;
+                return;
+            case 4:
+                if (!empty) _scratch.longitude_e6 = _coordinate();
+                return;
+            case 5:
+                if ('W' == _first) _scratch.longitude_e6 = -_scratch.longitude_e6;
+                return;
+        }
+    }
+
+    switch (_type) {
+
+        case S7XG_NMEA_RMC:
+            if (7 == _index) {
+                uint32_t speed = (_scaled(2) * 5144UL + 5000) / 10000;
+                _scratch.speed_cms = (speed > 0xFFFF) ? 0xFFFF : speed;
+            } else if (8 == _index) {
+                _scratch.course_cdeg = _scaled(2);
+            } else if ((9 == _index) && !empty) {
+                uint32_t date = _scaled(0);
+                _scratch.day = date / 10000;
+                _scratch.month = (date / 100) % 100;
+                _scratch.year = 2000 + date % 100;
+                _scratch.valid |= S7XG_NMEA_VALID_DATE;
+            }
+            return;
+
+        case S7XG_NMEA_GGA:
+            if (6 == _index) {
+                _scratch.quality = _scaled(0);
+                if (_scratch.quality) {
+                    _scratch.valid |= S7XG_NMEA_VALID_POSITION;
+                } else {
+                    _scratch.valid &= ~(S7XG_NMEA_VALID_POSITION | S7XG_NMEA_VALID_ALTITUDE);
+                }
+            } else if (7 == _index) {
+                _scratch.satellites_used = _scaled(0);
+            } else if ((8 == _index) && !empty) {
+                _scratch.hdop = _scaled(2);
+            } else if ((9 == _index) && !empty && _scratch.quality) {
+                int32_t altitude = _scaled(2);
+                _scratch.altitude_cm = _negative ? -altitude : altitude;
+                _scratch.valid |= S7XG_NMEA_VALID_ALTITUDE;
+            }
+            return;
+
+        case S7XG_NMEA_GSA:
+            if (2 == _index) {
+                _scratch.fix_type = _scaled(0);
+                _scratch.satellites_used = 0;
+            } else if ((_index < 15) && !empty) {
+                _scratch.satellites_used++;
+            } else if (15 == _index) {
+                _scratch.pdop = _scaled(2);
+            } else if (16 == _index) {
+                _scratch.hdop = _scaled(2);
+            } else if (17 == _index) {
+                _scratch.vdop = _scaled(2);
+                if (!empty) _scratch.valid |= S7XG_NMEA_VALID_DOP;
+            }
+            return;
+
+        case S7XG_NMEA_GSV:
+            if (3 == _index) _scratch.satellites_view = _scaled(0);
+            return;
+
+    }
+
+}
+
+/**
+ * @brief               Converts the current field from (d)ddmm.mmmm to millionths of a degree
+ * @return              Absolute value, the hemisphere comes in the next field
+ */
+int32_t S7XGNmea::_coordinate() {
+    uint32_t minutes = _scaled(5);
+    uint32_t degrees = minutes / 10000000UL;
+    minutes = minutes % 10000000UL;
+    return degrees * 1000000UL + (minutes + 3) / 6;
+}
+
+/**
+ * @brief               Current field as a fixed point number
+ * @param[in] decimals  Number of decimals of the result (extra ones are truncated)
+ * @return              Absolute value of the field
+ */
+uint32_t S7XGNmea::_scaled(uint8_t decimals) {
+    uint32_t value = _value;
+    uint8_t current = _decimals;
+    while (current > decimals) { value /= 10; current--; }
+    while (current < decimals) { value *= 10; current++; }
+    return value;
+}
+
+/**
+ * @brief               Value of an hexadecimal digit
+ * @param[in] ch        Character
+ * @return              0 to 15, or 0xFF if not an hexadecimal digit
+ */
+uint8_t S7XGNmea::_nibble(char ch) {
+    if (('0' <= ch) && (ch <= '9')) return ch - '0';
+    if (('A' <= ch) && (ch <= 'F')) return ch - 'A' + 10;
+    if (('a' <= ch) && (ch <= 'f')) return ch - 'a' + 10;
+    return 0xFF;
+}
@@ -0,0 +1,112 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+
+typedef struct {
+  uint8_t valid;            // Any combination of S7XG_NMEA_VALID_*
+  uint8_t quality;          // GGA fix quality (0 invalid, 1 GPS, 2 DGPS...)
+  uint8_t fix_type;         // GSA fix type (1 none, 2 2D, 3 3D)
+  uint8_t satellites_used;
+  uint8_t satellites_view;
+  int32_t latitude_e6;      // Millionths of a degree, negative south
+  int32_t longitude_e6;     // Millionths of a degree, negative west
+  int32_t altitude_cm;      // Above mean sea level
+  uint16_t speed_cms;       // Speed over ground, centimetres per second
+  uint16_t course_cdeg;     // Course over ground, hundredths of a degree
+  uint16_t pdop;            // Hundredths
+  uint16_t hdop;            // Hundredths
+  uint16_t vdop;            // Hundredths
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+} gps_fix_t;
+
+enum {
+  S7XG_NMEA_VALID_TIME = 0x01,
+  S7XG_NMEA_VALID_DATE = 0x02,
+  S7XG_NMEA_VALID_POSITION = 0x04,
+  S7XG_NMEA_VALID_ALTITUDE = 0x08,
+  S7XG_NMEA_VALID_DOP = 0x10,
+};
+
+enum {
+  S7XG_NMEA_NONE = 0,
+  S7XG_NMEA_RMC,
+  S7XG_NMEA_GGA,
+  S7XG_NMEA_GSA,
+  S7XG_NMEA_GSV,
+  S7XG_NMEA_OTHER,
+  S7XG_NMEA_ERROR,
+};
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+class S7XGNmea {
+
+  public:
+
+    S7XGNmea();
+    void reset();
+    uint8_t feed(char ch);
+    const gps_fix_t & fix();
+    uint32_t sentences();
+    uint32_t errors();
+
+  protected:
+
+    void _start();
+    void _field();
+    int32_t _coordinate();
+    uint32_t _scaled(uint8_t decimals);
+    static uint8_t _nibble(char ch);
+
+    gps_fix_t _fix;
+    gps_fix_t _scratch;
+
+    uint8_t _state = 0;
+    uint8_t _type = S7XG_NMEA_NONE;
+    uint8_t _index = 0;
+    uint8_t _checksum = 0;
+    uint8_t _expected = 0;
+    char _tag[3];
+
+    uint32_t _value = 0;
+    uint8_t _decimals = 0;
+    bool _dot = false;
+    bool _negative = false;
+    char _first = 0;
+
+    uint32_t _sentences = 0;
+    uint32_t _errors = 0;
+
+};
@@ -0,0 +1,112 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+Lock-free single-producer, single-consumer ring. One thread pushes and
+another one pops, with no lock: each side only writes its own index and
+reads the other with acquire/release ordering, so the element is fully
+written before the consumer can see it. One slot is kept empty to tell a
+full ring from an empty one, so it holds SIZE - 1 elements.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+template <typename T, uint16_t SIZE>
+class S7XGSpsc {
+
+  static_assert((SIZE >= 2) && (0 == (SIZE & (SIZE - 1))), "The ring size must be a power of two");
+
+  public:
+
+    bool push(const T & value);
+    bool pop(T & value);
+    bool empty();
+    uint16_t count();
+
+  protected:
+
+    T _items[SIZE];
+    std::atomic<uint16_t> _head{0};
+    std::atomic<uint16_t> _tail{0};
+
+};
+
+// ----------------------------------------------------------------------------
+// Producer
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Adds an element, only call it from the producer thread
+ * @param[in] value     Element (copied)
+ * @return              False if the ring is full
+ */
+template <typename T, uint16_t SIZE>
+bool S7XGSpsc<T, SIZE>::push(const T & value) {
+    uint16_t tail = _tail.load(std::memory_order_relaxed);
+    uint16_t next = (tail + 1) & (SIZE - 1);
+    if (next == _head.load(std::memory_order_acquire)) return false;
+    _items[tail] = value;
+    _tail.store(next, std::memory_order_release);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Consumer
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Removes the oldest element, only call it from the consumer thread
+ * @param[out] value    Element
+ * @return              False if the ring is empty
+ */
+template <typename T, uint16_t SIZE>
+bool S7XGSpsc<T, SIZE>::pop(T & value) {
+    uint16_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) return false;
+    value = _items[head];
+    _head.store((head + 1) & (SIZE - 1), std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief               Checks if there is anything to pop, from the consumer thread
+ * @return              True if empty
+ */
+template <typename T, uint16_t SIZE>
+bool S7XGSpsc<T, SIZE>::empty() {
+    return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief               Number of elements, exact from either side only while the other one is idle
+ * @return              Element count
+ */
+template <typename T, uint16_t SIZE>
+uint16_t S7XGSpsc<T, SIZE>::count() {
+    return (_tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire)) & (SIZE - 1);
+}
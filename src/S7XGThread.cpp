@@ -0,0 +1,305 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+Threaded backend: a worker (a FreeRTOS task on the ESP32, a std::thread
+elsewhere) owns the module and its stream and is the only one calling
+into it. Application threads attach a channel each and send it functions
+to run on the worker through a lock-free single-producer single-consumer
+queue, the result comes back through another one. Downlinks, TX and join
+results are pushed by the worker to a third queue for one consumer.
+
+Opt-in: it needs std::thread or FreeRTOS and a few KB of RAM, so it is
+only built with -DS7XG_THREADED (the host build defines it).
+
+*/
+
+#if defined(S7XG_THREADED)
+
+#include "S7XGThread.h"
+
+// ----------------------------------------------------------------------------
+// Worker
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Stops the worker
+ */
+S7XGThread::~S7XGThread() {
+    end();
+}
+
+/**
+ * @brief               Starts the worker, from then on the module must only be used through call() and post()
+ * @details             The module must be bound to its stream with begin() first. The worker sets the
+ *                      downlink, TX and join callbacks of the module to feed event().
+ * @param[in] module    Module
+ * @return              False if already running or the worker could not be started
+ */
+bool S7XGThread::begin(S7XG & module) {
+
+    if (!_stopped) return false;
+
+    _module = &module;
+    _module->onDownlink(_downlink, this);
+    _module->onTxDone(_txDone, this);
+    _module->onJoin(_joined, this);
+    _running = true;
+    _stopped = false;
+
+    #if defined(ARDUINO_ARCH_ESP32)
+        if (pdPASS != xTaskCreatePinnedToCore(_run, "s7xg", S7XG_THREAD_STACK, this, S7XG_THREAD_PRIORITY, &_task, S7XG_THREAD_CORE)) {
+            _running = false;
+            _stopped = true;
+            return false;
+        }
+    #else
+        _thread = std::thread(_run, this);
+    #endif
+
+    return true;
+
+}
+
+/**
+ * @brief               Stops the worker once the function it is running (if any) returns
+ * @details             Requests still queued are not run and calls waiting for them return false.
+ */
+void S7XGThread::end() {
+    _running = false;
+    #if defined(ARDUINO_ARCH_ESP32)
+        while (!_stopped) _pause();
+    #else
+        if (_thread.joinable()) _thread.join();
+    #endif
+}
+
+/**
+ * @brief               Checks if the worker is running
+ * @return              True if running
+ */
+bool S7XGThread::running() {
+    return _running;
+}
+
+// ----------------------------------------------------------------------------
+// Requests
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Gets a channel for the calling thread
+ * @details             Each application thread needs its own channel, a channel must never be used by two
+ *                      threads at the same time. Can be called from any thread.
+ * @return              Channel number or -1 if there are S7XG_THREAD_CHANNELS already
+ */
+int8_t S7XGThread::attach() {
+    uint8_t count = _channel_count.load();
+    do {
+        if (S7XG_THREAD_CHANNELS == count) return -1;
+    } while (!_channel_count.compare_exchange_weak(count, count + 1));
+    return count;
+}
+
+/**
+ * @brief               Runs a function on the worker and waits for it
+ * @details             The function gets the module and can use it as in a single threaded program, blocking
+ *                      methods included. Calls from different channels run one after the other. Fails while
+ *                      the channel has posted requests whose replies were not collected with poll().
+ *                      Example: thread.call(channel, [](S7XG & module, void *) { return module.macPower(14); });
+ * @param[in] channel   Channel of the calling thread (see attach)
+ * @param[in] function  Function to run
+ * @param[in] arg       Argument passed to the function (defaults to NULL)
+ * @param[out] reply    Result, status and response of the last command (defaults to NULL)
+ * @return              Value returned by the function, false if it could not be run
+ */
+bool S7XGThread::call(uint8_t channel, s7xg_thread_call_t function, void * arg, s7xg_thread_reply_t * reply) {
+    if ((channel >= _channel_count) || _channels[channel].pending) return false;
+    if (0 == post(channel, function, arg)) return false;
+
+    // Nothing else pending on the channel, the next reply is this one
+    s7xg_thread_reply_t result;
+    while (!poll(channel, result)) {
+        if (!_running) return false;
+        _pause();
+    }
+    if (reply) *reply = result;
+    return result.result;
+}
+
+/**
+ * @brief               Queues a function to run on the worker without waiting for it
+ * @details             Get the result with poll(). Up to S7XG_THREAD_QUEUE_SIZE - 1 requests per channel can
+ *                      be pending, collect the replies before posting more. A channel whose replies are not
+ *                      collected is not served until they are, the other channels are.
+ * @param[in] channel   Channel of the calling thread (see attach)
+ * @param[in] function  Function to run
+ * @param[in] arg       Argument passed to the function (defaults to NULL)
+ * @return              Request ID (matches the reply ID), 0 if the channel is full or not attached
+ */
+uint16_t S7XGThread::post(uint8_t channel, s7xg_thread_call_t function, void * arg) {
+    if ((channel >= _channel_count) || !function || !_running) return 0;
+    s7xg_thread_channel_t & queue = _channels[channel];
+    if (0 == ++queue.id) queue.id = 1;
+    s7xg_thread_request_t request = { queue.id, function, arg };
+    if (!queue.requests.push(request)) return 0;
+    queue.pending++;
+    return request.id;
+}
+
+/**
+ * @brief               Gets the result of a posted function
+ * @param[in] channel   Channel of the calling thread (see attach)
+ * @param[out] reply    Result
+ * @return              False if there is no new result
+ */
+bool S7XGThread::poll(uint8_t channel, s7xg_thread_reply_t & reply) {
+    if (channel >= _channel_count) return false;
+    s7xg_thread_channel_t & queue = _channels[channel];
+    if (!queue.replies.pop(reply)) return false;
+    if (queue.pending) queue.pending--;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Events
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Gets the oldest unsolicited result (downlink, TX or join result)
+ * @details             Only one application thread can read the events.
+ * @param[out] event    Event
+ * @return              False if there are no events
+ */
+bool S7XGThread::event(s7xg_thread_event_t & event) {
+    return _events.pop(event);
+}
+
+/**
+ * @brief               Number of events lost because nobody was reading them
+ * @return              Event count
+ */
+uint32_t S7XGThread::eventsDropped() {
+    return _events_dropped;
+}
+
+// ----------------------------------------------------------------------------
+// Private
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Worker entry point
+ * @param[in] arg       S7XGThread object
+ */
+void S7XGThread::_run(void * arg) {
+    ((S7XGThread *) arg)->_work();
+    #if defined(ARDUINO_ARCH_ESP32)
+        vTaskDelete(NULL);
+    #endif
+}
+
+/**
+ * @brief               Runs the requests of every channel in turn and the module loop until stopped
+ */
+void S7XGThread::_work() {
+
+    while (_running) {
+
+        bool served = false;
+        uint8_t count = _channel_count;
+        for (uint8_t i=0; i<count; i++) {
+            s7xg_thread_channel_t & queue = _channels[i];
+
+            // A channel that does not collect its replies keeps the last one and gets nothing
+            // else run until there is room, without holding up the other channels
+            if (queue.parked) {
+                if (!queue.replies.push(queue.reply)) continue;
+                queue.parked = false;
+            }
+
+            s7xg_thread_request_t request;
+            if (!queue.requests.pop(request)) continue;
+            served = true;
+            s7xg_thread_reply_t & reply = queue.reply;
+            reply.id = request.id;
+            reply.result = request.function(*_module, request.arg);
+            reply.status = _module->getStatus();
+            strncpy(reply.response, _module->getResponse(), sizeof(reply.response) - 1);
+            reply.response[sizeof(reply.response) - 1] = 0;
+            queue.parked = !queue.replies.push(reply);
+        }
+
+        _module->loop();
+        if (!served) _pause();
+
+    }
+
+    _stopped = true;
+
+}
+
+/**
+ * @brief               Queues an event for the application
+ * @param[in] type      One of the S7XG_EVENT_* values
+ * @param[in] port      Downlink port
+ * @param[in] data      Downlink data
+ * @param[in] len       Downlink length
+ */
+void S7XGThread::_push(uint8_t type, uint8_t port, const uint8_t * data, uint8_t len) {
+    s7xg_thread_event_t event;
+    event.type = type;
+    event.port = port;
+    event.len = (len < S7XG_THREAD_EVENT_SIZE) ? len : S7XG_THREAD_EVENT_SIZE;
+    if (data) memcpy(event.data, data, event.len);
+    if (!_events.push(event)) _events_dropped++;
+}
+
+/**
+ * @brief               Gives the other threads a chance to run
+ */
+void S7XGThread::_pause() {
+    #if defined(ARDUINO_ARCH_ESP32)
+        vTaskDelay(1);
+    #else
+        delayMicroseconds(S7XG_THREAD_PAUSE_US);
+    #endif
+}
+
+/**
+ * @brief               Downlink callback, runs on the worker
+ */
+void S7XGThread::_downlink(uint8_t port, uint8_t * data, uint8_t len, void * arg) {
+    ((S7XGThread *) arg)->_push(S7XG_EVENT_DOWNLINK, port, data, len);
+}
+
+/**
+ * @brief               TX result callback, runs on the worker
+ */
+void S7XGThread::_txDone(bool success, void * arg) {
+    ((S7XGThread *) arg)->_push(success ? S7XG_EVENT_TX_OK : S7XG_EVENT_TX_ERROR);
+}
+
+/**
+ * @brief               Join result callback, runs on the worker
+ */
+void S7XGThread::_joined(bool success, void * arg) {
+    ((S7XGThread *) arg)->_push(success ? S7XG_EVENT_JOIN_OK : S7XG_EVENT_JOIN_ERROR);
+}
+
+#endif
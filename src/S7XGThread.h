@@ -0,0 +1,151 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#if !defined(S7XG_THREADED)
+  #error "S7XGThread is opt-in, build with -DS7XG_THREADED"
+#endif
+
+#include <Arduino.h>
+#include <atomic>
+#include "S7XG.h"
+#include "S7XGSpsc.h"
+
+#if !defined(ARDUINO_ARCH_ESP32)
+  #include <thread>
+#endif
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+// Defaults, override them with build flags (for example -DS7XG_THREAD_CHANNELS=4)
+#ifndef S7XG_THREAD_CHANNELS
+#define S7XG_THREAD_CHANNELS                  8
+#endif
+#ifndef S7XG_THREAD_QUEUE_SIZE
+#define S7XG_THREAD_QUEUE_SIZE                4
+#endif
+#ifndef S7XG_THREAD_EVENTS
+#define S7XG_THREAD_EVENTS                    16
+#endif
+#ifndef S7XG_THREAD_EVENT_SIZE
+#define S7XG_THREAD_EVENT_SIZE                64
+#endif
+#ifndef S7XG_THREAD_RESPONSE_SIZE
+#define S7XG_THREAD_RESPONSE_SIZE             64
+#endif
+#ifndef S7XG_THREAD_PAUSE_US
+#define S7XG_THREAD_PAUSE_US                  50
+#endif
+#ifndef S7XG_THREAD_STACK
+#define S7XG_THREAD_STACK                     4096
+#endif
+#ifndef S7XG_THREAD_PRIORITY
+#define S7XG_THREAD_PRIORITY                  5
+#endif
+#ifndef S7XG_THREAD_CORE
+#define S7XG_THREAD_CORE                      1
+#endif
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+
+typedef bool (*s7xg_thread_call_t)(S7XG & module, void * arg);
+
+typedef struct {
+  uint16_t id;
+  s7xg_thread_call_t function;
+  void * arg;
+} s7xg_thread_request_t;
+
+typedef struct {
+  uint16_t id;
+  bool result;              // Value returned by the function
+  uint8_t status;           // getStatus() after the function
+  char response[S7XG_THREAD_RESPONSE_SIZE];  // getResponse() after the function, truncated
+} s7xg_thread_reply_t;
+
+typedef struct {
+  uint8_t type;             // One of S7XG_EVENT_DOWNLINK, TX_OK, TX_ERROR, JOIN_OK or JOIN_ERROR
+  uint8_t port;             // Downlinks only
+  uint8_t len;              // Downlink length, up to S7XG_THREAD_EVENT_SIZE (longer ones are truncated)
+  uint8_t data[S7XG_THREAD_EVENT_SIZE];
+} s7xg_thread_event_t;
+
+typedef struct {
+  S7XGSpsc<s7xg_thread_request_t, S7XG_THREAD_QUEUE_SIZE> requests;
+  S7XGSpsc<s7xg_thread_reply_t, S7XG_THREAD_QUEUE_SIZE> replies;
+  s7xg_thread_reply_t reply;  // Worker only, last reply if it did not fit in replies
+  bool parked = false;      // Worker only, reply is waiting for room
+  uint16_t id = 0;          // Application thread only, last request ID
+  uint8_t pending = 0;      // Application thread only, posted requests not polled yet
+} s7xg_thread_channel_t;
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+class S7XGThread {
+
+  public:
+
+    ~S7XGThread();
+
+    bool begin(S7XG & module);
+    void end();
+    bool running();
+
+    int8_t attach();
+    bool call(uint8_t channel, s7xg_thread_call_t function, void * arg = NULL, s7xg_thread_reply_t * reply = NULL);
+    uint16_t post(uint8_t channel, s7xg_thread_call_t function, void * arg = NULL);
+    bool poll(uint8_t channel, s7xg_thread_reply_t & reply);
+
+    bool event(s7xg_thread_event_t & event);
+    uint32_t eventsDropped();
+
+  protected:
+
+    static void _run(void * arg);
+    void _work();
+    void _push(uint8_t type, uint8_t port = 0, const uint8_t * data = NULL, uint8_t len = 0);
+    static void _pause();
+    static void _downlink(uint8_t port, uint8_t * data, uint8_t len, void * arg);
+    static void _txDone(bool success, void * arg);
+    static void _joined(bool success, void * arg);
+
+    S7XG * _module = NULL;
+    s7xg_thread_channel_t _channels[S7XG_THREAD_CHANNELS];
+    std::atomic<uint8_t> _channel_count{0};
+    S7XGSpsc<s7xg_thread_event_t, S7XG_THREAD_EVENTS> _events;
+    std::atomic<uint32_t> _events_dropped{0};
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _stopped{true};
+
+    #if defined(ARDUINO_ARCH_ESP32)
+      TaskHandle_t _task = NULL;
+    #else
+      std::thread _thread;
+    #endif
+
+};
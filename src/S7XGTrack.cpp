@@ -0,0 +1,357 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+GPS track batching. Several fixes are packed in a single uplink payload:
+
+  byte 0        format version (S7XG_TRACK_VERSION)
+  bytes 1-4     time of the first fix, seconds since 1970 (big endian)
+  bytes 5-8     latitude of the first fix, 1e-5 degrees (big endian, signed)
+  bytes 9-12    longitude of the first fix, 1e-5 degrees (big endian, signed)
+  then, for every other fix, the difference with the previous one in
+  latitude, longitude and time, each a zigzag encoded varint (7 bits per
+  byte, least significant group first, MSB set when more bytes follow)
+
+A fix a few metres and seconds away from the previous one takes 3 bytes,
+so a 51 bytes payload carries a dozen positions instead of one.
+The decoder is S7XGTrack::decode, extras/decoders/track.js does the same
+for The Things Network.
+
+*/
+
+#include "S7XGTrack.h"
+
+// ----------------------------------------------------------------------------
+// Init
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Creates an empty track
+ * @param[in] size      Maximum payload size, up to S7XG_UPLINK_SIZE (the default)
+ */
+S7XGTrack::S7XGTrack(uint8_t size) {
+    if (size < S7XG_TRACK_HEADER_SIZE) size = S7XG_TRACK_HEADER_SIZE;
+    _size = (size < S7XG_UPLINK_SIZE) ? size : S7XG_UPLINK_SIZE;
+}
+
+// ----------------------------------------------------------------------------
+// Encoder
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Appends a fix to the track
+ * @param[in] time      Seconds since 1970-01-01 UTC (see epoch)
+ * @param[in] latitude_e6 Millionths of a degree, negative south
+ * @param[in] longitude_e6 Millionths of a degree, negative west
+ * @return              False if it does not fit, flush or clear the track and add it again
+ */
+bool S7XGTrack::add(uint32_t time, int32_t latitude_e6, int32_t longitude_e6) {
+
+    int32_t latitude = _quantize(latitude_e6);
+    int32_t longitude = _quantize(longitude_e6);
+
+    if (0 == _count) {
+        _data[0] = S7XG_TRACK_VERSION;
+        uint32_t values[3] = { time, (uint32_t) latitude, (uint32_t) longitude };
+        for (uint8_t i=0; i<3; i++) {
+            _data[1 + i * 4] = values[i] >> 24;
+            _data[2 + i * 4] = values[i] >> 16;
+            _data[3 + i * 4] = values[i] >> 8;
+            _data[4 + i * 4] = values[i];
+        }
+        _length = S7XG_TRACK_HEADER_SIZE;
+        _last = 3;
+    } else {
+        uint8_t point[S7XG_TRACK_POINT_SIZE];
+        uint8_t len = _varint(point, latitude - _latitude);
+        len += _varint(&point[len], longitude - _longitude);
+        len += _varint(&point[len], (int32_t) (time - _time));
+        if (_length + len > _size) return false;
+        memcpy(&_data[_length], point, len);
+        _length += len;
+        _last = len;
+    }
+
+    _count++;
+    _time = time;
+    _latitude = latitude;
+    _longitude = longitude;
+    return true;
+
+}
+
+/**
+ * @brief               Appends a fix from gpsData
+ * @param[in] message   GPS data, ignored unless it has a valid time and position
+ * @return              False if ignored or if it does not fit
+ */
+bool S7XGTrack::add(const gps_message_t & message) {
+    uint8_t required = S7XG_GPS_VALID_TIME | S7XG_GPS_VALID_POSITION;
+    if ((message.valid & required) != required) return false;
+    uint32_t time = epoch(message.year, message.month, message.day, message.hour, message.minute, message.second);
+    return add(time, message.latitude_e6, message.longitude_e6);
+}
+
+/**
+ * @brief               Appends a fix decoded from the NMEA output (see S7XG::gpsFix)
+ * @param[in] fix       GPS fix, ignored unless it has a valid date, time and position
+ * @return              False if ignored or if it does not fit
+ */
+bool S7XGTrack::add(const gps_fix_t & fix) {
+    uint8_t required = S7XG_NMEA_VALID_TIME | S7XG_NMEA_VALID_DATE | S7XG_NMEA_VALID_POSITION;
+    if ((fix.valid & required) != required) return false;
+    uint32_t time = epoch(fix.year, fix.month, fix.day, fix.hour, fix.minute, fix.second);
+    return add(time, fix.latitude_e6, fix.longitude_e6);
+}
+
+/**
+ * @brief               Empties the track, the next fix is stored in full
+ */
+void S7XGTrack::clear() {
+    _length = 0;
+    _count = 0;
+}
+
+/**
+ * @brief               Tells whether the track should be sent before adding more fixes
+ * @details             True when the room left is less than the last fix took, so the next one
+ *                      would probably not fit.
+ * @return              True if full
+ */
+bool S7XGTrack::full() {
+    return _count && (_size - _length < _last);
+}
+
+/**
+ * @brief               Number of fixes in the track
+ * @return              Fix count
+ */
+uint8_t S7XGTrack::count() {
+    return _count;
+}
+
+/**
+ * @brief               Size of the encoded track
+ * @return              Number of bytes
+ */
+uint8_t S7XGTrack::length() {
+    return _length;
+}
+
+/**
+ * @brief               Encoded track, ready to be sent
+ * @return              Pointer to the payload (length() bytes)
+ */
+const uint8_t * S7XGTrack::data() {
+    return _data;
+}
+
+// ----------------------------------------------------------------------------
+// Sampler
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Samples the GPS periodically and queues the track when full
+ * @details             Call loop() from your main loop. The GPS must be initialized and in manual mode
+ *                      and the module joined. Tracks are queued with macQueue, so they go out as soon
+ *                      as the duty cycle budget allows and are retried if the module is busy.
+ * @param[in] module    Module to read the GPS from and send the tracks with
+ * @param[in] port      LoRaWAN port (defaults to S7XG_TRACK_PORT)
+ * @param[in] period    Milliseconds between fixes (defaults to S7XG_TRACK_PERIOD)
+ */
+void S7XGTrack::begin(S7XG & module, uint8_t port, uint32_t period) {
+    _module = &module;
+    _port = port;
+    _period = period;
+    _sampled = millis() - period;
+    clear();
+}
+
+/**
+ * @brief               Sets the maximum time a fix waits in the track before it is sent
+ * @param[in] ms        Milliseconds since the first fix in the track (0 to wait until full, the default)
+ */
+void S7XGTrack::setMaxAge(uint32_t ms) {
+    _max_age = ms;
+}
+
+/**
+ * @brief               Reads a fix every period and queues the track when full or too old
+ * @details             Reading the fix is a blocking gpsData call. The track is also queued when it can be
+ *                      sent right away but one more fix would not fit in the airtime budget (see
+ *                      S7XG::nextUplinkIn), so it goes out with as many fixes as the budget allows.
+ */
+void S7XGTrack::loop() {
+
+    if (!_module) return;
+
+    uint32_t now = millis();
+    if (now - _sampled >= _period) {
+        _sampled = now;
+        gps_message_t message = _module->gpsData();
+        uint8_t required = S7XG_GPS_VALID_TIME | S7XG_GPS_VALID_POSITION;
+        if ((message.valid & required) == required) {
+            if (0 == _count) _started = now;
+            if (!add(message) && flush()) {
+                _started = now;
+                add(message);
+            }
+            if (full() || _budgetReached()) flush();
+        }
+    }
+
+    if (_max_age && _count && (now - _started >= _max_age)) flush();
+
+}
+
+/**
+ * @brief               Tells whether one more fix would make the track miss the airtime budget
+ * @details             Like full(), the next fix is expected to take as many bytes as the last one.
+ * @return              True if the track fits in the budget now and would not with another fix
+ */
+bool S7XGTrack::_budgetReached() {
+    if (0 == _count) return false;
+    return (0 == _module->nextUplinkIn(_length)) && (0 != _module->nextUplinkIn(_length + _last));
+}
+
+/**
+ * @brief               Queues the track for sending and empties it
+ * @return              False if the track is empty or the uplink queue is full
+ */
+bool S7XGTrack::flush() {
+    if (!_module || (0 == _count)) return false;
+    if (!_module->macQueue(_data, _length, _port)) return false;
+    clear();
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Decoder
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Decodes a track payload
+ * @param[in] data      Payload
+ * @param[in] len       Payload length
+ * @param[out] points   Decoded fixes
+ * @param[in] max       Size of the points array
+ * @return              Number of fixes decoded, 0 if the payload is not a track
+ */
+uint8_t S7XGTrack::decode(const uint8_t * data, uint8_t len, s7xg_track_point_t * points, uint8_t max) {
+
+    if ((len < S7XG_TRACK_HEADER_SIZE) || (S7XG_TRACK_VERSION != data[0]) || (0 == max)) return 0;
+
+    uint32_t values[3];
+    for (uint8_t i=0; i<3; i++) {
+        const uint8_t * p = &data[1 + i * 4];
+        values[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+    }
+    uint32_t time = values[0];
+    int32_t latitude = (int32_t) values[1];
+    int32_t longitude = (int32_t) values[2];
+
+    const uint8_t * p = &data[S7XG_TRACK_HEADER_SIZE];
+    const uint8_t * end = &data[len];
+    uint8_t count = 0;
+    while (true) {
+        points[count].time = time;
+        points[count].latitude_e6 = latitude * 10;
+        points[count].longitude_e6 = longitude * 10;
+        if (++count == max) break;
+        int32_t delta_latitude, delta_longitude, delta_time;
+        if (!_unvarint(p, end, delta_latitude)) break;
+        if (!_unvarint(p, end, delta_longitude)) break;
+        if (!_unvarint(p, end, delta_time)) break;
+        latitude += delta_latitude;
+        longitude += delta_longitude;
+        time += delta_time;
+    }
+    return count;
+
+}
+
+/**
+ * @brief               Converts a UTC date and time to seconds since 1970-01-01
+ * @return              Unix time
+ */
+uint32_t S7XGTrack::epoch(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+
+    // Days from civil, with years starting in March so the leap day is the last one
+    int32_t y = year - (month <= 2);
+    int32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int32_t days = era * 146097 + (int32_t) doe - 719468;
+
+    return days * 86400UL + hour * 3600UL + minute * 60UL + second;
+
+}
+
+// ----------------------------------------------------------------------------
+// Private
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Writes a zigzag encoded varint
+ * @param[out] destination Buffer, at least 5 bytes
+ * @param[in] value     Value
+ * @return              Number of bytes written
+ */
+uint8_t S7XGTrack::_varint(uint8_t * destination, int32_t value) {
+    uint32_t zigzag = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+    uint8_t len = 0;
+    while (zigzag > 0x7F) {
+        destination[len++] = (zigzag & 0x7F) | 0x80;
+        zigzag >>= 7;
+    }
+    destination[len++] = zigzag;
+    return len;
+}
+
+/**
+ * @brief               Reads a zigzag encoded varint
+ * @param[in,out] p     Read pointer, moved past the value
+ * @param[in] end       End of the buffer
+ * @param[out] value    Value
+ * @return              False if the buffer ends before the value does
+ */
+bool S7XGTrack::_unvarint(const uint8_t * & p, const uint8_t * end, int32_t & value) {
+    uint32_t zigzag = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (p == end) return false;
+        uint8_t byte = *p++;
+        zigzag |= (uint32_t) (byte & 0x7F) << shift;
+        if (0 == (byte & 0x80)) {
+            value = (int32_t) (zigzag >> 1) ^ -(int32_t) (zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief               Rounds a coordinate to the 1e-5 degrees (about 1 metre) stored in tracks
+ * @param[in] value_e6  Millionths of a degree
+ * @return              Hundred thousandths of a degree
+ */
+int32_t S7XGTrack::_quantize(int32_t value_e6) {
+    return (value_e6 + (value_e6 < 0 ? -5 : 5)) / 10;
+}
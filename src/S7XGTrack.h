@@ -0,0 +1,107 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "S7XG.h"
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+// Payload format, the decoders depend on it
+#define S7XG_TRACK_VERSION                    1
+#define S7XG_TRACK_HEADER_SIZE                13
+#define S7XG_TRACK_POINT_SIZE                 15
+
+// Defaults, override them with build flags (for example -DS7XG_TRACK_PERIOD=30000)
+#ifndef S7XG_TRACK_PERIOD
+#define S7XG_TRACK_PERIOD                     10000
+#endif
+#ifndef S7XG_TRACK_PORT
+#define S7XG_TRACK_PORT                       2
+#endif
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+
+typedef struct {
+  uint32_t time;            // Seconds since 1970-01-01 UTC
+  int32_t latitude_e6;      // Millionths of a degree (multiple of 10), negative south
+  int32_t longitude_e6;     // Millionths of a degree (multiple of 10), negative west
+} s7xg_track_point_t;
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+class S7XGTrack {
+
+  public:
+
+    S7XGTrack(uint8_t size = S7XG_UPLINK_SIZE);
+
+    // Encoder
+    bool add(uint32_t time, int32_t latitude_e6, int32_t longitude_e6);
+    bool add(const gps_message_t & message);
+    bool add(const gps_fix_t & fix);
+    void clear();
+    bool full();
+    uint8_t count();
+    uint8_t length();
+    const uint8_t * data();
+
+    // Sampler
+    void begin(S7XG & module, uint8_t port = S7XG_TRACK_PORT, uint32_t period = S7XG_TRACK_PERIOD);
+    void setMaxAge(uint32_t ms);
+    void loop();
+    bool flush();
+
+    // Decoder
+    static uint8_t decode(const uint8_t * data, uint8_t len, s7xg_track_point_t * points, uint8_t max);
+    static uint32_t epoch(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+
+  protected:
+
+    static uint8_t _varint(uint8_t * destination, int32_t value);
+    static bool _unvarint(const uint8_t * & p, const uint8_t * end, int32_t & value);
+    static int32_t _quantize(int32_t value_e6);
+    bool _budgetReached();
+
+    uint8_t _data[S7XG_UPLINK_SIZE];
+    uint8_t _size;
+    uint8_t _length = 0;
+    uint8_t _count = 0;
+    uint8_t _last = 0;
+    uint32_t _time = 0;
+    int32_t _latitude = 0;
+    int32_t _longitude = 0;
+
+    S7XG * _module = NULL;
+    uint8_t _port = S7XG_TRACK_PORT;
+    uint32_t _period = S7XG_TRACK_PERIOD;
+    uint32_t _sampled = 0;
+    uint32_t _started = 0;
+    uint32_t _max_age = 0;
+
+};
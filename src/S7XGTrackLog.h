@@ -0,0 +1,340 @@
+/*
+
+S7XG library
+
+Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
+
+The S7XG library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The S7XG library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the S7XG library.  If not, see <http://www.gnu.org/licenses/>.
+
+// ----------------------------------------------------------------------------
+
+On-device track log: a ring buffer of GPS fixes packed in 12 bytes each,
+so an hour of fixes every 10 seconds takes 4.3 kB. Records are stored as
+
+  word 0        time, seconds since 1970
+  word 1        bits 0-24 latitude + 90 degrees, 1e-5 degrees
+                bits 25-30 positioning time, high 6 bits
+                bit 31 fix flag
+  word 2        bits 0-25 longitude + 180 degrees, 1e-5 degrees
+                bits 26-31 positioning time, low 6 bits
+
+Positioning time is kept in tenths of a second up to 409.5 seconds.
+When the log is full the oldest record is overwritten.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "S7XG.h"
+#include "S7XGTrack.h"
+
+// ----------------------------------------------------------------------------
+// Configuration
+// ----------------------------------------------------------------------------
+
+#define S7XG_LOG_POSITIONING_MAX              4095
+
+// ----------------------------------------------------------------------------
+// Types
+// ----------------------------------------------------------------------------
+
+typedef struct {
+  uint32_t time;            // Seconds since 1970-01-01 UTC
+  int32_t latitude_e6;      // Millionths of a degree (multiple of 10), negative south
+  int32_t longitude_e6;     // Millionths of a degree (multiple of 10), negative west
+  uint16_t positioning_ds;  // Time spent positioning, tenths of a second
+  bool fix;
+} s7xg_log_fix_t;
+
+typedef struct {
+  uint32_t time;
+  uint32_t latitude;
+  uint32_t longitude;
+} s7xg_log_record_t;
+
+static_assert(sizeof(s7xg_log_record_t) == 12, "Track log records must be 12 bytes long");
+
+// ----------------------------------------------------------------------------
+// Class definition
+// ----------------------------------------------------------------------------
+
+template <uint16_t SIZE>
+class S7XGTrackLog {
+
+  static_assert(SIZE > 0, "The track log needs room for one fix at least");
+
+  public:
+
+    bool append(const s7xg_log_fix_t & fix);
+    bool append(const gps_message_t & message);
+    bool append(const gps_fix_t & fix);
+
+    uint16_t count();
+    uint16_t capacity();
+    uint32_t overwritten();
+    void clear();
+
+    bool get(uint16_t index, s7xg_log_fix_t & fix);
+    uint16_t since(uint32_t time);
+
+    bool pop(s7xg_log_fix_t & fix);
+    uint16_t drain(s7xg_log_fix_t * fixes, uint16_t max);
+    uint16_t drain(S7XGTrack & track);
+
+  protected:
+
+    static void _pack(const s7xg_log_fix_t & fix, s7xg_log_record_t & record);
+    static void _unpack(const s7xg_log_record_t & record, s7xg_log_fix_t & fix);
+    s7xg_log_record_t & _at(uint16_t index);
+
+    s7xg_log_record_t _records[SIZE];
+    uint16_t _head = 0;
+    uint16_t _count = 0;
+    uint32_t _overwritten = 0;
+
+};
+
+// ----------------------------------------------------------------------------
+// Append
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Appends a fix, overwriting the oldest one if the log is full
+ * @details             Fixes are expected in time order (see since).
+ * @param[in] fix       Fix
+ * @return              Always true
+ */
+template <uint16_t SIZE>
+bool S7XGTrackLog<SIZE>::append(const s7xg_log_fix_t & fix) {
+    if (SIZE == _count) {
+        _head = (_head + 1) % SIZE;
+        _count--;
+        _overwritten++;
+    }
+    _pack(fix, _at(_count));
+    _count++;
+    return true;
+}
+
+/**
+ * @brief               Appends a fix from gpsData
+ * @param[in] message   GPS data, ignored unless it has a valid time
+ * @return              False if ignored
+ */
+template <uint16_t SIZE>
+bool S7XGTrackLog<SIZE>::append(const gps_message_t & message) {
+    if (0 == (message.valid & S7XG_GPS_VALID_TIME)) return false;
+    s7xg_log_fix_t fix;
+    fix.time = S7XGTrack::epoch(message.year, message.month, message.day, message.hour, message.minute, message.second);
+    fix.latitude_e6 = message.latitude_e6;
+    fix.longitude_e6 = message.longitude_e6;
+    uint32_t positioning = message.positioning_ms / 100;
+    fix.positioning_ds = (positioning < S7XG_LOG_POSITIONING_MAX) ? positioning : S7XG_LOG_POSITIONING_MAX;
+    fix.fix = (message.valid & S7XG_GPS_VALID_POSITION);
+    return append(fix);
+}
+
+/**
+ * @brief               Appends a fix decoded from the NMEA output (see S7XG::gpsFix)
+ * @param[in] fix       GPS fix, ignored unless it has a valid date and time (positioning time is not known)
+ * @return              False if ignored
+ */
+template <uint16_t SIZE>
+bool S7XGTrackLog<SIZE>::append(const gps_fix_t & fix) {
+    uint8_t required = S7XG_NMEA_VALID_TIME | S7XG_NMEA_VALID_DATE;
+    if ((fix.valid & required) != required) return false;
+    s7xg_log_fix_t entry;
+    entry.time = S7XGTrack::epoch(fix.year, fix.month, fix.day, fix.hour, fix.minute, fix.second);
+    entry.latitude_e6 = fix.latitude_e6;
+    entry.longitude_e6 = fix.longitude_e6;
+    entry.positioning_ds = 0;
+    entry.fix = (fix.valid & S7XG_NMEA_VALID_POSITION);
+    return append(entry);
+}
+
+// ----------------------------------------------------------------------------
+// Status
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Number of fixes in the log
+ * @return              Fix count
+ */
+template <uint16_t SIZE>
+uint16_t S7XGTrackLog<SIZE>::count() {
+    return _count;
+}
+
+/**
+ * @brief               Maximum number of fixes in the log
+ * @return              SIZE
+ */
+template <uint16_t SIZE>
+uint16_t S7XGTrackLog<SIZE>::capacity() {
+    return SIZE;
+}
+
+/**
+ * @brief               Number of fixes lost because the log was full
+ * @return              Fix count
+ */
+template <uint16_t SIZE>
+uint32_t S7XGTrackLog<SIZE>::overwritten() {
+    return _overwritten;
+}
+
+/**
+ * @brief               Removes all the fixes
+ */
+template <uint16_t SIZE>
+void S7XGTrackLog<SIZE>::clear() {
+    _head = 0;
+    _count = 0;
+}
+
+// ----------------------------------------------------------------------------
+// Iterate
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Reads a fix without removing it
+ * @details             Example: for (uint16_t i = log.since(t); log.get(i, fix); i++) {...}
+ * @param[in] index     Position, 0 is the oldest
+ * @param[out] fix      Fix
+ * @return              False if there is no such fix
+ */
+template <uint16_t SIZE>
+bool S7XGTrackLog<SIZE>::get(uint16_t index, s7xg_log_fix_t & fix) {
+    if (index >= _count) return false;
+    _unpack(_at(index), fix);
+    return true;
+}
+
+/**
+ * @brief               Finds the oldest fix at or after a given time
+ * @details             Binary search, the fixes must have been appended in time order.
+ * @param[in] time      Seconds since 1970
+ * @return              Index of the fix, count() if there is none
+ */
+template <uint16_t SIZE>
+uint16_t S7XGTrackLog<SIZE>::since(uint32_t time) {
+    uint16_t low = 0;
+    uint16_t high = _count;
+    while (low < high) {
+        uint16_t middle = (low + high) / 2;
+        if (_at(middle).time < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// ----------------------------------------------------------------------------
+// Drain
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Removes the oldest fix
+ * @param[out] fix      Fix
+ * @return              False if the log is empty
+ */
+template <uint16_t SIZE>
+bool S7XGTrackLog<SIZE>::pop(s7xg_log_fix_t & fix) {
+    if (0 == _count) return false;
+    _unpack(_at(0), fix);
+    _head = (_head + 1) % SIZE;
+    _count--;
+    return true;
+}
+
+/**
+ * @brief               Removes the oldest fixes
+ * @param[out] fixes    Destination array
+ * @param[in] max       Size of the destination array
+ * @return              Number of fixes removed
+ */
+template <uint16_t SIZE>
+uint16_t S7XGTrackLog<SIZE>::drain(s7xg_log_fix_t * fixes, uint16_t max) {
+    uint16_t count = 0;
+    while ((count < max) && pop(fixes[count])) count++;
+    return count;
+}
+
+/**
+ * @brief               Moves the oldest fixes with a position to a track payload, as many as fit
+ * @details             Fixes without a position are dropped. The track is not cleared first.
+ * @param[in] track     Track to add the fixes to
+ * @return              Number of fixes added to the track
+ */
+template <uint16_t SIZE>
+uint16_t S7XGTrackLog<SIZE>::drain(S7XGTrack & track) {
+    uint16_t count = 0;
+    s7xg_log_fix_t fix;
+    while (get(0, fix)) {
+        if (fix.fix) {
+            if (!track.add(fix.time, fix.latitude_e6, fix.longitude_e6)) break;
+            count++;
+        }
+        pop(fix);
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+// Private
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief               Packs a fix in a 12 bytes record (see the format at the top of this file)
+ * @param[in] fix       Fix
+ * @param[out] record   Record
+ */
+template <uint16_t SIZE>
+void S7XGTrackLog<SIZE>::_pack(const s7xg_log_fix_t & fix, s7xg_log_record_t & record) {
+    int32_t latitude = (fix.latitude_e6 + (fix.latitude_e6 < 0 ? -5 : 5)) / 10;
+    int32_t longitude = (fix.longitude_e6 + (fix.longitude_e6 < 0 ? -5 : 5)) / 10;
+    latitude = (latitude < -9000000) ? -9000000 : (latitude > 9000000) ? 9000000 : latitude;
+    longitude = (longitude < -18000000) ? -18000000 : (longitude > 18000000) ? 18000000 : longitude;
+    uint16_t positioning = (fix.positioning_ds < S7XG_LOG_POSITIONING_MAX) ? fix.positioning_ds : S7XG_LOG_POSITIONING_MAX;
+    record.time = fix.time;
+    record.latitude = (uint32_t) (latitude + 9000000) | ((uint32_t) (positioning >> 6) << 25) | (fix.fix ? 0x80000000UL : 0);
+    record.longitude = (uint32_t) (longitude + 18000000) | ((uint32_t) (positioning & 0x3F) << 26);
+}
+
+/**
+ * @brief               Unpacks a record
+ * @param[in] record    Record
+ * @param[out] fix      Fix
+ */
+template <uint16_t SIZE>
+void S7XGTrackLog<SIZE>::_unpack(const s7xg_log_record_t & record, s7xg_log_fix_t & fix) {
+    fix.time = record.time;
+    fix.latitude_e6 = ((int32_t) (record.latitude & 0x01FFFFFFUL) - 9000000) * 10;
+    fix.longitude_e6 = ((int32_t) (record.longitude & 0x03FFFFFFUL) - 18000000) * 10;
+    fix.positioning_ds = ((record.latitude >> 25) & 0x3F) << 6 | (record.longitude >> 26);
+    fix.fix = (record.latitude & 0x80000000UL);
+}
+
+/**
+ * @brief               Record at a logical position
+ * @param[in] index     Position, 0 is the oldest
+ * @return              Record
+ */
+template <uint16_t SIZE>
+s7xg_log_record_t & S7XGTrackLog<SIZE>::_at(uint16_t index) {
+    return _records[(_head + index) % SIZE];
+}